@@ -23,10 +23,28 @@
  */
 #include <stddef.h>
 
+#if defined(__cplusplus)
+extern "C" {
+#endif /* @__cplusplus */
+
 #define NOVA_MODE_DEBUG 1
 #define NOVA_FORCE_NV_TID_DEFPERM 1
 /* #define NOVA_LAZY_TIDINIT 1 */
 #define NOVA_TID_RECYCLING 1
+/* Let starved local heaps take half-empty blocks off their siblings (see
+ * __nv_local_lkg_steal_nl). Costs an FPGM round trip on local deallocations into
+ * non-head blocks, since those blocks can change owner under the deallocator.
+ */
+#if !defined(NOVA_BLOCK_STEALING)
+#    define NOVA_BLOCK_STEALING 1
+#endif /* !@NOVA_BLOCK_STEALING */
+/* Send blocks that were emptied mostly by one other thread's deallocations up to
+ * that thread's regional heap rather than their owner's (see __nv_lkg_empty).
+ * Costs a record update on every foreign deallocation.
+ */
+#if !defined(NOVA_BLOCK_MIGRATION)
+#    define NOVA_BLOCK_MIGRATION 1
+#endif /* !@NOVA_BLOCK_MIGRATION */
 
 /* We want this to be settable from the client; basically, to turn this on or off
  * the library's client should do the following
@@ -45,6 +63,99 @@
 /* A nv_blfl flag.
  */
 #define NOVA_BLFL_ISHEAD 1
+/* A nv_blfl flag.
+ * The block is sitting in one of the occupancy bins of a local linkage; which
+ * one is stored in the NOVA_BLFL_BINMASK bits.
+ */
+#define NOVA_BLFL_BINNED 2
+#define NOVA_BLFL_BINSHIFT 2
+#define NOVA_BLFL_BINMASK (3 << NOVA_BLFL_BINSHIFT)
+/* A nv_blfl flag.
+ * The block is formatted as a bitmap block (see nova_block_bitmap.c) rather than
+ * with an intrusive free list.
+ */
+#define NOVA_BLFL_BITMAP 16
+
+/* A nv_blfl flag.
+ * The block heads a span: a run of nv_ocnt contiguous pools in a span chunk that
+ * holds a single medium object, or, with nv_ocnt = 0, a mapping of its own for
+ * an object too large for a chunk (see nova_span.c).
+ */
+#define NOVA_BLFL_SPAN 32
+
+/* The rest of nv_blfl is the block's reset generation. nova_heap_reset bumps it
+ * (with the FPGM locked) on every block it takes back; a foreign deallocation
+ * that finds it changed by the time it has the FPGM leaves the block alone,
+ * since the reset already took care of its objects. It wraps around, which is
+ * fine as long as nobody sits between the two reads for 1024 resets.
+ */
+#define NOVA_BLFL_RGENSHIFT 6
+#define NOVA_BLFL_RGENMASK ((uint16_t)(0xffff << NOVA_BLFL_RGENSHIFT))
+
+/* nv_uhead layout: block address below NOVA_ULKG_TAGSHIFT, ABA counter above.
+ * Assumes user-space addresses fit in 48 bits.
+ */
+#define NOVA_ULKG_TAGSHIFT 48
+#define NOVA_ULKG_PTRMASK (((uintptr_t)1 << NOVA_ULKG_TAGSHIFT) - 1)
+/* For __nv_ulkg_pop: everything on the stack.
+ */
+#define NOVA_ULKG_ALL ((nvi_t)-1)
+
+/* Most blocks a local linkage will pull from upstream in one go.
+ */
+#define NOVA_REFILL_MAXBATCH 16
+
+/* Largest size class that gets formatted as a bitmap block. The maps take
+ * their space out of the block's pool (see nova_block_bitmap.c).
+ */
+#define NOVA_BMBLOCK_MAXOSZ 32
+
+/* Occupancy bins of a local linkage, from fullest to emptiest.
+ * Blocks that aren't the head of their linkage are never allocated from, so their
+ * allocation count only ever goes down, and they only ever move towards
+ * NOVA_LKG_BIN_LO (and then out of the linkage entirely when they hit zero).
+ */
+#define NOVA_LKG_BIN_FULL 0 /* acnt == ocnt */
+#define NOVA_LKG_BIN_HI 1   /* acnt > 3/4 ocnt */
+#define NOVA_LKG_BIN_MID 2  /* acnt >= 1/2 ocnt */
+#define NOVA_LKG_BIN_LO 3   /* acnt < 1/2 ocnt */
+#define NOVA_LKG_NBINS 4
+
+#define NOVA_LKG_BIN(___nv_ocnt___, ___nv_acnt___)                                      \
+    ((___nv_acnt___) >= (___nv_ocnt___)                         ? NOVA_LKG_BIN_FULL \
+     : 4 * (nvi_t)(___nv_acnt___) > 3 * (nvi_t)(___nv_ocnt___) ? NOVA_LKG_BIN_HI   \
+     : 2 * (nvi_t)(___nv_acnt___) >= (nvi_t)(___nv_ocnt___)    ? NOVA_LKG_BIN_MID  \
+                                                                 : NOVA_LKG_BIN_LO)
+
+/* Smallest size class; has to be able to hold a free list link (uint16_t), and
+ * sets the minimum alignment of every object handed out.
+ */
+#define NOVA_SMOBJ_MINOSZ 8
+/* Largest object handed out at all (as a span); the whole of a 47-bit user
+ * address space. Size classes stop here, which keeps the power-of-two round-up
+ * from overflowing: anything larger has no class (see __nv_canonicalize_osz) and
+ * is refused.
+ */
+#define NOVA_SPAN_MAXSZ ((nvi_t)1 << 47)
+/* Assumed size of a cache line, in bytes.
+ */
+#define NOVA_CACHELINE 64
+
+/* A nova_alloc_flags flag.
+ * The object is placed in a size class of at least NOVA_CACHELINE bytes, so it
+ * starts on a cache line boundary and never shares a line with another object.
+ */
+#define NOVA_ALLOC_CACHELINE 1
+
+/* A nova_heap_trim policy flag.
+ * Return the empty blocks the heap has parked for future refills.
+ */
+#define NOVA_TRIM_EMPTY 1
+/* A nova_heap_trim policy flag.
+ * Return the (non-head) blocks that are less than half full, live objects and
+ * all; they stay valid, and the regional heap hands the blocks out again later.
+ */
+#define NOVA_TRIM_SPARSE 2
 
 typedef enum nova_res { nova_ok   = 0,
                         nova_fail = 1 } nova_res_t;
@@ -85,26 +196,138 @@ typedef struct __attribute__ ((packed, aligned (128))) nova_block
     int nv_rbl[0]; /* +128 (0) */
 } nova_block_t;
 
+/* Remote deallocation record of a block (see __nv_block_rfstat); there's no room
+ * left for it in nova_block_t, so it lives in the chunk header instead. Guarded
+ * by the block's FPGM, and cleared by __nv_block_fmt.
+ */
+typedef struct nova_rfstat
+{
+    /* last thread to deallocate into the block through the foreign path */
+    nova_tid_t nv_rftid;
+    /* objects it has deallocated there since another thread last did */
+    nvi_t nv_rfcnt;
+} nova_rfstat_t;
+
 typedef struct nova_lkg
 {
     nova_block_t * nv_head;
+    /* Unsized linkages only: tagged top of the lock-free block stack; see
+     * nova_lkg_unsized.c. nv_head is unused on those.
+     */
+    /* __atomic */ uintptr_t nv_uhead;
+    /* Unsized linkages only: whether this is the root heap's, whose blocks are
+     * counted in their chunk's nv_nidle.
+     */
+    int nv_uroot;
     nova_mutex_t nv_ll;
     void * nv_heap;
+    /* Local linkages only: every non-head block, sorted by occupancy.
+     * Guarded by nv_ll.
+     */
+    nova_block_t * nv_bins[NOVA_LKG_NBINS];
+    /* Local sized linkages only: number of blocks to ask for the next time the
+     * linkage has to go upstream (1 .. NOVA_REFILL_MAXBATCH). Doubles every
+     * time the linkage goes upstream, halves every time the bins cover a refill.
+     * Guarded by nv_ll.
+     */
+    nvi_t nv_rfdmd;
 } nova_lkg_t;
 
 typedef struct nova_heap
 {
     struct nova_heap * nv_parent_heap;
+    /* next child of the same parent; guarded by the parent's nv_sibl */
+    struct nova_heap * nv_sibnx;
+    /* next heap waiting for the maintenance thread to drop it; see
+     * nova_heap_drop_async */
+    struct nova_heap * nv_dropnx;
     nvi_t nv_ln;
     nova_lkg_t nv_lkgs[];
 } nova_heap_t;
 
+/* Chunk layout (see NV_CHUNK_HDRPOOLS, NV_CHUNK_BLOCKCOUNT):
+ *
+ *  [ header pools: nova_chunk_t | nv_blocks[n] | pool map | rfstats[n] | slack ][ pool 0 ] ... [ pool n-1 ]
+ *
+ * nv_blocks[i] describes pool i, which starts (NV_CHUNK_HDRPOOLS + i) pools into
+ * the chunk. The pool map has one bit per pool (see __nv_chunk_pmap), followed
+ * by one nova_rfstat_t per block (see __nv_block_rfstat); whatever is left of
+ * the header pools after that is free for per-chunk bookkeeping (see
+ * __nv_chunk_slack).
+ */
 typedef struct nova_chunk
 {
     struct nova_chunk * nv_next;
-    nova_block_t nv_blocks[63];
+    /* Span chunks only (these all fit in the padding in front of nv_blocks): */
+    /* next span chunk of the same span allocator */
+    struct nova_chunk * nv_spnx;
+    /* regional heap whose span allocator owns this chunk */
+    nova_heap_t * nv_spheap;
+    /* Root chunks: number of the chunk's blocks on the root's unsized linkage,
+     * kept up by the linkage itself; NOVA_CHUNK_DYING is set once nova_reclaim
+     * has released the chunk (see nova_maint.c). __atomic.
+     */
+    nvi_t nv_nidle;
+    /* Direct spans only: length of the mapping, header included. */
+    nvi_t nv_dmsz;
+    /* NV_CHUNK_BLOCKCOUNT of them */
+    nova_block_t nv_blocks[];
 } nova_chunk_t;
 
+/* nv_nidle flag: the chunk's pools have gone back to the system, and its blocks
+ * are dropped as they come off the root's unsized linkage; the last one to come
+ * off takes the chunk with it.
+ */
+#define NOVA_CHUNK_DYING ((nvi_t)1 << 63)
+
+/* Span allocator; every regional heap has one, for objects too large for a
+ * small object pool.
+ */
+typedef struct nova_spa
+{
+    nova_mutex_t nv_spl;
+    /* span chunks, chained through nv_spnx; guarded by nv_spl */
+    nova_chunk_t * nv_chunks;
+} nova_spa_t;
+
+/* What a regional heap keeps in front of its nova_heap_t. The heap is a DST, so
+ * the only place for regional-only members is at a negative offset; the whole
+ * prefix sits right in front of the heap (see NOVA_RHEAP_PFX).
+ */
+typedef struct nova_rheap_pfx
+{
+    nova_spa_t nv_spa;
+    /* child heaps, chained through nv_sibnx; see __nv_regional_heap_adopt */
+    nova_mutex_t nv_sibl;
+    nova_heap_t * nv_children;
+    /* root heap only; pushed onto lock-free (see nv_chunk_bind_to_root), but
+     * unlinking from it and walking it need nv_chunkl */
+    nova_chunk_t * nv_chunks;
+    nova_mutex_t nv_chunkl;
+    /* __atomic */ uint64_t nv_refcnt;
+} nova_rheap_pfx_t;
+
+#define NOVA_RHEAP_PFX(___nv_heap___) (((nova_rheap_pfx_t *)(___nv_heap___)) - 1)
+
+/* Object constructor/destructor; see nova_objcache_create.
+ */
+typedef void (*nova_objfn_t) (void * nv_obj);
+
+/* Per-thread cache of constructed objects of one size (see nova_objcache.c).
+ */
+typedef struct nova_objcache
+{
+    /* regional heap the blocks come from and go back to */
+    nova_heap_t * nv_parent_heap;
+    nova_smobjsz_t nv_osz;
+    nova_objfn_t nv_ctor;
+    nova_objfn_t nv_dtor;
+    /* block allocations are served from; NULL until the first one */
+    nova_block_t * nv_cur;
+    /* every block of the cache (nv_cur included), chained through nv_lkgnx */
+    nova_block_t * nv_blocks;
+} nova_objcache_t;
+
 /** Initializes `nv_mutex` as a normal, non-reentrant mutex.
  */
 nova_res_t nvmutex_init (nova_mutex_t * nv_mutex);
@@ -137,6 +360,9 @@ nova_res_t nv_chunk_create (nova_chunk_t ** nv_chunk);
  * \target chunk
  *
  * \param nova_heap_t* nv_receiver regional heap to move the chunk's blocks to.
+ * \behaviour links blocks [nv_begin, nv_end) into a chain up front, and pushes
+ *            that onto the receiver's unsized linkage in one go.
+ * \notes only for fresh chunks: nothing else may be able to see the blocks.
  */
 nova_res_t __nv_chunk_release_blocks_to (nova_chunk_t * nv_chunk,
                                          nova_heap_t * nv_receiver,
@@ -146,24 +372,44 @@ nova_res_t __nv_chunk_release_blocks_to (nova_chunk_t * nv_chunk,
 nova_res_t __nv_chunk_destroy (nova_chunk_t * nv_chunk);
 nova_res_t nv_chunk_destroy_chained (nova_chunk_t * nv_chunk, nvi_t nv_number);
 nova_res_t nv_chunk_bind_to_root (nova_chunk_t * nv_chunk, nova_heap_t * nv_heap);
+/** Take `nv_chunk` back off the root heap `nv_heap`'s chunk list.
+ * \notes lock-free against nv_chunk_bind_to_root; takes the root's nv_chunkl
+ *        against other unbinders and walkers.
+ */
+nova_res_t __nv_chunk_unbind_from_root (nova_chunk_t * nv_chunk, nova_heap_t * nv_heap);
+/* Chunks come out of reserved address space (see nova_arena.c): the first
+ * reservation is NOVA_ARENA_INITCHUNKS chunks, and each one after that is twice
+ * the size of the last (up to NOVA_ARENA_MAXCHUNKS chunks), for at most
+ * NOVA_ARENA_MAXRGNS reservations.
+ */
+#define NOVA_ARENA_INITCHUNKS 64
+#define NOVA_ARENA_MAXCHUNKS 4096
+#define NOVA_ARENA_MAXRGNS 16
+
+/** Commit a fresh chunk from the arena, reserving more address space if needed.
+ * \behaviour fails once the arena has hit NOVA_ARENA_MAXRGNS, or if the chunk
+ *            size changed since the first reservation.
+ */
+nova_res_t __nv_arena_chunk_alloc (nova_chunk_t ** nv_chunk);
+/** Give a chunk that came from __nv_arena_chunk_alloc back to the arena.
+ */
+nova_res_t __nv_arena_chunk_release (nova_chunk_t * nv_chunk);
+/** Whether nv_ptr points into the arena. Doesn't lock.
+ */
+int __nv_arena_owns (void * nv_ptr);
+/** The chunk's pool map: NV_CHUNK_BLOCKCOUNT bits, rounded up to whole words.
+ * Span chunks use it to track which pools are taken (bit i set <=> pool i is
+ * part of a live span); it's unused otherwise.
+ */
+uint64_t * __nv_chunk_pmap (nova_chunk_t * nv_chunk);
+/** Unused tail of the chunk's header pools, and its size in bytes (which may be 0).
+ */
+void * __nv_chunk_slack (nova_chunk_t * nv_chunk, nvi_t * nv_size);
 
 nova_res_t nv_heap_create (nova_heap_t ** nv_heap);
 nova_res_t nv_heap_init (nova_heap_t * nv_heap, nvi_t nv_ln);
 nova_res_t nv_heap_bind_parent (nova_heap_t * nv_child, nova_heap_t * nv_parent);
 
-/** Give an evacuating block to a local heap to be passed up to the regional heap.
- *
- * \source local linkage
- * \target local heap
- * \payload block to pass on to regional heap
- * \notes should only be called when the local heap has informed the regional heap
- *        to prepare for the evacuation.
- *
- * \param nova_heap_t* nv_heap target
- * \param nova_block_t* nv_block payload
- */
-nova_res_t __nv_local_heap_pass_evac_nl_sl (nova_heap_t * nv_heap,
-                                            nova_block_t * nv_block);
 /** Try to allocate an object of size `nv_osz` into `nv_obj` from the given heap.
  * \source client-path
  * \target local heap
@@ -175,8 +421,18 @@ nova_res_t __nv_local_heap_pass_evac_nl_sl (nova_heap_t * nv_heap,
 nova_res_t __nv_local_heap_alloc (nova_heap_t * nv_heap,
                                   void ** nv_obj,
                                   nova_smobjsz_t nv_osz);
+/** Get a block formatted for `nv_osz` for one of `nv_heap`'s sized linkages.
+ * \source local linkage
+ * \target local heap
+ *
+ * \behaviour uses a block parked on the heap's unsized linkage if there is one;
+ *            otherwise asks the regional heap for up to `nv_n` blocks, and parks
+ *            the ones it doesn't need.
+ * \notes the block comes back with its FPGM locked.
+ */
 nova_res_t __nv_local_heap_req_block (nova_heap_t * nv_heap,
                                       nova_smobjsz_t nv_osz,
+                                      nvi_t nv_n,
                                       nova_block_t ** nv_block);
 
 /** Try to destroy the local heap `nv_heap`.
@@ -189,33 +445,166 @@ nova_res_t __nv_local_heap_req_block (nova_heap_t * nv_heap,
  * \param nova_heap_t* nv_heap target
  */
 nova_res_t __nv_local_heap_drop (nova_heap_t * nv_heap);
+/** Backend of nova_heap_trim.
+ * \source client
+ * \target local heap
+ */
+nvi_t __nv_local_heap_trim (nova_heap_t * nv_heap, nvi_t nv_policy);
+/** Backend of nova_heap_reset.
+ * \source client
+ * \target local heap
+ */
+nvi_t __nv_local_heap_reset (nova_heap_t * nv_heap);
+/** Backend of nova_heap_transfer; returns the number of blocks handed over.
+ * \source client
+ * \target local heap
+ */
+nvi_t __nv_local_heap_transfer (nova_heap_t * nv_heap, nova_tid_t nv_owner);
 
 nova_res_t __nv_regional_heap_create (nova_heap_t ** nv_heap);
 nova_res_t __nv_root_heap_create (nova_heap_t ** nv_heap);
-nova_res_t __nv_regional_heap_take_evac_block_nl_sl (nova_heap_t * nv_heap,
-                                                     nova_block_t * nv_ev_block);
-nova_res_t __nv_regional_heap_pass_evac_block_nl_sl (nova_heap_t * nv_heap,
-                                                     nova_block_t * nv_block);
 nova_res_t __nv_regional_heap_incref (nova_heap_t * nv_heap);
 nova_res_t __nv_regional_heap_decref (nova_heap_t * nv_heap);
 nova_res_t __nv_regional_heap_drop (nova_heap_t * nv_heap);
+/** Add `nv_child` to / remove it from the regional heap `nv_heap`'s list of
+ * children, which is what local heaps look through for siblings to steal from.
+ * \source nv_heap_bind_parent, dying child heap
+ */
+nova_res_t __nv_regional_heap_adopt (nova_heap_t * nv_heap, nova_heap_t * nv_child);
+nova_res_t __nv_regional_heap_abandon (nova_heap_t * nv_heap, nova_heap_t * nv_child);
+/** Get up to `nv_n` blocks from a regional heap (or its ancestors).
+ *
+ * \behaviour `nv_block` is set to a chain (through nv_lkgnx) of between 1 and
+ *            `nv_n` blocks: the first one is formatted for `nv_osz` and has its
+ *            FPGM locked; any others are empty, unformatted and unlocked.
+ *            Only empty blocks are handed out in batches; a partially used block
+ *            from a sized linkage always comes alone.
+ */
 nova_res_t __nv_regional_heap_req_block (nova_heap_t * nv_heap,
                                          nova_smobjsz_t nv_osz,
+                                         nvi_t nv_n,
                                          nova_block_t ** nv_block);
+/** Same as __nv_regional_heap_req_block, but only ever hands out empty blocks,
+ * and leaves all of them unformatted (the first one still has its FPGM locked).
+ * \source object cache, root heap refill
+ */
+nova_res_t __nv_regional_heap_req_empty (nova_heap_t * nv_heap,
+                                         nvi_t nv_n,
+                                         nova_block_t ** nv_chain);
+
+/** Carve a span big enough for `nv_size` bytes out of the regional heap
+ * `nv_heap`'s span allocator, and put its base in `nv_obj`.
+ * \behaviour takes a fresh span chunk if none of the current ones has a long
+ *            enough run of free pools; spans longer than NV_CHUNK_BLOCKCOUNT
+ *            pools are mapped directly instead.
+ */
+nova_res_t __nv_span_alloc (nova_heap_t * nv_heap, nvi_t nv_size, void ** nv_obj);
+/** Return the span headed by `nv_block` to its span allocator; neighbouring free
+ * runs coalesce automatically.
+ * \behaviour a span chunk left with no spans goes back to the system, and so
+ *            does a direct span.
+ */
+nova_res_t __nv_span_dealloc (nova_block_t * nv_block);
+/** Grow or shrink the span headed by `nv_block` in place so that it covers
+ * `nv_size` bytes. Fails (leaving the span untouched) if the pools after the span
+ * aren't free.
+ * \notes direct spans can only shrink, and only while they still need a mapping.
+ */
+nova_res_t __nv_span_resize (nova_block_t * nv_block, nvi_t nv_size);
+/** Number of bytes usable in the span headed by `nv_block`.
+ */
+nvi_t __nv_span_size (nova_block_t * nv_block);
+nova_res_t __nv_spa_init (nova_spa_t * nv_spa);
+/** Hand every span chunk of `nv_from` over to `nv_to`.
+ * \source dying regional heap
+ */
+nova_res_t __nv_spa_pass (nova_spa_t * nv_from, nova_heap_t * nv_to);
 
 nova_res_t nv_lkg_init (nova_lkg_t * nv_lkg);
 nova_res_t nv_lkg_req_block (nova_lkg_t * nv_lkg,
                              nova_block_t ** nv_block);
+/** Block request for unsized linkages: pops up to `nv_n` blocks off the
+ * linkage's stack in one go, and returns how many it got. The chain runs through
+ * nv_lkgnx; only the first block has its FPGM locked.
+ */
+nvi_t nv_lkg_req_blocks (nova_lkg_t * nv_lkg,
+                         nvi_t nv_n,
+                         nova_block_t ** nv_chain);
+
+#define NOVA_LKG_UNSIZED(___nv_lkg___) \
+    ((___nv_lkg___) == &((nova_heap_t *)(___nv_lkg___)->nv_heap)->nv_lkgs[0])
+
+/** Push the chain `nv_first` .. `nv_last` (through nv_lkgnx) onto the unsized
+ * linkage `nv_lkg`. Lock-free.
+ * \notes the blocks have to be empty, and their FPGMs unlocked.
+ */
+nova_res_t __nv_ulkg_push (nova_lkg_t * nv_lkg, nova_block_t * nv_first, nova_block_t * nv_last);
+/** Pop up to `nv_n` blocks (NOVA_ULKG_ALL for all of them) off the unsized
+ * linkage `nv_lkg`, as a NULL-terminated chain through nv_lkgnx. Lock-free.
+ * Returns how many it got; `nv_chain` is only written if that's non-zero.
+ * \notes on the root's linkage, blocks of chunks released by nova_reclaim are
+ *        dropped rather than returned, and the last one out destroys its chunk.
+ */
+nvi_t __nv_ulkg_pop (nova_lkg_t * nv_lkg, nvi_t nv_n, nova_block_t ** nv_chain);
+/** Receive a single empty block whose FPGM is locked; unlocks the FPGM and
+ * pushes the block onto the unsized linkage `nv_lkg`.
+ */
+nova_res_t __nv_ulkg_receive_block_sl (nova_lkg_t * nv_lkg, nova_block_t * nv_block);
+/** Move everything on the unsized linkage `nv_from` over to the unsized linkage
+ * `nv_to`; returns the number of blocks moved. Lock-free.
+ */
+nvi_t __nv_ulkg_pass (nova_lkg_t * nv_from, nova_lkg_t * nv_to);
 
-/** Drop a local linkage.
+/** Drop a local linkage, passing all of its blocks up to the same linkage of the
+ * heap's parent.
  *
  * \source local heap
  * \target local linkage
- * \notes should only be called after the regional heap has been prepped.
+ * \behaviour the blocks are detached under the linkage's own LL, and spliced
+ *            into the parent's linkage as a single chain (see __nv_lkg_pass_up),
+ *            so the parent's LL is only held for constant time.
+ * \notes no other locks may be held.
  *
  * \param nova_lkg_t* nv_lkg target
  */
 nova_res_t __nv_local_lkg_drop (nova_lkg_t * nv_lkg);
+/** Make sure no deallocation into `nv_lkg` can take the local path anymore:
+ * the head is binned like any other block and loses its owner (and so do the
+ * binned blocks, without NOVA_BLOCK_STEALING).
+ * \source nova_heap_drop_async
+ * \notes has to be called from the owning thread; no other locks may be held.
+ */
+void __nv_local_lkg_disown (nova_lkg_t * nv_lkg);
+/** Pass every non-head block in `nv_lkg`'s NOVA_LKG_BIN_LO bin up to the same
+ * linkage of the heap's parent, the same way __nv_local_lkg_drop does; returns
+ * the number of blocks passed.
+ * \source local heap (trim)
+ * \notes no other locks may be held.
+ */
+nvi_t __nv_local_lkg_trim (nova_lkg_t * nv_lkg);
+/** Take back every block of `nv_lkg` (head included), live objects and all, and
+ * park them on the heap's own unsized linkage; returns the number of blocks.
+ * \source local heap (reset)
+ * \behaviour each block is reset with __nv_block_reset_sl; the free lists are
+ *            rebuilt by __nv_block_fmt when the block is next handed out.
+ * \notes no other locks may be held.
+ */
+nvi_t __nv_local_lkg_reset (nova_lkg_t * nv_lkg);
+/** Hand every block of `nv_lkg` (head included) over to the thread `nv_owner`,
+ * with __nv_block_transfer_sl; returns the number of blocks.
+ * \source local heap (transfer)
+ * \notes no other locks may be held.
+ */
+nvi_t __nv_local_lkg_transfer (nova_lkg_t * nv_lkg, nova_tid_t nv_owner);
+/** Allocate from `nv_block`, a non-head block binned on `nv_lkg`, rather than
+ * from the head; fails if the block isn't the calling thread's, isn't (or is no
+ * longer) on nv_lkg, or has no free object.
+ * \source client (nova_alloc_near)
+ * \behaviour pulls in the FPG if the FPL is empty, and rebins the block.
+ * \notes no other locks may be held. nv_lkg must belong to a local heap of the
+ *        calling thread.
+ */
+nova_res_t __nv_local_lkg_alloc_near (nova_lkg_t * nv_lkg, nova_block_t * nv_block, void ** nv_obj);
 /** Try to allocate an object of size `nv_osz` into `nv_obj` from the given linkage.
  *
  * \source local heap
@@ -236,12 +625,78 @@ nova_res_t __nv_local_lkg_alloc (nova_lkg_t * nv_lkg,
                                  void ** nv_obj,
                                  nova_smobjsz_t nv_osz,
                                  nova_heap_t * nv_heap);
+/** File a non-head block into the occupancy bin matching its current allocation
+ * count.
+ * \notes nv_lkg's LL must be locked.
+ */
+nova_res_t __nv_local_lkg_bin_nl (nova_lkg_t * nv_lkg, nova_block_t * nv_block);
+/** Take a block out of whichever occupancy bin it is in.
+ * \notes nv_lkg's LL must be locked.
+ */
+nova_res_t __nv_local_lkg_unbin_nl (nova_lkg_t * nv_lkg, nova_block_t * nv_block);
+/** Take a half-empty block for `nv_lkg` off the same-sized linkage of one of its
+ * heap's siblings, and hand it over to `nv_lkg` and the calling thread.
+ * \source local linkage, after the bins came up empty
+ * \behaviour only looks at siblings whose LL it can get without waiting, and
+ *            only takes from a sibling that has more than one block in its
+ *            NOVA_LKG_BIN_LO bin. Returns NULL if there was nothing to take.
+ * \notes nv_lkg's LL must be locked. The block comes back unbinned, with its
+ *        FPGM locked.
+ */
+nova_block_t * __nv_local_lkg_steal_nl (nova_lkg_t * nv_lkg);
 
+/** A binned block just became empty: take it off its (local) linkage and pass it
+ * up to the parent's unsized linkage.
+ *
+ * \behaviour with NOVA_BLOCK_MIGRATION, if at least half of the block's objects
+ *            were deallocated in a row by the calling thread through the foreign
+ *            path, and the calling thread's default heap has a different parent
+ *            under the same root, the block goes up to that parent instead.
+ * \source block deallocation
+ * \target the block's linkage
+ * \notes called with the linkage's LL and the block's FPGM locked; both are
+ *        released before returning.
+ */
+nova_res_t __nv_lkg_empty (nova_block_t * nv_block);
+/** A non-head block's allocation count just crossed into a different occupancy
+ * bin ("empty enough"); refile it.
+ *
+ * \source block deallocation
+ * \target the block's linkage
+ * \notes called with the linkage's LL locked; it is released before returning.
+ */
+nova_res_t __nv_lkg_empty_e (nova_block_t * nv_block);
+
+/** Hand a chain of blocks (through nv_lkgnx) that a linkage of some child heap
+ * has let go of to linkage `nv_li` of `nv_heap`. Empty blocks go on the unsized
+ * linkage, the rest are spliced into the sized one in one go.
+ *
+ * \source dropping or trimming linkage
+ * \notes the blocks have to be off every linkage already, with no flags set, a
+ *        NULL nv_lkg and nv_owner 0 (see __nv_lkg_release_nl), and their FPGMs
+ *        unlocked. Takes the LL of linkage `nv_li` of `nv_heap` for constant time.
+ */
+nova_res_t __nv_lkg_pass_up (nova_heap_t * nv_heap, nvi_t nv_li, nova_block_t * nv_chain);
+/** Let go of a block for good, as part of a chain going upstream: clears the
+ * bin bits and the owner, and NULLs nv_lkg so that deallocations leave the block
+ * alone from now on.
+ * \notes the LL of the block's linkage must be locked; the head flag has to have
+ *        been cleared already (under the FPGM).
+ */
+void __nv_lkg_release_nl (nova_block_t * nv_block);
+/** Drop a regional linkage, passing all of its blocks up to the same linkage of
+ * the heap's parent (see __nv_local_lkg_drop).
+ */
 nova_res_t __nv_regional_lkg_drop (nova_lkg_t * nv_lkg);
-nova_res_t __nv_regional_lkg_receive_block_nl_sl (nova_lkg_t * nv_lkg,
-                                                  nova_block_t * nv_block);
 
 nova_res_t nv_block_init (nova_block_t * nv_block, void * nv_block_memory);
+/** Run nv_block_init on a block header that nv_chunk_create left uninitialized
+ * (nv_base == NULL); no-op otherwise. Keeps the block's linkage members.
+ * \notes whoever calls this has to have exclusive access to the block, i.e.
+ *        hold the LL of the linkage it's on (or have just taken it off one).
+ *        The FPGM isn't usable until this has run.
+ */
+nova_res_t __nv_block_init_lazy (nova_block_t * nv_block);
 /** Formats nv_block into objects of size `nv_osz`.
  * \behaviour this sets up the free list in memory, and modifies nv_fpl and nv_fpg
  *            to get things set up.
@@ -261,9 +716,317 @@ nova_res_t __nv_block_alloc_inner (nova_block_t * nv_block, void ** nv_obj);
 #if NOVA_MODE_DEBUG
 nova_res_t __nv_block_dealloc (nova_block_t * nv_block, void * nv_obj);
 #endif
+/** Return `nv_n` objects, all belonging to `nv_block`, in one go.
+ * \behaviour equivalent to nv_n calls to __nv_dealloc_smobj, but takes the FPGM
+ *            and adjusts the allocation count once.
+ */
+nova_res_t __nv_block_dealloc_bulk (nova_block_t * nv_block, void ** nv_objs, nvi_t nv_n);
+/** The remote deallocation record of `nv_block`, in its chunk's header.
+ */
+nova_rfstat_t * __nv_block_rfstat (nova_block_t * nv_block);
+/** Count `nv_n` foreign deallocations into `nv_block` from the calling thread.
+ * \notes FPGM must be locked.
+ */
+void __nv_block_note_remote_sl (nova_block_t * nv_block, nvi_t nv_n);
+/** Whether a deallocation into `nv_block` from the calling thread can go to the
+ * block's local free list (or map).
+ * \behaviour `nv_fpgm_held` is set if the FPGM had to be taken to decide; the
+ *            caller then releases it once it's done with either free list.
+ * \notes with NOVA_BLOCK_STEALING, a non-head block can be given to another
+ *        thread as long as its FPGM is free; see __nv_local_lkg_steal_nl.
+ */
+int __nv_block_dealloc_is_local (nova_block_t * nv_block, int * nv_fpgm_held);
+/** Whether `nv_block` has been reset (see nova_heap_reset) since its flags read
+ * `nv_blfl`. Only meaningful with the FPGM locked.
+ */
+int __nv_block_was_reset (nova_block_t * nv_block, uint16_t nv_blfl);
+/** Forget every object on `nv_block`: bumps the reset generation, clears the
+ * head and bin flags, the free pointers and the allocation count, and NULLs
+ * nv_lkg.
+ * \notes FPGM must be locked (and the LL of the block's linkage, if any).
+ */
+void __nv_block_reset_sl (nova_block_t * nv_block);
+/** Make the thread `nv_owner` the owner of `nv_block`, folding whatever foreign
+ * deallocations are pending into the local free list (or map) on the way.
+ * \notes FPGM must be locked (and the LL of the block's linkage); called from
+ *        the block's current owner.
+ */
+void __nv_block_transfer_sl (nova_block_t * nv_block, nova_tid_t nv_owner);
+
+/** Call `nv_fn` on every free object of the bitmap block `nv_block`, after
+ * folding the foreign map into the local one; returns the number of objects.
+ * \notes called from the thread that owns the block.
+ */
+nvi_t __nv_bmblock_for_each_free (nova_block_t * nv_block, nova_objfn_t nv_fn);
+/** Fold the foreign map of the bitmap block `nv_block` into the local one.
+ * \notes FPGM must be locked; called from the thread that owns the block.
+ */
+void __nv_bmblock_reclaim_sl (nova_block_t * nv_block);
+/** Formats nv_block as a bitmap block of objects of size `nv_osz`.
+ * \notes called by __nv_block_fmt for nv_osz <= NOVA_BMBLOCK_MAXOSZ; same
+ *        assumptions.
+ */
+nova_res_t __nv_bmblock_fmt (nova_block_t * nv_block, nova_smobjsz_t nv_osz);
+nova_res_t __nv_bmblock_alloc (nova_block_t * nv_block, void ** nv_obj);
+/** Allocate up to `nv_n` objects from the owning thread, by consuming whole words
+ * of the local map at a time; the number actually allocated goes in `nv_got`.
+ */
+nova_res_t __nv_bmblock_alloc_bulk (nova_block_t * nv_block,
+                                    void ** nv_objs,
+                                    nvi_t nv_n,
+                                    nvi_t * nv_got);
+/** Mark `nv_n` objects of `nv_block` as free in the appropriate (local or
+ * foreign) map, and take them off the allocation count; what's left of it goes
+ * in `nv_racnt`, for the caller to settle (see __nv_block_dealloc_bulk).
+ * \behaviour `nv_blfl` is the block's flags as the caller first saw them; if
+ *            the block has been reset since (see nova_heap_reset), nothing is
+ *            touched, and nova_fail is returned.
+ */
+nova_res_t __nv_bmblock_release (nova_block_t * nv_block,
+                                 void ** nv_objs,
+                                 nvi_t nv_n,
+                                 uint16_t nv_blfl,
+                                 nova_smobjcnt_t * nv_racnt);
 
+/** Find the block that owns the small object `nv_obj`.
+ * \behaviour pure address arithmetic on the chunk geometry; never touches the
+ *            object's memory.
+ */
+nova_block_t * __nv_smobj_block (void * nv_obj);
 nova_res_t __nv_dealloc_smobj (void * nv_obj);
 
+/** Allocate an object of `nv_size` bytes from the local heap `nv_heap`.
+ * Returns NULL on failure.
+ * \notes objects too large for a small object pool get a span from the local
+ *        heap's parent, or a mapping of their own if they don't fit in a chunk.
+ */
+void * nova_alloc (nova_heap_t * nv_heap, nvi_t nv_size);
+/** Same as nova_alloc, but takes NOVA_ALLOC_* flags in `nv_alfl`.
+ */
+void * nova_alloc_flags (nova_heap_t * nv_heap, nvi_t nv_size, nvi_t nv_alfl);
+/** Allocate an object of `nv_size` bytes aligned to `nv_align` from the local
+ * heap `nv_heap`.
+ *
+ * \behaviour the alignment is provided by the size class (classes are powers
+ *            of two, and pools are aligned inside their chunk), so this never
+ *            over-allocates beyond the size class of max(nv_size, nv_align).
+ *
+ * \notes nv_align must be a power of two, and may not exceed the alignment of a
+ *        small object pool.
+ */
+void * nova_memalign (nova_heap_t * nv_heap, nvi_t nv_align, nvi_t nv_size);
+/** Return an object to the block it was allocated from. NULL is ignored.
+ */
+void nova_free (void * nv_obj);
+/** Allocate up to `nv_n` objects of `nv_size` bytes into `nv_objs`; returns the
+ * number of objects actually allocated.
+ * \behaviour tiny classes are served a word of the block's bitmap at a time.
+ */
+nvi_t nova_alloc_bulk (nova_heap_t * nv_heap, nvi_t nv_size, void ** nv_objs, nvi_t nv_n);
+/** Free `nv_n` objects. Runs of objects from the same block are returned
+ * together. NULLs are ignored.
+ */
+void nova_free_bulk (void ** nv_objs, nvi_t nv_n);
+/** Resize `nv_obj` to `nv_size` bytes.
+ *
+ * \behaviour if nv_size still fits in the object's size class, nv_obj is
+ *            returned as-is; otherwise a new object is allocated from `nv_heap`,
+ *            the contents are copied over once, and nv_obj is freed.
+ *            Spans are resized in place when the neighbouring pools allow.
+ *            NULL nv_obj behaves like nova_alloc, and nv_size=0 like nova_free.
+ *
+ * \notes on failure, NULL is returned and nv_obj is left untouched.
+ */
+void * nova_realloc (nova_heap_t * nv_heap, void * nv_obj, nvi_t nv_size);
+/** Number of bytes actually usable at `nv_obj` (i.e. the size of its class, or
+ * the length of its span).
+ * Returns 0 for NULL.
+ */
+nvi_t nova_usable_size (void * nv_obj);
+/** Give blocks that the local heap `nv_heap` isn't using back to its regional
+ * heap; `nv_policy` is a combination of NOVA_TRIM_* flags. Returns the number of
+ * blocks given back.
+ *
+ * \behaviour the head block of every linkage is always kept, so the next
+ *            allocation of each size doesn't have to go upstream.
+ * \notes must be called from the thread that allocates from nv_heap, e.g. when
+ *        it goes idle.
+ */
+nvi_t nova_heap_trim (nova_heap_t * nv_heap, nvi_t nv_policy);
+/** Free every small object allocated from the local heap `nv_heap` at once, in
+ * time proportional to the number of blocks rather than objects. Returns the
+ * number of blocks taken back.
+ *
+ * \behaviour the blocks stay with nv_heap (parked, like after a batch refill)
+ *            and are reformatted as they're needed again. Spans (objects too
+ *            large for a small object pool) are not affected.
+ * \notes must be called from the thread that allocates from nv_heap. Frees
+ *        that other threads are already in the middle of are dropped safely;
+ *        freeing any of the objects after nova_heap_reset returns is a double
+ *        free.
+ */
+nvi_t nova_heap_reset (nova_heap_t * nv_heap);
+/** Hand the local heap `nv_heap` over to the thread with id `nv_owner` (see
+ * nova_thread_id), so that its frees of the heap's objects take the local path
+ * instead of going through the FPGM.
+ *
+ * \behaviour every block on the heap's sized linkages gets the new owner, and
+ *            the frees that other threads left on it are folded into its local
+ *            free list (or map).
+ * \notes must be called from the thread that allocates from nv_heap, which may
+ *        not allocate from it afterwards; nv_owner may start allocating from it
+ *        once it knows the call has returned. Frees (from any thread,
+ *        including the old owner) are fine throughout. Not for default heaps.
+ */
+nova_res_t nova_heap_transfer (nova_heap_t * nv_heap, nova_tid_t nv_owner);
+/** nova_alloc, but from the same block as the object `nv_hint` if possible, so
+ * that objects that are used together (e.g. neighbouring nodes of a tree or a
+ * list) share pages and cache sets.
+ *
+ * \behaviour the object comes from nv_hint's block if it's one of nv_heap's
+ *            blocks of the same size class, with a free object; otherwise (or
+ *            if nv_hint is NULL), this is just nova_alloc.
+ * \notes nv_hint must be NULL or a live object. Allocating from a block other
+ *        than the head takes the linkage's LL and the block's FPGM, so this is
+ *        slower than nova_alloc when the hint pays off.
+ */
+void * nova_alloc_near (nova_heap_t * nv_heap, void * nv_hint, nvi_t nv_size);
+/** Release every chunk of the root heap `nv_root` whose blocks are all sitting
+ * idle on the root's unsized linkage, except for the first `nv_keep` of them;
+ * returns the number of chunks released.
+ *
+ * \behaviour released chunks have their pools returned to the system right
+ *            away; the header pools follow (and the chunk goes back to the
+ *            arena) once its blocks have worked their way off the unsized
+ *            linkage. Chunks that didn't come from the arena are left alone.
+ *            Doesn't take anything off the unsized linkage itself, so refills
+ *            carry on as usual meanwhile.
+ * \notes may be called from any thread, at any time, as long as nv_root
+ *        outlives the call.
+ */
+nvi_t nova_reclaim (nova_heap_t * nv_root, nvi_t nv_keep);
+/** Start a background thread that runs nova_reclaim(nv_root, nv_keep) every
+ * `nv_period_ms` milliseconds. The smaller the period and nv_keep, the more
+ * aggressively memory is given back (and the more often bursts have to make
+ * new chunks).
+ * \notes there is only ever one maintenance thread; fails if it's already
+ *        running. Stop it with nova_maint_stop before dropping nv_root.
+ */
+nova_res_t nova_maint_start (nova_heap_t * nv_root, nvi_t nv_period_ms, nvi_t nv_keep);
+/** Stop the maintenance thread and wait for it to exit, after it has dropped
+ * any heaps still queued by nova_heap_drop_async; no-op if it isn't running.
+ */
+nova_res_t nova_maint_stop (void);
+/** Drop the local heap `nv_heap` on the maintenance thread instead of the
+ * calling one; returns right away.
+ *
+ * \behaviour the heap is queued, and the maintenance thread wakes up to drop it
+ *            (along with its regional heap, if that was the last reference).
+ *            If the maintenance thread isn't running, the heap is dropped on the
+ *            spot, same as __nv_local_heap_drop. Either way, the heap's blocks
+ *            are disowned first (see __nv_local_lkg_disown), so the caller's own
+ *            frees into them from then on go through the FPGM.
+ * \notes nv_heap may not be allocated from once this is called; objects on it
+ *        may still be freed, from any thread. nova_maint_stop drops whatever is
+ *        still queued before it returns.
+ */
+nova_res_t nova_heap_drop_async (nova_heap_t * nv_heap);
+/** Create an object cache for objects of `nv_size` bytes, with blocks coming
+ * from the regional heap `nv_parent`.
+ *
+ * \behaviour `nv_ctor` (if not NULL) is run on every object of a block when the
+ *            block is taken into the cache, and `nv_dtor` (if not NULL) on every
+ *            object when the block leaves it (see nova_objcache_reap); in
+ *            between, freed objects keep whatever state they were freed in, so
+ *            clients should free them in their constructed state.
+ * \notes allocation is for the creating thread only; objects may be freed with
+ *        nova_free from any thread. Fails if nv_size is more than half a pool.
+ *        Objects are aligned to at most 64 bytes.
+ */
+nova_res_t nova_objcache_create (nova_objcache_t ** nv_cache,
+                                 nova_heap_t * nv_parent,
+                                 nvi_t nv_size,
+                                 nova_objfn_t nv_ctor,
+                                 nova_objfn_t nv_dtor);
+/** Allocate a constructed object from `nv_cache`; NULL if out of memory.
+ */
+void * nova_objcache_alloc (nova_objcache_t * nv_cache);
+/** Destroy every object of the cache's fully free blocks and give the blocks
+ * back to the regional heap; returns the number of blocks given back. The block
+ * allocations are currently served from is kept.
+ * \notes creating thread only.
+ */
+nvi_t nova_objcache_reap (nova_objcache_t * nv_cache);
+/** Destroy the free objects of every block and hand all of the blocks back to
+ * the regional heap, then free the cache.
+ * \notes creating thread only. Objects still live at this point are never
+ *        destroyed; they can still be freed (with nova_free), but don't come
+ *        back constructed.
+ */
+nova_res_t nova_objcache_drop (nova_objcache_t * nv_cache);
+/** Make the regional heap `nv_parent` the parent of every default heap created
+ * from here on (see nova_default_heap); NULL unsets it.
+ * \notes holds a reference on nv_parent until it's replaced. Default heaps that
+ *        already exist keep the parent they were made under.
+ */
+nova_res_t nova_set_default_parent (nova_heap_t * nv_parent);
+/** Backend of nova_default_heap: make the calling thread's default heap.
+ * \source client
+ * \target default parent heap
+ */
+nova_heap_t * __nv_default_heap_create ();
+/* The calling thread's default heap, if it has one yet. __thread rather than
+ * _Thread_local, so that C++ clients can see it as well.
+ */
+extern __thread nova_heap_t * __nv_dheap_local;
+/** The calling thread's default heap; NULL if it couldn't be made.
+ *
+ * \behaviour made on first use, under the default parent (and with a thread id
+ *            for the calling thread, if it didn't have one yet); dropped when the
+ *            thread exits, along with the thread id if it was made here.
+ * \notes fails if nova_set_default_parent hasn't been called.
+ */
+static inline nova_heap_t * nova_default_heap (void)
+{
+    nova_heap_t * _nv_heap = __nv_dheap_local;
+    if (__builtin_expect (_nv_heap != NULL, 1)) {
+        return _nv_heap;
+    }
+    return __nv_default_heap_create ();
+}
+/** nova_alloc from the calling thread's default heap.
+ */
+void * nova_malloc (nvi_t nv_size);
+/** Free `nv_obj` once no thread can be using it anymore: once every thread
+ * taking part (see nova_quiesce) has quiesced since, twice over. For nodes of
+ * lock-free structures, which readers may still be looking at after they've
+ * been unlinked.
+ *
+ * \behaviour the object goes on the calling thread's limbo list, and is freed
+ *            with the rest of its batch by a later nova_quiesce (see
+ *            nova_epoch.c). NULL is ignored. Deferring doesn't make the thread
+ *            take part: one that never quiesces doesn't hold anybody up, but
+ *            its objects are only freed once it does, or once it exits.
+ * \notes fails only if the limbo list can't grow (or the thread can't be
+ *        registered); the object is not freed in that case.
+ */
+nova_res_t nova_free_deferred (void * nv_obj);
+/** Declare that the calling thread holds no references into any structure whose
+ * objects are freed with nova_free_deferred (a quiescent point), and free
+ * whatever of its deferred objects have become safe to; returns how many were
+ * freed.
+ *
+ * \behaviour the first call registers the thread; from then on, no deferred
+ *            object is freed until the thread has quiesced again. A thread
+ *            that exits stops taking part, and its pending objects are freed
+ *            by other threads' quiescent points.
+ * \notes every thread that reads such structures has to have called this
+ *        before its first access, and keep calling it (e.g. once per operation
+ *        or per batch of operations); a registered thread that stops quiescing
+ *        holds up every deferred free.
+ */
+nvi_t nova_quiesce (void);
+
 typedef enum nvcfg {
     /* Retrieves the size of a chunk, in bytes
      */
@@ -274,9 +1037,38 @@ typedef enum nvcfg {
     /* Retrieves number of pools per heap
      */
     NV_SMOBJ_POOLCOUNT,
+    /* Derived (read-only): retrieves the number of pools at the start of a chunk
+     * that hold the chunk header, block headers and pool map.
+     */
+    NV_CHUNK_HDRPOOLS,
+    /* Derived (read-only): retrieves the number of blocks in a chunk, i.e.
+     * NV_CHUNKSIZE / NV_SMOBJ_POOLSIZE - NV_CHUNK_HDRPOOLS.
+     */
+    NV_CHUNK_BLOCKCOUNT,
 } nvcfg_t;
 
+/* Defaults, for anything that isn't set with nova_set_cfg.
+ */
+#define NOVA_CFG_CHUNKSIZE 0x100000
+#define NOVA_CFG_SMOBJ_POOLSIZE 0x4000
+#define NOVA_CFG_SMOBJ_POOLCOUNT 14
+
 nvi_t nova_read_cfg (nvcfg_t);
+/** Set a configuration parameter.
+ * \behaviour fails (and changes nothing) for derived parameters, or if the
+ *            resulting chunk geometry isn't valid: chunk and pool sizes have to be
+ *            powers of two, pools no larger than 64KB, and a chunk has to have
+ *            room for at least one block and at most 65535.
+ *            NV_CHUNKSIZE and NV_SMOBJ_POOLSIZE are refused once the first
+ *            chunk (or direct span) has been created: every live object's block
+ *            is found from them.
+ */
+nova_res_t nova_set_cfg (nvcfg_t nv_cfg, nvi_t nv_value);
+/** Fix the chunk geometry for good; nova_set_cfg refuses to change it from here
+ * on.
+ * \source chunk creation, direct spans
+ */
+void __nv_cfg_freeze (void);
 
 typedef enum nve {
     /* We're actually ok
@@ -379,18 +1171,76 @@ nova_res_t __nvd_validate_range (void * nv_range_base,
 /* \behaviour shall never return 0
  *            shall not yet return 1
  *            may return values >= 2
+ *            returns ~0 for sizes above NOVA_SPAN_MAXSZ
  */
 nvi_t __nv_lindex (nvi_t nv_osz);
 
+/* \behaviour sizes above NOVA_SPAN_MAXSZ have no class, and come back as they
+ *            are.
+ */
 nvi_t __nv_canonicalize_osz (nvi_t nv_osz);
 
 nova_res_t __nv_cache_reload_from_cfg (uintptr_t nv_override,
                                        nvcfg_t nv_cfg,
                                        uintptr_t * nv_cache);
-extern uintptr_t _nv_dealloc_csize_cache, _nv_dealloc_smobjplsz_cache;
+extern uintptr_t _nv_dealloc_csize_cache, _nv_dealloc_smobjplsz_cache, _nv_dealloc_hdrpools_cache;
 
 nova_tid_t __nv_tid ();
+/** The calling thread's id, as far as block ownership is concerned; 0 if the
+ * thread doesn't have one yet (nova_default_heap sets one up, as does
+ * __nv_tid_thread_init).
+ */
+nova_tid_t nova_thread_id (void);
 nova_res_t __nv_tid_thread_init ();
 nova_res_t __nv_tid_thread_drop ();
 nova_res_t __nv_tid_recycle_init ();
 nova_res_t __nv_tid_recycle_drop ();
+
+/* Constant-expression forms of __nv_canonicalize_osz and __nv_lindex (the two
+ * pairs have to agree), for sizes known at compile time.
+ */
+#define NOVA_CANONICAL_OSZ(___nv_osz___)                                       \
+    ((___nv_osz___) <= NOVA_SMOBJ_MINOSZ  ? (nvi_t)NOVA_SMOBJ_MINOSZ           \
+     : (___nv_osz___) > NOVA_SPAN_MAXSZ ? (nvi_t)(___nv_osz___)              \
+                                          : (nvi_t)1 << (64 - __builtin_clzll ((unsigned long long)((___nv_osz___) - 1))))
+#define NOVA_LINDEX(___nv_osz___)                        \
+    ((___nv_osz___) > NOVA_SPAN_MAXSZ ? ~(nvi_t)0        \
+                                      : (nvi_t)__builtin_ctzll ((unsigned long long)NOVA_CANONICAL_OSZ (___nv_osz___)) - 1)
+
+/** nova_alloc, for when `nv_size` is a compile-time constant: the size class and
+ * linkage are then constant-folded, and the call goes straight to the local
+ * linkage.
+ * \behaviour falls back to nova_alloc if nv_size isn't a constant (or the
+ *            compiler can't tell), or the object doesn't fit in a small object
+ *            pool.
+ */
+static inline __attribute__ ((always_inline)) void * nova_alloc_const (nova_heap_t * nv_heap, nvi_t nv_size)
+{
+    if (__builtin_constant_p (nv_size) && NOVA_CANONICAL_OSZ (nv_size) <= UINT16_MAX) {
+        /* Same test as __nv_is_smobj; only the pool size is left for run time.
+         */
+        if (__builtin_expect (NOVA_LINDEX (nv_size) < nv_heap->nv_ln
+                                  && NOVA_CANONICAL_OSZ (nv_size) <= __atomic_load_n (&_nv_dealloc_smobjplsz_cache, __ATOMIC_RELAXED),
+                              1)) {
+            void * _nv_obj;
+            if (__builtin_expect (nova_ok != __nv_local_lkg_alloc (&nv_heap->nv_lkgs[NOVA_LINDEX (nv_size)], &_nv_obj, (nova_smobjsz_t)NOVA_CANONICAL_OSZ (nv_size), nv_heap), 0)) {
+                return NULL;
+            }
+            return _nv_obj;
+        }
+    }
+    return nova_alloc (nv_heap, nv_size);
+}
+
+/** Allocate an uninitialized object of type `___nv_type___` from the local heap
+ * `___nv_heap___` (see nova_alloc_const); evaluates to a `___nv_type___ *`, NULL
+ * on failure.
+ * \notes the class of a type is never smaller than its alignment, so the object
+ *        is always suitably aligned.
+ */
+#define NOVA_NEW(___nv_heap___, ___nv_type___) \
+    ((___nv_type___ *)nova_alloc_const ((___nv_heap___), sizeof (___nv_type___)))
+
+#if defined(__cplusplus)
+}
+#endif /* @__cplusplus */
@@ -0,0 +1,248 @@
+#pragma once
+
+#include "nova.h"
+
+/* std::size_t */
+#include <cstddef>
+/* std::pmr::memory_resource */
+#include <memory_resource>
+/* std::bad_alloc, std::bad_array_new_length */
+#include <new>
+
+/*******************************************************************************
+ * C++ INTERFACE
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Everything here sits on top of the client interface in nova.h, and is all
+ * inline; there's nothing to link but the library itself.
+ *
+ * nova::allocator is for containers that know their value type up front (node
+ * containers especially, which allocate one sizeof(node) at a time): the size
+ * class and linkage index of a single T are worked out at compile time, and the
+ * allocation goes straight to the local linkage. The pmr resources get their
+ * sizes at run time, through a virtual call, and take the usual path.
+ */
+
+namespace nova {
+
+namespace detail {
+
+    constexpr nvi_t canonicalize_osz (nvi_t nv_osz)
+    {
+        return NOVA_CANONICAL_OSZ (nv_osz);
+    }
+
+    constexpr nvi_t lindex (nvi_t nv_osz)
+    {
+        return NOVA_LINDEX (nv_osz);
+    }
+
+    /* Class 2^k objects are aligned to 2^k, so a class at least as large as the
+     * alignment takes care of it (see nova_memalign).
+     */
+    template <nvi_t Size, nvi_t Align>
+    struct size_class {
+        static constexpr nvi_t osz = canonicalize_osz (Size < Align ? Align : Size);
+        static constexpr nvi_t li  = lindex (osz);
+    };
+
+    /* Allocate one object of the given size and alignment from the local heap
+     * nv_heap; NULL on failure.
+     */
+    template <nvi_t Size, nvi_t Align>
+    inline void * alloc_class (nova_heap_t * nv_heap)
+    {
+        using _nv_class = size_class<Size, Align>;
+
+        if constexpr (_nv_class::osz <= UINT16_MAX) {
+            /* Same test as nova_alloc_const.
+             */
+            if (__builtin_expect (_nv_class::li < nv_heap->nv_ln
+                                      && _nv_class::osz <= __atomic_load_n (&_nv_dealloc_smobjplsz_cache, __ATOMIC_RELAXED),
+                                  1)) {
+                void * _nv_obj;
+                if (__builtin_expect (nova_ok != __nv_local_lkg_alloc (&nv_heap->nv_lkgs[_nv_class::li], &_nv_obj, (nova_smobjsz_t)_nv_class::osz, nv_heap), 0)) {
+                    return nullptr;
+                }
+                return _nv_obj;
+            }
+        }
+        /* Span; those only start on a pool boundary, so an alignment past the
+         * pool's is refused there, same as on the array path.
+         */
+        return nova_memalign (nv_heap, Align, _nv_class::osz);
+    }
+
+    inline nova_heap_t *& thread_heap_slot () noexcept
+    {
+        static thread_local nova_heap_t * _nv_heap = nullptr;
+        return _nv_heap;
+    }
+
+} // namespace detail
+
+/** The local heap that nova::allocator allocates from on the calling thread:
+ * the one installed by the innermost nova::thread_heap_scope, or else the
+ * thread's default heap (NULL if that can't be made).
+ */
+inline nova_heap_t * thread_heap () noexcept
+{
+    nova_heap_t * _nv_heap = detail::thread_heap_slot ();
+    if (__builtin_expect (_nv_heap != nullptr, 1)) {
+        return _nv_heap;
+    }
+    return nova_default_heap ();
+}
+
+/** Install the local heap `nv_heap` as the calling thread's heap for as long as
+ * the scope lives; the previous one (if any) comes back when it ends.
+ * \notes the heap has to outlive the scope; it is not dropped.
+ */
+class thread_heap_scope {
+public:
+    explicit thread_heap_scope (nova_heap_t * nv_heap) noexcept
+        : nv_prev (detail::thread_heap_slot ())
+    {
+        detail::thread_heap_slot () = nv_heap;
+    }
+    ~thread_heap_scope () { detail::thread_heap_slot () = nv_prev; }
+
+    thread_heap_scope (const thread_heap_scope &) = delete;
+    thread_heap_scope & operator= (const thread_heap_scope &) = delete;
+
+private:
+    nova_heap_t * nv_prev;
+};
+
+/** Stateless allocator over the calling thread's heap (nova::thread_heap).
+ *
+ * \behaviour single objects have their size class resolved at compile time from
+ *            sizeof(T) and alignof(T); arrays go through nova_memalign.
+ *            Throws std::bad_alloc if the thread has no heap, or the heap is out
+ *            of memory.
+ * \notes all nova::allocators compare equal: objects can be freed from any
+ *        thread, whatever heap they came from.
+ */
+template <class T>
+class allocator {
+public:
+    using value_type                             = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using is_always_equal                        = std::true_type;
+
+    allocator () noexcept = default;
+    template <class U>
+    allocator (const allocator<U> &) noexcept
+    {
+    }
+
+    T * allocate (std::size_t nv_n)
+    {
+        nova_heap_t * _nv_heap = thread_heap ();
+        if (__builtin_expect (_nv_heap == nullptr, 0)) {
+            throw std::bad_alloc ();
+        }
+
+        void * _nv_obj;
+        if (__builtin_expect (nv_n == 1, 1)) {
+            _nv_obj = detail::alloc_class<sizeof (T), alignof (T)> (_nv_heap);
+        } else {
+            if (nv_n > (std::size_t)-1 / sizeof (T)) {
+                throw std::bad_array_new_length ();
+            }
+            _nv_obj = nova_memalign (_nv_heap, alignof (T), nv_n * sizeof (T));
+        }
+        if (__builtin_expect (_nv_obj == nullptr, 0)) {
+            throw std::bad_alloc ();
+        }
+        return static_cast<T *> (_nv_obj);
+    }
+
+    void deallocate (T * nv_obj, std::size_t) noexcept
+    {
+        nova_free (nv_obj);
+    }
+};
+
+template <class T, class U>
+constexpr bool operator== (const allocator<T> &, const allocator<U> &) noexcept
+{
+    return true;
+}
+
+template <class T, class U>
+constexpr bool operator!= (const allocator<T> &, const allocator<U> &) noexcept
+{
+    return false;
+}
+
+/** std::pmr::memory_resource over the local heap `nv_heap`, which it doesn't
+ * own.
+ * \notes only to be allocated from on the thread that owns nv_heap. Compares
+ *        equal to every other nova::heap_resource, since nova_free doesn't care
+ *        which heap an object came from.
+ */
+class heap_resource : public std::pmr::memory_resource {
+public:
+    explicit heap_resource (nova_heap_t * nv_heap) noexcept
+        : nv_heap (nv_heap)
+    {
+    }
+
+    nova_heap_t * heap () const noexcept { return nv_heap; }
+
+protected:
+    void * do_allocate (std::size_t nv_size, std::size_t nv_align) override
+    {
+        void * _nv_obj = nova_memalign (nv_heap, nv_align, nv_size);
+        if (__builtin_expect (_nv_obj == nullptr, 0)) {
+            throw std::bad_alloc ();
+        }
+        return _nv_obj;
+    }
+
+    void do_deallocate (void * nv_obj, std::size_t, std::size_t) override
+    {
+        nova_free (nv_obj);
+    }
+
+    bool do_is_equal (const std::pmr::memory_resource & nv_other) const noexcept override
+    {
+        return dynamic_cast<const heap_resource *> (&nv_other) != nullptr;
+    }
+
+    nova_heap_t * nv_heap;
+};
+
+/** heap_resource over a local heap of its own, made under the regional heap
+ * `nv_parent` when the resource is constructed, and dropped when it's
+ * destroyed; meant to live alongside the container(s) using it.
+ *
+ * \behaviour release() frees everything allocated from the resource at once
+ *            (nova_heap_reset), like std::pmr::monotonic_buffer_resource.
+ *            Throws std::bad_alloc if the heap can't be made.
+ * \notes objects still live when the resource is destroyed stay valid, and can
+ *        still be freed.
+ */
+class scoped_heap_resource : public heap_resource {
+public:
+    explicit scoped_heap_resource (nova_heap_t * nv_parent)
+        : heap_resource (nullptr)
+    {
+        if (nova_ok != nv_heap_create (&nv_heap)) {
+            throw std::bad_alloc ();
+        }
+        nv_heap_bind_parent (nv_heap, nv_parent);
+        __nv_regional_heap_incref (nv_parent);
+    }
+    ~scoped_heap_resource () { __nv_local_heap_drop (nv_heap); }
+
+    scoped_heap_resource (const scoped_heap_resource &) = delete;
+    scoped_heap_resource & operator= (const scoped_heap_resource &) = delete;
+
+    void release () noexcept { nova_heap_reset (nv_heap); }
+};
+
+} // namespace nova
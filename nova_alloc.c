@@ -0,0 +1,300 @@
+#include "nova.h"
+/* memcpy */
+#include <string.h>
+
+/*******************************************************************************
+ * CLIENT INTERFACE : ALLOCATION
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Whether an object of nv_osz bytes goes in a small object pool (as opposed to a
+ * span). The class has to map onto one of the heap's linkages, fit in a pool, and
+ * fit in a nova_smobjsz_t.
+ */
+static inline int __nv_is_smobj (nova_heap_t * nv_heap, nvi_t nv_osz)
+{
+    const nvi_t _nv_canon = __nv_canonicalize_osz (nv_osz);
+    return __nv_lindex (_nv_canon) < nv_heap->nv_ln
+        && _nv_canon <= nova_read_cfg (NV_SMOBJ_POOLSIZE)
+        && _nv_canon <= UINT16_MAX;
+}
+
+/* Shared tail of all the client allocation functions: by the time we get here,
+ * nv_osz has already been bumped up to whatever class gives the object the
+ * properties (alignment, line isolation) that the client asked for.
+ */
+static void * __nv_alloc_osz (nova_heap_t * nv_heap, nvi_t nv_osz)
+{
+    void * _nv_obj = NULL;
+
+    /* Anything that doesn't fit in a small object pool gets a span from the
+     * regional heap. Spans start on a pool boundary, so they satisfy any
+     * alignment or isolation that a class would have.
+     */
+    if (__builtin_expect (!__nv_is_smobj (nv_heap, nv_osz), 0)) {
+        if (__builtin_expect (nova_ok != __nv_span_alloc (nv_heap->nv_parent_heap, nv_osz, &_nv_obj), 0)) {
+            return NULL;
+        }
+        return _nv_obj;
+    }
+
+    if (__builtin_expect (nova_ok != __nv_local_heap_alloc (nv_heap, &_nv_obj, (nova_smobjsz_t)__nv_canonicalize_osz (nv_osz)), 0)) {
+        return NULL;
+    }
+    return _nv_obj;
+}
+
+void * nova_alloc (nova_heap_t * nv_heap, nvi_t nv_size)
+{
+    return __nv_alloc_osz (nv_heap, nv_size);
+}
+
+void * nova_alloc_flags (nova_heap_t * nv_heap, nvi_t nv_size, nvi_t nv_alfl)
+{
+    if (nv_alfl & NOVA_ALLOC_CACHELINE) {
+        /* A class of >= NOVA_CACHELINE bytes is a whole number of lines, and
+         * every object in it starts on a line boundary; so as long as the object
+         * is in such a class, nothing else can live on its lines.
+         */
+        if (nv_size < NOVA_CACHELINE) {
+            nv_size = NOVA_CACHELINE;
+        }
+    }
+    return __nv_alloc_osz (nv_heap, nv_size);
+}
+
+void * nova_memalign (nova_heap_t * nv_heap, nvi_t nv_align, nvi_t nv_size)
+{
+    /* Pools start at multiples of the pool size from the (chunk-aligned) chunk
+     * base, so the best alignment we can give out is the largest power of two
+     * dividing the pool size.
+     */
+    const nvi_t _nv_plsz = nova_read_cfg (NV_SMOBJ_POOLSIZE);
+    if (__builtin_expect (nv_align == 0
+                              || (nv_align & (nv_align - 1)) != 0
+                              || nv_align > (_nv_plsz & -_nv_plsz),
+                          0)) {
+#if NOVA_MODE_DEBUG
+        __nv_error (NVE_BADVAL, "nova_memalign(%p, %zu, %zu): alignment must be a power of two no larger than the pool alignment.", nv_heap, nv_align, nv_size);
+#endif
+        return NULL;
+    }
+
+    /* Objects of class 2^k sit at multiples of 2^k from the pool base, so picking
+     * a class at least as large as the alignment is all that's needed.
+     */
+    if (nv_size < nv_align) {
+        nv_size = nv_align;
+    }
+    return __nv_alloc_osz (nv_heap, nv_size);
+}
+
+void nova_free (void * nv_obj)
+{
+    if (__builtin_expect (nv_obj == NULL, 0)) {
+        return;
+    }
+    __nv_dealloc_smobj (nv_obj);
+}
+
+/*******************************************************************************
+ * CLIENT INTERFACE : LOCALITY
+ ******************************************************************************/
+
+void * nova_alloc_near (nova_heap_t * nv_heap, void * nv_hint, nvi_t nv_size)
+{
+    if (nv_hint != NULL && __nv_is_smobj (nv_heap, nv_size)) {
+        const nova_smobjsz_t _nv_osz = (nova_smobjsz_t)__nv_canonicalize_osz (nv_size);
+        nova_block_t * _nv_block     = __nv_smobj_block (nv_hint);
+        const uint16_t _nv_blfl      = __c11_atomic_load (&_nv_block->nv_blfl, __ATOMIC_RELAXED);
+
+        /* A head block is where nova_alloc goes anyway; spans and bitmap blocks
+         * don't have a free list to take from.
+         */
+        if (!(_nv_blfl & (NOVA_BLFL_ISHEAD | NOVA_BLFL_BITMAP | NOVA_BLFL_SPAN))
+            && _nv_block->nv_osz == _nv_osz) {
+            void * _nv_obj;
+            if (nova_ok == __nv_local_lkg_alloc_near (&nv_heap->nv_lkgs[__nv_lindex (_nv_osz)], _nv_block, &_nv_obj)) {
+                return _nv_obj;
+            }
+        }
+    }
+    return __nv_alloc_osz (nv_heap, nv_size);
+}
+
+/*******************************************************************************
+ * CLIENT INTERFACE : BULK OPERATIONS
+ ******************************************************************************/
+
+nvi_t nova_alloc_bulk (nova_heap_t * nv_heap, nvi_t nv_size, void ** nv_objs, nvi_t nv_n)
+{
+    /* Spans are one at a time anyways.
+     */
+    if (__builtin_expect (!__nv_is_smobj (nv_heap, nv_size), 0)) {
+        nvi_t _nv_got = 0;
+        while (_nv_got < nv_n
+               && nova_ok == __nv_span_alloc (nv_heap->nv_parent_heap, nv_size, &nv_objs[_nv_got])) {
+            _nv_got++;
+        }
+        return _nv_got;
+    }
+
+    const nova_smobjsz_t _nv_osz = (nova_smobjsz_t)__nv_canonicalize_osz (nv_size);
+    nova_lkg_t * _nv_lkg         = &nv_heap->nv_lkgs[__nv_lindex (_nv_osz)];
+    nvi_t _nv_got                = 0;
+
+    while (_nv_got < nv_n) {
+        /* Bitmap heads hand out whole words at a time.
+         */
+        nova_block_t * _nvc_head = __atomic_load_n (&_nv_lkg->nv_head, __ATOMIC_ACQUIRE);
+        if (_nvc_head != NULL
+            && (__c11_atomic_load (&_nvc_head->nv_blfl, __ATOMIC_RELAXED) & NOVA_BLFL_BITMAP)) {
+            nvi_t _nv_k = 0;
+            __nv_bmblock_alloc_bulk (_nvc_head, &nv_objs[_nv_got], nv_n - _nv_got, &_nv_k);
+            _nv_got += _nv_k;
+            if (_nv_got == nv_n) {
+                break;
+            }
+        }
+
+        /* Head ran dry (or isn't a bitmap block): one object through the normal
+         * path, which takes care of sliding and refilling the linkage.
+         */
+        if (nova_ok != __nv_local_lkg_alloc (_nv_lkg, &nv_objs[_nv_got], _nv_osz, nv_heap)) {
+            break;
+        }
+        _nv_got++;
+    }
+
+    return _nv_got;
+}
+
+void nova_free_bulk (void ** nv_objs, nvi_t nv_n)
+{
+    nvi_t _nv_i = 0;
+    while (_nv_i < nv_n) {
+        if (nv_objs[_nv_i] == NULL) {
+            _nv_i++;
+            continue;
+        }
+
+        /* Gather the run of objects that live on the same block; a span only
+         * ever has the one object.
+         */
+        nova_block_t * _nv_block = __nv_smobj_block (nv_objs[_nv_i]);
+        if (__c11_atomic_load (&_nv_block->nv_blfl, __ATOMIC_RELAXED) & NOVA_BLFL_SPAN) {
+            __nv_span_dealloc (_nv_block);
+            _nv_i++;
+            continue;
+        }
+        nvi_t _nv_j              = _nv_i + 1;
+        while (_nv_j < nv_n
+               && nv_objs[_nv_j] != NULL
+               && __nv_smobj_block (nv_objs[_nv_j]) == _nv_block) {
+            _nv_j++;
+        }
+
+        __nv_block_dealloc_bulk (_nv_block, &nv_objs[_nv_i], _nv_j - _nv_i);
+        _nv_i = _nv_j;
+    }
+}
+
+/*******************************************************************************
+ * CLIENT INTERFACE : RESIZING
+ ******************************************************************************/
+
+void * nova_realloc (nova_heap_t * nv_heap, void * nv_obj, nvi_t nv_size)
+{
+    if (nv_obj == NULL) {
+        return nova_alloc (nv_heap, nv_size);
+    }
+    if (nv_size == 0) {
+        nova_free (nv_obj);
+        return NULL;
+    }
+
+    nova_block_t * _nv_block = __nv_smobj_block (nv_obj);
+    const nvi_t _nv_usz      = nova_usable_size (nv_obj);
+
+    if (__c11_atomic_load (&_nv_block->nv_blfl, __ATOMIC_RELAXED) & NOVA_BLFL_SPAN) {
+        /* Spans can grow into free pools right after them, and give back pools
+         * from the tail, without moving; only go down to a small object if it
+         * really is small now.
+         */
+        if (!__nv_is_smobj (nv_heap, nv_size)
+            && nova_ok == __nv_span_resize (_nv_block, nv_size)) {
+            return nv_obj;
+        }
+    } else if (nv_size <= _nv_usz) {
+        /* Still fits in the class: nothing to do. This also covers shrinking;
+         * moving down a class would cost a copy to save slack that the client
+         * will likely grow back into anyway.
+         */
+        return nv_obj;
+    }
+
+    /* Has to move; one copy of at most the old object's worth of bytes (which is
+     * all that could possibly have been written), then release the old object.
+     */
+    void * _nv_nobj = nova_alloc (nv_heap, nv_size);
+    if (__builtin_expect (_nv_nobj == NULL, 0)) {
+        return NULL;
+    }
+    memcpy (_nv_nobj, nv_obj, (nv_size < _nv_usz) ? nv_size : _nv_usz);
+    nova_free (nv_obj);
+
+    return _nv_nobj;
+}
+
+nvi_t nova_usable_size (void * nv_obj)
+{
+    if (nv_obj == NULL) {
+        return 0;
+    }
+    /* nv_osz is fixed for as long as there's a live object on the block (and
+     * nv_ocnt for as long as the span is live), so we don't need to synchronize
+     * with anything to read them.
+     */
+    nova_block_t * _nv_block = __nv_smobj_block (nv_obj);
+    if (__c11_atomic_load (&_nv_block->nv_blfl, __ATOMIC_RELAXED) & NOVA_BLFL_SPAN) {
+        return __nv_span_size (_nv_block);
+    }
+    return _nv_block->nv_osz;
+}
+
+/*******************************************************************************
+ * CLIENT INTERFACE : TRIMMING
+ ******************************************************************************/
+
+nvi_t nova_heap_trim (nova_heap_t * nv_heap, nvi_t nv_policy)
+{
+    return __nv_local_heap_trim (nv_heap, nv_policy);
+}
+
+/*******************************************************************************
+ * CLIENT INTERFACE : RESETTING
+ ******************************************************************************/
+
+nvi_t nova_heap_reset (nova_heap_t * nv_heap)
+{
+    return __nv_local_heap_reset (nv_heap);
+}
+
+/*******************************************************************************
+ * CLIENT INTERFACE : TRANSFER
+ ******************************************************************************/
+
+nova_res_t nova_heap_transfer (nova_heap_t * nv_heap, nova_tid_t nv_owner)
+{
+    /* Owners are never 0: that's what released blocks have.
+     */
+    if (__builtin_expect (nv_owner == 0, 0)) {
+#if NOVA_MODE_DEBUG
+        __nv_error (NVE_BADVAL, "nova_heap_transfer(%p, %lu): not a thread id.", nv_heap, (unsigned long)nv_owner);
+#endif
+        return nova_fail;
+    }
+    __nv_local_heap_transfer (nv_heap, nv_owner);
+    return nova_ok;
+}
@@ -0,0 +1,159 @@
+#include "nova.h"
+
+/* mmap, mprotect, madvise */
+#include <sys/mman.h>
+
+/*******************************************************************************
+ * CHUNK HANDLING : ARENA
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Rather than going to posix_memalign for every chunk (which over-allocates to
+ * get the alignment, and leaves chunk-sized holes all over the libc heap), we
+ * reserve a big PROT_NONE range of address space up front and commit chunks out
+ * of it, bottom to top. So chunks come out address-ordered and contiguous, and
+ * "is this a Nova chunk" is a range check.
+ *
+ * When a reservation runs dry, we reserve another one twice as large, up to
+ * NOVA_ARENA_MAXRGNS of them; after that, nv_chunk_create falls back to
+ * posix_memalign.
+ *
+ * Chunks that are destroyed stay committed, but their pages are handed back to
+ * the system with madvise and the chunk goes on a free list for reuse.
+ */
+
+typedef struct nova_arena_rgn
+{
+    uint8_t * nv_base;
+    uint8_t * nv_end;
+} nova_arena_rgn_t;
+
+typedef struct nova_arena
+{
+    nova_mutex_t nv_al;
+    /* chunk size the reservations were made for; 0 until the first one */
+    nvi_t nv_csize;
+    /* bump pointer into nv_rgns[nv_nrgns - 1] */
+    uint8_t * nv_top;
+    /* destroyed chunks, chained through nv_next */
+    nova_chunk_t * nv_free;
+    /* __atomic */ nvi_t nv_nrgns;
+    nova_arena_rgn_t nv_rgns[NOVA_ARENA_MAXRGNS];
+} nova_arena_t;
+
+static nova_arena_t _nv_arena = {
+    .nv_al    = PTHREAD_MUTEX_INITIALIZER,
+    .nv_csize = 0,
+    .nv_top   = NULL,
+    .nv_free  = NULL,
+    .nv_nrgns = 0,
+};
+
+/* Reserve a new region of nv_size bytes, aligned to nv_csize. Arena is locked.
+ */
+static nova_res_t __nv_arena_reserve_al (nvi_t nv_csize, nvi_t nv_size)
+{
+    int _nv_mflags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    _nv_mflags |= MAP_NORESERVE;
+#endif
+    /* mmap only guarantees page alignment, so over-reserve by a chunk and trim.
+     */
+    uint8_t * _nv_raw = mmap (NULL, nv_size + nv_csize, PROT_NONE, _nv_mflags, -1, 0);
+    if (_nv_raw == MAP_FAILED) {
+        return nova_fail;
+    }
+    uint8_t * _nv_base = (uint8_t *)(((uintptr_t)_nv_raw + nv_csize - 1) & ~(uintptr_t)(nv_csize - 1));
+    if (_nv_base != _nv_raw) {
+        munmap (_nv_raw, (nvi_t)(_nv_base - _nv_raw));
+    }
+    munmap (_nv_base + nv_size, nv_csize - (nvi_t)(_nv_base - _nv_raw));
+
+    nova_arena_rgn_t * _nv_rgn = &_nv_arena.nv_rgns[_nv_arena.nv_nrgns];
+    _nv_rgn->nv_base           = _nv_base;
+    _nv_rgn->nv_end            = _nv_base + nv_size;
+    _nv_arena.nv_top           = _nv_base;
+    /* Publish the region only once it's filled in; __nv_arena_owns doesn't lock.
+     */
+    __atomic_store_n (&_nv_arena.nv_nrgns, _nv_arena.nv_nrgns + 1, __ATOMIC_RELEASE);
+
+    return nova_ok;
+}
+
+nova_res_t __nv_arena_chunk_alloc (nova_chunk_t ** nv_chunk)
+{
+    const nvi_t _nv_csize = nova_read_cfg (NV_CHUNKSIZE);
+    nova_res_t _nv_res    = nova_fail;
+
+    nvmutex_lock (&_nv_arena.nv_al);
+    if (_nv_arena.nv_csize == 0) {
+        _nv_arena.nv_csize = _nv_csize;
+    } else if (__builtin_expect (_nv_arena.nv_csize != _nv_csize, 0)) {
+        /* Chunk size changed after we started reserving; the existing regions
+         * have the wrong alignment, so leave it to posix_memalign.
+         */
+        goto out;
+    }
+
+    if (_nv_arena.nv_free != NULL) {
+        *nv_chunk         = _nv_arena.nv_free;
+        _nv_arena.nv_free = _nv_arena.nv_free->nv_next;
+        _nv_res           = nova_ok;
+        goto out;
+    }
+
+    if (_nv_arena.nv_nrgns == 0
+        || _nv_arena.nv_top == _nv_arena.nv_rgns[_nv_arena.nv_nrgns - 1].nv_end) {
+        if (_nv_arena.nv_nrgns == NOVA_ARENA_MAXRGNS) {
+            goto out;
+        }
+        nvi_t _nv_nchunks = NOVA_ARENA_INITCHUNKS << _nv_arena.nv_nrgns;
+        if (_nv_nchunks > NOVA_ARENA_MAXCHUNKS) {
+            _nv_nchunks = NOVA_ARENA_MAXCHUNKS;
+        }
+        if (nova_ok != __nv_arena_reserve_al (_nv_csize, _nv_nchunks * _nv_csize)) {
+            goto out;
+        }
+    }
+
+    if (0 != mprotect (_nv_arena.nv_top, _nv_csize, PROT_READ | PROT_WRITE)) {
+        goto out;
+    }
+    *nv_chunk = (nova_chunk_t *)_nv_arena.nv_top;
+    _nv_arena.nv_top += _nv_csize;
+    _nv_res = nova_ok;
+
+out:
+    nvmutex_unlock (&_nv_arena.nv_al);
+    return _nv_res;
+}
+
+int __nv_arena_owns (void * nv_ptr)
+{
+    const nvi_t _nv_nrgns = __atomic_load_n (&_nv_arena.nv_nrgns, __ATOMIC_ACQUIRE);
+    for (nvi_t i = 0; i < _nv_nrgns; i++) {
+        if ((uint8_t *)nv_ptr >= _nv_arena.nv_rgns[i].nv_base
+            && (uint8_t *)nv_ptr < _nv_arena.nv_rgns[i].nv_end) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+nova_res_t __nv_arena_chunk_release (nova_chunk_t * nv_chunk)
+{
+    /* Drop the pages but keep the range committed, so that the chunk can be
+     * handed out again without another mprotect.
+     */
+#ifdef MADV_DONTNEED
+    madvise (nv_chunk, _nv_arena.nv_csize, MADV_DONTNEED);
+#endif
+
+    nvmutex_lock (&_nv_arena.nv_al);
+    nv_chunk->nv_next = _nv_arena.nv_free;
+    _nv_arena.nv_free = nv_chunk;
+    nvmutex_unlock (&_nv_arena.nv_al);
+
+    return nova_ok;
+}
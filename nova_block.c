@@ -1,6 +1,8 @@
 #include "nova.h"
 /* memcpy */
 #include <string.h>
+/* sched_yield */
+#include <sched.h>
 
 /*******************************************************************************
  * BLOCK HANDLING
@@ -26,6 +28,35 @@ nova_res_t nv_block_init (nova_block_t * nv_block, void * nv_block_memory)
     return nova_ok;
 }
 
+nova_res_t __nv_block_init_lazy (nova_block_t * nv_block)
+{
+    if (__builtin_expect (nv_block->nv_base != NULL, 1)) {
+        return nova_ok;
+    }
+
+    /* Same arithmetic as __nv_smobj_block, backwards.
+     */
+    const uintptr_t _nv_csize = nova_read_cfg (NV_CHUNKSIZE);
+    const nvi_t _nv_plsz      = nova_read_cfg (NV_SMOBJ_POOLSIZE);
+    nova_chunk_t * _nv_chunk  = (nova_chunk_t *)((uintptr_t)nv_block & ~(_nv_csize - 1));
+    const nvi_t _nv_bi        = (nvi_t)(nv_block - _nv_chunk->nv_blocks);
+
+    /* nv_block_init clears the side linkages and nv_lkg, so keep them.
+     */
+    nova_block_t * _nv_lkgnx = nv_block->nv_lkgnx;
+    nova_block_t * _nv_lkgpr = nv_block->nv_lkgpr;
+    void * _nv_lkg           = nv_block->nv_lkg;
+    nova_tid_t _nv_owner     = nv_block->nv_owner;
+    nv_block_init (nv_block,
+                   (uint8_t *)_nv_chunk + (nova_read_cfg (NV_CHUNK_HDRPOOLS) + _nv_bi) * _nv_plsz);
+    nv_block->nv_lkgnx = _nv_lkgnx;
+    nv_block->nv_lkgpr = _nv_lkgpr;
+    nv_block->nv_lkg   = _nv_lkg;
+    nv_block->nv_owner = _nv_owner;
+
+    return nova_ok;
+}
+
 nova_res_t __nv_block_fmt (nova_block_t * nv_block, nova_smobjsz_t nv_osz)
 {
     /*
@@ -43,6 +74,21 @@ nova_res_t __nv_block_fmt (nova_block_t * nv_block, nova_smobjsz_t nv_osz)
         return nova_fail;
     }
 #endif
+    /* Whoever freed into the block's last incarnation doesn't matter anymore.
+     */
+    nova_rfstat_t * _nv_rf = __nv_block_rfstat (nv_block);
+    _nv_rf->nv_rftid       = 0;
+    _nv_rf->nv_rfcnt       = 0;
+
+    /* Tiny classes get a bitmap instead of a free list.
+     */
+    if (nv_osz <= NOVA_BMBLOCK_MAXOSZ) {
+        return __nv_bmblock_fmt (nv_block, nv_osz);
+    }
+    /* Blocks get reformatted across classes, so clear out any leftover format.
+     */
+    __c11_atomic_fetch_and (&nv_block->nv_blfl, (uint16_t)~NOVA_BLFL_BITMAP, __ATOMIC_ACQ_REL);
+
     nv_block->nv_osz  = nv_osz;
     nv_block->nv_ocnt = _nv_smobjpoolsz / nv_osz;
     __atomic_store_n (&nv_block->nv_acnt, 0, __ATOMIC_RELEASE);
@@ -95,6 +141,10 @@ nova_res_t __nv_block_fmt (nova_block_t * nv_block, nova_smobjsz_t nv_osz)
 
 nova_res_t __nv_block_alloc (nova_block_t * nv_block, void ** nv_obj)
 {
+    if (__builtin_expect (__c11_atomic_load (&nv_block->nv_blfl, __ATOMIC_RELAXED) & NOVA_BLFL_BITMAP, 0)) {
+        return __nv_bmblock_alloc (nv_block, nv_obj);
+    }
+
     /* Effect FPL to be non-null.
      */
     if (__builtin_expect (nv_block->nv_fpl != NULL, 1)) {
@@ -133,6 +183,8 @@ nova_res_t __nv_block_alloc_inner (nova_block_t * nv_block, void ** nv_obj)
     /* _n_ext _o_bject _off_set */
     const uint16_t _nv_nooff = *((uint16_t *)(*nv_obj));
     if (__builtin_expect (_nv_nooff != 0xffff, 1)) {
+        nv_block->nv_fpl = (uint8_t *)nv_block->nv_base + _nv_nooff;
+    } else {
         /* 0xffff is a special value meaning end-of-free-list.
          * I chose 0xffff because, well, it's the closest I can get to an out-of-range
          * value. Technically it's possible to set it up so that this value would
@@ -140,22 +192,144 @@ nova_res_t __nv_block_alloc_inner (nova_block_t * nv_block, void ** nv_obj)
          * 1 bytes inaccessible, so I'm going to call it good.
          */
         nv_block->nv_fpl = NULL;
-    } else {
-        nv_block->nv_fpl = (uint8_t *)nv_block->nv_base + _nv_nooff;
     }
 
+    /* Deallocation pairs this with an atomic decrement, which is what the
+     * empty/empty-enough bookkeeping is keyed on.
+     */
+    __atomic_add_fetch (&nv_block->nv_acnt, 1, __ATOMIC_ACQ_REL);
+
     return nova_ok;
 }
 
-nova_res_t __nv_dealloc_smobj (void * nv_obj)
+/* Lock the LL of whatever linkage nv_block is currently on, and return that
+ * linkage. The block can be moved between linkages while we're waiting on the
+ * LL, so we check that we actually got the right one, and try again otherwise.
+ *
+ * Returns NULL (with nothing locked) if the block is in transit between
+ * linkages; in that case there's nothing for a deallocator to do.
+ *
+ * The linkage itself may be on its way out: a dying local heap lets go of its
+ * blocks under their FPGMs (see __nv_local_lkg_drop), and frees the linkage
+ * right after. So nv_lkg is read with the FPGM held, which keeps the linkage
+ * alive until we have its LL; and since the lock order is LL -> FPGM, we can
+ * only try for the LL from there, and back off completely if it's busy.
+ */
+static nova_lkg_t * __nv_block_lock_lkg (nova_block_t * nv_block)
 {
-    /* ALERT: THIS IS A HOT PATH.
+    for (;;) {
+        nvmutex_lock (&nv_block->nv_fpgm);
+        nova_lkg_t * _nvc_lkg = __atomic_load_n (&nv_block->nv_lkg, __ATOMIC_ACQUIRE);
+        if (_nvc_lkg == NULL) {
+            nvmutex_unlock (&nv_block->nv_fpgm);
+            return NULL;
+        }
+        if (nova_ok == nvmutex_trylock (&_nvc_lkg->nv_ll)) {
+            /* Trimming lets go of blocks with only the LL held, so check again.
+             */
+            if (__builtin_expect (_nvc_lkg == __atomic_load_n (&nv_block->nv_lkg, __ATOMIC_ACQUIRE), 1)) {
+                nvmutex_unlock (&nv_block->nv_fpgm);
+                return _nvc_lkg;
+            }
+            nvmutex_unlock (&_nvc_lkg->nv_ll);
+        }
+        nvmutex_unlock (&nv_block->nv_fpgm);
+        sched_yield ();
+    }
+}
+
+static nova_res_t __nv_block_acnt_release (nova_block_t * nv_block, nvi_t nv_n);
+/* What's left of __nv_block_acnt_release once the count itself is down. */
+static nova_res_t __nv_block_acnt_settle (nova_block_t * nv_block, nova_smobjcnt_t nv_racnt, nvi_t nv_n);
+
+int __nv_block_was_reset (nova_block_t * nv_block, uint16_t nv_blfl)
+{
+    return (__c11_atomic_load (&nv_block->nv_blfl, __ATOMIC_ACQUIRE) & NOVA_BLFL_RGENMASK)
+        != (nv_blfl & NOVA_BLFL_RGENMASK);
+}
+
+void __nv_block_reset_sl (nova_block_t * nv_block)
+{
+    __c11_atomic_fetch_and (&nv_block->nv_blfl,
+                            (uint16_t) ~(NOVA_BLFL_ISHEAD | NOVA_BLFL_BINNED | NOVA_BLFL_BINMASK),
+                            __ATOMIC_ACQ_REL);
+    /* Anybody who read the flags before this and hasn't got the FPGM yet drops
+     * their objects (see __nv_block_was_reset); anybody who already had it is
+     * done with the FPG and the count by now.
      */
+    __c11_atomic_fetch_add (&nv_block->nv_blfl, (uint16_t)(1 << NOVA_BLFL_RGENSHIFT), __ATOMIC_ACQ_REL);
+    nv_block->nv_fpl = NULL;
+    __atomic_store_n (&nv_block->nv_fpg, NULL, __ATOMIC_RELEASE);
+    __atomic_store_n (&nv_block->nv_acnt, 0, __ATOMIC_RELEASE);
+    __atomic_store_n (&nv_block->nv_lkg, NULL, __ATOMIC_RELEASE);
+}
+
+void __nv_block_transfer_sl (nova_block_t * nv_block, nova_tid_t nv_owner)
+{
+    if (__c11_atomic_load (&nv_block->nv_blfl, __ATOMIC_RELAXED) & NOVA_BLFL_BITMAP) {
+        __nv_bmblock_reclaim_sl (nv_block);
+    } else {
+        /* Foreign frees are supposed to be the exception, so the FPG is the list
+         * to walk; it goes in front of the FPL.
+         */
+        uint8_t * _nv_fpg = __atomic_exchange_n (&nv_block->nv_fpg, NULL, __ATOMIC_ACQ_REL);
+        if (_nv_fpg != NULL) {
+            uint8_t * _nv_tail = _nv_fpg;
+            for (uint16_t _nv_nooff; (_nv_nooff = *(uint16_t *)_nv_tail) != 0xffff;) {
+                _nv_tail = (uint8_t *)nv_block->nv_base + _nv_nooff;
+            }
+            *(uint16_t *)_nv_tail = (nv_block->nv_fpl != NULL)
+                ? (uint16_t)((uint8_t *)nv_block->nv_fpl - (uint8_t *)nv_block->nv_base)
+                : 0xffff;
+            nv_block->nv_fpl = _nv_fpg;
+        }
+    }
+
+    /* Last: as soon as the new owner sees itself here, it may go straight for
+     * the FPL (head blocks don't take the FPGM on local frees).
+     */
+    __atomic_store_n (&nv_block->nv_owner, nv_owner, __ATOMIC_RELEASE);
+}
 
+/* Link nv_objs[0 .. nv_n) together with the usual byte offsets; the tail is left
+ * for the caller.
+ */
+static inline void __nv_block_chain_objs (nova_block_t * nv_block, void ** nv_objs, nvi_t nv_n)
+{
+    for (nvi_t _nv_i = 0; _nv_i + 1 < nv_n; _nv_i++) {
+        *(uint16_t *)nv_objs[_nv_i] = (uint8_t *)nv_objs[_nv_i + 1] - (uint8_t *)nv_block->nv_base;
+    }
+}
+
+int __nv_block_dealloc_is_local (nova_block_t * nv_block, int * nv_fpgm_held)
+{
+    *nv_fpgm_held = 0;
+    if (__builtin_expect (__nv_tid () != __atomic_load_n (&nv_block->nv_owner, __ATOMIC_ACQUIRE), 0)) {
+        return 0;
+    }
+#if NOVA_BLOCK_STEALING
+    /* Only the owner ever touches the head flag of its own blocks, so if it's set,
+     * it stays set until we're done; and heads are never stolen. Anything else
+     * can be taken by a sibling between the nv_owner check and the push onto the
+     * FPL, so lock the block down and check again.
+     */
+    if (!(__c11_atomic_load (&nv_block->nv_blfl, __ATOMIC_ACQUIRE) & NOVA_BLFL_ISHEAD)) {
+        nvmutex_lock (&nv_block->nv_fpgm);
+        *nv_fpgm_held = 1;
+        return __nv_tid () == __atomic_load_n (&nv_block->nv_owner, __ATOMIC_ACQUIRE);
+    }
+#endif
+    return 1;
+}
+
+nova_block_t * __nv_smobj_block (void * nv_obj)
+{
     const uintptr_t _nv_csize_lcache = __atomic_load_n (&_nv_dealloc_csize_cache,
                                                         __ATOMIC_ACQUIRE);
     const uintptr_t _nv_sops_lcache  = __atomic_load_n (&_nv_dealloc_smobjplsz_cache,
                                                        __ATOMIC_ACQUIRE);
+    const uintptr_t _nv_hdrp_lcache  = __atomic_load_n (&_nv_dealloc_hdrpools_cache,
+                                                       __ATOMIC_ACQUIRE);
 
     /* We know the following: _nv_csize_lcache is a power-of-2, and the chunk
      * allocation is always aligned to the chunksize.
@@ -169,9 +343,58 @@ nova_res_t __nv_dealloc_smobj (void * nv_obj)
     nova_chunk_t * _nv_chunk = (nova_chunk_t *)((uintptr_t)nv_obj & ~(_nv_csize_lcache - 1));
     /* Grab all the chunk-internal bits of the object's address.
      */
-    nvi_t _nv_ooff_ic       = (uintptr_t)nv_obj & (_nv_csize_lcache - 1);
-    nvi_t _nv_bloff_ic      = _nv_ooff_ic / _nv_sops_lcache;
-    nova_block_t * nv_block = &_nv_chunk->nv_blocks[_nv_bloff_ic - 1];
+    nvi_t _nv_ooff_ic  = (uintptr_t)nv_obj & (_nv_csize_lcache - 1);
+    nvi_t _nv_bloff_ic = _nv_ooff_ic / _nv_sops_lcache;
+    /* The first few pools are the headers themselves.
+     */
+    return &_nv_chunk->nv_blocks[_nv_bloff_ic - _nv_hdrp_lcache];
+}
+
+nova_rfstat_t * __nv_block_rfstat (nova_block_t * nv_block)
+{
+    /* Same caches as __nv_smobj_block: this is on the foreign deallocation path.
+     */
+    const uintptr_t _nv_csize_lcache = __atomic_load_n (&_nv_dealloc_csize_cache, __ATOMIC_ACQUIRE);
+    const uintptr_t _nv_sops_lcache  = __atomic_load_n (&_nv_dealloc_smobjplsz_cache, __ATOMIC_ACQUIRE);
+    const uintptr_t _nv_hdrp_lcache  = __atomic_load_n (&_nv_dealloc_hdrpools_cache, __ATOMIC_ACQUIRE);
+
+    nova_chunk_t * _nv_chunk = (nova_chunk_t *)((uintptr_t)nv_block & ~(_nv_csize_lcache - 1));
+    const nvi_t _nv_nblocks  = _nv_csize_lcache / _nv_sops_lcache - _nv_hdrp_lcache;
+    /* Right after the pool map; see nova_chunk_t.
+     */
+    nova_rfstat_t * _nv_rfs = (nova_rfstat_t *)((uint64_t *)&_nv_chunk->nv_blocks[_nv_nblocks] + ((_nv_nblocks + 63) >> 6));
+    return &_nv_rfs[nv_block - _nv_chunk->nv_blocks];
+}
+
+void __nv_block_note_remote_sl (nova_block_t * nv_block, nvi_t nv_n)
+{
+    nova_rfstat_t * _nv_rf   = __nv_block_rfstat (nv_block);
+    const nova_tid_t _nv_tid = __nv_tid ();
+
+    /* Only runs by a single thread count: a block that several consumers
+     * share stays with its producer.
+     */
+    if (_nv_rf->nv_rftid == _nv_tid) {
+        _nv_rf->nv_rfcnt += nv_n;
+    } else {
+        _nv_rf->nv_rftid = _nv_tid;
+        _nv_rf->nv_rfcnt = nv_n;
+    }
+}
+
+nova_res_t __nv_dealloc_smobj (void * nv_obj)
+{
+    /* ALERT: THIS IS A HOT PATH.
+     */
+
+    nova_block_t * nv_block = __nv_smobj_block (nv_obj);
+
+    /* Medium objects: the header is the same lookup away, but the span is
+     * returned whole.
+     */
+    if (__builtin_expect (__c11_atomic_load (&nv_block->nv_blfl, __ATOMIC_RELAXED) & NOVA_BLFL_SPAN, 0)) {
+        return __nv_span_dealloc (nv_block);
+    }
 
 #if NOVA_MODE_DEBUG
     return __nv_block_dealloc (nv_block, nv_obj);
@@ -210,10 +433,26 @@ nova_res_t __nv_block_dealloc (nova_block_t * nv_block, void * nv_obj)
      *                          be any local operations on this block, there are
      *                          no possible deallocation-active local referrants.
      *                          [P1] remains satisfied.
+
+     *  - block is stolen (NOVA_BLOCK_STEALING)
+     *      the thief holds the FPGM while it changes nv_owner, and the old owner
+     *      holds the FPGM from its nv_owner check until it's done with the FPL
+     *      (see __nv_block_dealloc_is_local). [P1] remains satisfied.
      *
      * Therefore, for the purposes of P1, nv_owner will always be valid.
      */
-    if (__builtin_expect (__nv_tid () == __atomic_load_n (&nv_block->nv_owner, __ATOMIC_ACQUIRE), 1)) {
+    /* The reset generation in here is what the object was allocated under, as
+     * far as we're concerned; see NOVA_BLFL_RGENMASK.
+     */
+    const uint16_t _nv_blfl = __c11_atomic_load (&nv_block->nv_blfl, __ATOMIC_RELAXED);
+    nova_smobjcnt_t _nv_racnt;
+    int _nv_held = 0;
+    if (__builtin_expect (_nv_blfl & NOVA_BLFL_BITMAP, 0)) {
+        if (__builtin_expect (nova_ok != __nv_bmblock_release (nv_block, &nv_obj, 1, _nv_blfl, &_nv_racnt), 0)) {
+            return nova_ok;
+        }
+        return __nv_block_acnt_settle (nv_block, _nv_racnt, 1);
+    } else if (__builtin_expect (__nv_block_dealloc_is_local (nv_block, &_nv_held), 1)) {
         /* Shuffle the object back into the free chain.
          */
 
@@ -241,8 +480,17 @@ nova_res_t __nv_block_dealloc (nova_block_t * nv_block, void * nv_obj)
              */
             nv_block->nv_fpl = nv_obj;
         }
+        if (_nv_held) {
+            nvmutex_unlock (&nv_block->nv_fpgm);
+        }
     } else {
-        nvmutex_lock (&nv_block->nv_fpgm);
+        if (!_nv_held) {
+            nvmutex_lock (&nv_block->nv_fpgm);
+        }
+        if (__builtin_expect (__nv_block_was_reset (nv_block, _nv_blfl), 0)) {
+            nvmutex_unlock (&nv_block->nv_fpgm);
+            return nova_ok;
+        }
         /* Locked, so no modifications for the duration of the lock.
          */
         void * _nv_fpg_cache = __atomic_load_n (&nv_block->nv_fpg, __ATOMIC_ACQUIRE);
@@ -266,31 +514,98 @@ nova_res_t __nv_block_dealloc (nova_block_t * nv_block, void * nv_obj)
             __atomic_store_n (&nv_block->nv_fpg, nv_obj, __ATOMIC_RELEASE);
         }
 
+#if NOVA_BLOCK_MIGRATION
+        __nv_block_note_remote_sl (nv_block, 1);
+#endif
+        /* The count goes down with the FPGM still held, so that a reset never
+         * sees the object on the FPG without it being accounted for.
+         */
+        _nv_racnt = __atomic_sub_fetch (&nv_block->nv_acnt, (nova_smobjcnt_t)1, __ATOMIC_ACQ_REL);
+        nvmutex_unlock (&nv_block->nv_fpgm);
+
+        return __nv_block_acnt_settle (nv_block, _nv_racnt, 1);
+    }
+
+    return __nv_block_acnt_release (nv_block, 1);
+}
+
+nova_res_t __nv_block_dealloc_bulk (nova_block_t * nv_block, void ** nv_objs, nvi_t nv_n)
+{
+    const uint16_t _nv_blfl = __c11_atomic_load (&nv_block->nv_blfl, __ATOMIC_RELAXED);
+    nova_smobjcnt_t _nv_racnt;
+
+    if (_nv_blfl & NOVA_BLFL_BITMAP) {
+        if (nova_ok != __nv_bmblock_release (nv_block, nv_objs, nv_n, _nv_blfl, &_nv_racnt)) {
+            return nova_ok;
+        }
+        return __nv_block_acnt_settle (nv_block, _nv_racnt, nv_n);
+    }
+
+    /* String the objects together into a chain first (with the usual byte
+     * offsets), then hang the whole chain off the front of the appropriate free
+     * list in one go. On the foreign path, that has to wait until we know the
+     * block wasn't reset under us: the objects may belong to somebody else by
+     * then.
+     */
+    int _nv_held = 0;
+    if (__builtin_expect (__nv_block_dealloc_is_local (nv_block, &_nv_held), 1)) {
+        __nv_block_chain_objs (nv_block, nv_objs, nv_n);
+        *(uint16_t *)nv_objs[nv_n - 1] = nv_block->nv_fpl != NULL
+                                             ? (uint8_t *)nv_block->nv_fpl - (uint8_t *)nv_block->nv_base
+                                             : 0xffff;
+        nv_block->nv_fpl               = nv_objs[0];
+        if (_nv_held) {
+            nvmutex_unlock (&nv_block->nv_fpgm);
+        }
+        return __nv_block_acnt_release (nv_block, nv_n);
+    }
+
+    if (!_nv_held) {
+        nvmutex_lock (&nv_block->nv_fpgm);
+    }
+    if (__builtin_expect (__nv_block_was_reset (nv_block, _nv_blfl), 0)) {
         nvmutex_unlock (&nv_block->nv_fpgm);
+        return nova_ok;
     }
+    __nv_block_chain_objs (nv_block, nv_objs, nv_n);
+    void * _nv_fpg_cache           = __atomic_load_n (&nv_block->nv_fpg, __ATOMIC_ACQUIRE);
+    *(uint16_t *)nv_objs[nv_n - 1] = _nv_fpg_cache != NULL
+                                         ? (uint8_t *)_nv_fpg_cache - (uint8_t *)nv_block->nv_base
+                                         : 0xffff;
+    __atomic_store_n (&nv_block->nv_fpg, nv_objs[0], __ATOMIC_RELEASE);
+#if NOVA_BLOCK_MIGRATION
+    __nv_block_note_remote_sl (nv_block, nv_n);
+#endif
+    _nv_racnt = __atomic_sub_fetch (&nv_block->nv_acnt, (nova_smobjcnt_t)nv_n, __ATOMIC_ACQ_REL);
+    nvmutex_unlock (&nv_block->nv_fpgm);
+
+    return __nv_block_acnt_settle (nv_block, _nv_racnt, nv_n);
+}
+
+static nova_res_t __nv_block_acnt_release (nova_block_t * nv_block, nvi_t nv_n)
+{
+    return __nv_block_acnt_settle (nv_block,
+                                   __atomic_sub_fetch (&nv_block->nv_acnt, (nova_smobjcnt_t)nv_n, __ATOMIC_ACQ_REL),
+                                   nv_n);
+}
 
+static nova_res_t __nv_block_acnt_settle (nova_block_t * nv_block, nova_smobjcnt_t nv_racnt, nvi_t nv_n)
+{
     /*
      * Now for the tricky part.
      */
 
 #define _NV_islalh(___nv_b___) \
     (__c11_atomic_load (&(___nv_b___)->nv_blfl, __ATOMIC_ACQUIRE) & NOVA_BLFL_ISHEAD)
+#define _NV_isbinned(___nv_b___) \
+    (__c11_atomic_load (&(___nv_b___)->nv_blfl, __ATOMIC_ACQUIRE) & NOVA_BLFL_BINNED)
 
-    nova_smobjcnt_t _nv_racnt = __atomic_sub_fetch (&nv_block->nv_acnt, 1, __ATOMIC_ACQ_REL);
-    if (0 == _nv_racnt) {
+    if (0 == nv_racnt) {
         /* If the allocation count becomes zero from this, and this is not the
          * head block of a local linkage, then ensure that no allocations occur and
          * that it does not become the head block of a local linkage, and inform
          * the parent linkage that this block is empty.
          *
-         * <EDIT:IGNORE>
-         * IGNORE [P2]: Once the FPGM is locked, if the block is not the head of a local linkage,
-         * IGNORE       and if there are no allocations on the block, then there will be no
-         * IGNORE       local operations completed on the block until the FPGM is unlocked.
-         * IGNORE
-         * IGNORE Therefore, we must ensure that P2 is true.
-         * </EDIT:IGNORE>
-         *
          * To prevent an FPGM-LL deadlock, we have to ensure synchronization of
          * LL locking: first, lock the LL, then the FPGM.
          *
@@ -298,32 +613,41 @@ nova_res_t __nv_block_dealloc (nova_block_t * nv_block, void * nv_obj)
          * state.
          */
         if (__builtin_expect (!_NV_islalh (nv_block), 1)) {
-            nova_lkg_t * _nvc_lkg = __atomic_load_n (&nv_block->nv_lkg, __ATOMIC_ACQUIRE);
-            nvmutex_lock (&_nvc_lkg->nv_ll);
-            nvmutex_lock (&nv_block->nv_fpgm);
-            if (__builtin_expect (!_NV_islalh (nv_block), 1)) {
-                if (0 == __atomic_load_n (&nv_block->nv_acnt, __ATOMIC_ACQUIRE)) {
-                    /* Well, we're good at this point.
-                     * NOTE: nv_block will be passed up with its FPGM locked; that
-                     * should be handled on landing.
-                     */
-                    __nv_lkg_empty (nv_block);
-                    goto nv_block_dealloc___secL___;
+            nova_lkg_t * _nvc_lkg = __nv_block_lock_lkg (nv_block);
+            if (_nvc_lkg != NULL) {
+                nvmutex_lock (&nv_block->nv_fpgm);
+                if (__builtin_expect (!_NV_islalh (nv_block), 1)) {
+                    if (0 == __atomic_load_n (&nv_block->nv_acnt, __ATOMIC_ACQUIRE)) {
+                        /* Well, we're good at this point.
+                         * NOTE: nv_block will be passed up with its FPGM locked; that
+                         * should be handled on landing. __nv_lkg_empty also takes
+                         * care of the LL.
+                         */
+                        __nv_lkg_empty (nv_block);
+                        goto nv_block_dealloc___secL___;
+                    }
                 }
-            }
 
-            /* it became the head (or it flipped in and out and got some allocations
-             * in between) -> ignore */
-            nvmutex_unlock (&nv_block->nv_fpgm);
-            nvmutex_unlock (&_nvc_lkg->nv_ll);
+                /* it became the head (or it flipped in and out and got some allocations
+                 * in between) -> ignore */
+                nvmutex_unlock (&nv_block->nv_fpgm);
+                nvmutex_unlock (&_nvc_lkg->nv_ll);
+            }
         }
-    }
-    /* We use == so that this is only triggered _once_; we don't want to waste costly
-     * extra cycles on this, especially when
-     */
-    if (_nv_racnt == (nv_block->nv_ocnt / 2)) {
-        /* empty-enough condition */
-        /* Although we're only modifying the side-linkage pointers, we do still
+    } else if (NOVA_LKG_BIN (nv_block->nv_ocnt, nv_racnt)
+               != NOVA_LKG_BIN (nv_block->nv_ocnt, nv_racnt + nv_n)) {
+        /* empty-enough condition: the block just crossed into a lower occupancy bin.
+         *
+         * Every range of the allocation count is only ever covered by one
+         * decrement, so this is only triggered _once_ per crossing; we don't want
+         * to waste costly extra cycles on this, especially as most deallocations
+         * won't cross anything.
+         *
+         * Only binned (i.e. non-head, local) blocks care; head blocks get binned
+         * with a freshly computed bin when they're slid away from, and regional
+         * linkages aren't sorted at all.
+         *
+         * Although we're only modifying the side-linkage pointers, we do still
          * have to check 0!=acnt, therefore our first instinct might be to lock
          * the FPGM, so we don't get extra concurrent deallocations that:
          *  a) empty it
@@ -332,31 +656,29 @@ nova_res_t __nv_block_dealloc (nova_block_t * nv_block, void * nv_obj)
          * However, all of the above scenarios require first locking the LL,
          * so we can actually proceed without locking the FPGM as the LL is already locked.
          */
-        nova_lkg_t * _nvc_lkg = __atomic_load_n (&nv_block->nv_lkg, __ATOMIC_ACQUIRE);
-        nvmutex_lock (&_nvc_lkg->nv_ll);
-        /* nvmutex_lock (&nv_block->nv_fpgm); */
-        if (__builtin_expect (!_NV_islalh (nv_block), 1)) {
-            if (0 != __atomic_load_n (&nv_block->nv_acnt, __ATOMIC_ACQUIRE)) {
-                /* We locked it, it's nonzero, and it's not head:
-                 * This block is _not_ vulnerable to empty-condition occurring.
-                 *
-                 * Tell the linkage that this block is empty enough.
-                 */
-                __nv_lkg_empty_e (nv_block);
-                goto nv_block_dealloc___secL___;
+        if (_NV_isbinned (nv_block)) {
+            nova_lkg_t * _nvc_lkg = __nv_block_lock_lkg (nv_block);
+            if (_nvc_lkg != NULL) {
+                if (__builtin_expect (!_NV_islalh (nv_block) && _NV_isbinned (nv_block), 1)) {
+                    if (0 != __atomic_load_n (&nv_block->nv_acnt, __ATOMIC_ACQUIRE)) {
+                        /* We locked it, it's nonzero, and it's not head:
+                         * This block is _not_ vulnerable to empty-condition occurring.
+                         *
+                         * Tell the linkage that this block is empty enough.
+                         */
+                        __nv_lkg_empty_e (nv_block);
+                        goto nv_block_dealloc___secL___;
+                    }
+                }
+                /* Block became empty (yield to empty-condition) or was moved. */
+                nvmutex_unlock (&_nvc_lkg->nv_ll);
             }
         }
-        /* IGNORE Block became empty, yield to empty-condition. */
-        /* nvmutex_unlock (&nv_block->nv_fpgm); */
-
-        /* Unlock the LL; we don't actually care that this is a cached value,
-         * because we want to lock the LL that was locked up above, so it's actually
-         * okay if nv_block->nv_lkg has changed (spoiler alert: it hasn't), so
-         * we just use the cached value.
-         */
-        nvmutex_unlock (&_nvc_lkg->nv_ll);
     }
 
+#undef _NV_islalh
+#undef _NV_isbinned
+
 nv_block_dealloc___secL___:
     return nova_ok;
 }
@@ -0,0 +1,426 @@
+#include "nova.h"
+/* memset */
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+/* The SSE4.1 and AVX2 paths are compiled in regardless of the target flags (see
+ * __nv_bm_isa), and only run on CPUs that have them.
+ */
+#    define NOVA_BM_X86 1
+/* _mm256_load_si256, _mm256_testz_si256, _mm256_or_si256, _mm256_store_si256
+ * _mm_load_si128, _mm_testz_si128, _mm_or_si128, _mm_movemask_epi8, ...
+ */
+#    include <immintrin.h>
+#else
+#    define NOVA_BM_X86 0
+#endif
+
+/*******************************************************************************
+ * BLOCK HANDLING : BITMAP BLOCKS
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Blocks formatted to a tiny size class (<= NOVA_BMBLOCK_MAXOSZ) don't use the
+ * intrusive free list: for 8-32 byte objects, following the free list means
+ * reading a freed object on every allocation, which is a cache miss whenever the
+ * object has gone cold, and it scatters reuse all over the pool.
+ *
+ * Instead, the front of the pool holds two occupancy bitmaps (1 = free):
+ *
+ *  +0          local map; only ever touched by the owning thread
+ *  +mapsz      foreign map; objects freed by other threads, guarded by the FPGM
+ *  +2*mapsz    objects
+ *
+ * Each map is a whole number of 256-bit groups, so that the object area keeps
+ * the alignment of the size class, and so that a group can be tested with a single
+ * vector instruction. The free pointers are reused as follows:
+ *
+ *  nv_fpl      NULL if the local map is empty, otherwise the first group of the
+ *              local map that may have a set bit (every group before it is zero)
+ *  nv_fpg      NULL if the foreign map is empty, otherwise the foreign map
+ *
+ * so the usual "FPL, then FPG" logic in the callers carries over unchanged.
+ *
+ * The maps would ideally live in the chunk header, off to the side of the
+ * objects, but the header doesn't have the room: with the default geometry, a
+ * block of 8-byte objects needs 2 x 256 bytes of map, 32KB for a whole chunk of
+ * them, against the few KB of slack there is. Sizing the header for that would
+ * cost every chunk two pools, bitmap blocks or not. So the maps take their space
+ * out of the pool instead, which only costs the bitmap blocks themselves: 3% of
+ * the objects at 8 bytes, 1.6% at 16, 0.8% at 32 (64, 32 and 16 objects out of
+ * a 16KB pool).
+ */
+
+/* 64-bit words per 256-bit group */
+#define _NV_BM_GROUP 4
+
+static nvi_t __nv_bm_mapsz (nvi_t nv_ocnt)
+{
+    return ((nv_ocnt + 255) >> 8) << 5;
+}
+
+/* Which of the vector paths below the CPU can run, worked out on first use:
+ * the library is built for the baseline target (SSE2 on x86-64), so anything
+ * beyond that has to be checked for at run time.
+ */
+#define _NV_BM_ISA_BASE 0
+#define _NV_BM_ISA_SSE41 1
+#define _NV_BM_ISA_AVX2 2
+
+static int __nv_bm_isa_detect (void)
+{
+#if NOVA_BM_X86
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2")) {
+        return _NV_BM_ISA_AVX2;
+    }
+    if (__builtin_cpu_supports ("sse4.1")) {
+        return _NV_BM_ISA_SSE41;
+    }
+#endif
+    return _NV_BM_ISA_BASE;
+}
+
+static inline int __nv_bm_isa (void)
+{
+    /* __atomic; -1 until detected. Racing detections all get the same answer.
+     */
+    static int _nv_isa = -1;
+    int _nv_l          = __atomic_load_n (&_nv_isa, __ATOMIC_RELAXED);
+    if (__builtin_expect (_nv_l < 0, 0)) {
+        _nv_l = __nv_bm_isa_detect ();
+        __atomic_store_n (&_nv_isa, _nv_l, __ATOMIC_RELAXED);
+    }
+    return _nv_l;
+}
+
+/* Index of the first nonzero word in the (nonzero) group starting at nv_wi.
+ */
+static inline nvi_t __nv_bm_group_word (const uint64_t * nv_map, nvi_t nv_wi)
+{
+    while (nv_map[nv_wi] == 0) {
+        nv_wi++;
+    }
+    return nv_wi;
+}
+
+/* Index of the first nonzero word of nv_map in [nv_from, nv_nwords), or nv_nwords if
+ * there is none. nv_from and nv_nwords are multiples of _NV_BM_GROUP.
+ */
+static nvi_t __nv_bm_scan_base (const uint64_t * nv_map, nvi_t nv_from, nvi_t nv_nwords)
+{
+    for (nvi_t _nv_wi = nv_from; _nv_wi < nv_nwords; _nv_wi += _NV_BM_GROUP) {
+#if defined(__SSE2__)
+        const __m128i _nv_v = _mm_or_si128 (_mm_load_si128 ((const __m128i *)&nv_map[_nv_wi]),
+                                            _mm_load_si128 ((const __m128i *)&nv_map[_nv_wi + 2]));
+        if (0xffff == _mm_movemask_epi8 (_mm_cmpeq_epi8 (_nv_v, _mm_setzero_si128 ()))) {
+            continue;
+        }
+#else
+        if (0 == (nv_map[_nv_wi] | nv_map[_nv_wi + 1] | nv_map[_nv_wi + 2] | nv_map[_nv_wi + 3])) {
+            continue;
+        }
+#endif
+        return __nv_bm_group_word (nv_map, _nv_wi);
+    }
+    return nv_nwords;
+}
+
+#if NOVA_BM_X86
+__attribute__ ((target ("sse4.1"))) static nvi_t __nv_bm_scan_sse41 (const uint64_t * nv_map, nvi_t nv_from, nvi_t nv_nwords)
+{
+    for (nvi_t _nv_wi = nv_from; _nv_wi < nv_nwords; _nv_wi += _NV_BM_GROUP) {
+        const __m128i _nv_v = _mm_or_si128 (_mm_load_si128 ((const __m128i *)&nv_map[_nv_wi]),
+                                            _mm_load_si128 ((const __m128i *)&nv_map[_nv_wi + 2]));
+        if (_mm_testz_si128 (_nv_v, _nv_v)) {
+            continue;
+        }
+        return __nv_bm_group_word (nv_map, _nv_wi);
+    }
+    return nv_nwords;
+}
+
+__attribute__ ((target ("avx2"))) static nvi_t __nv_bm_scan_avx2 (const uint64_t * nv_map, nvi_t nv_from, nvi_t nv_nwords)
+{
+    for (nvi_t _nv_wi = nv_from; _nv_wi < nv_nwords; _nv_wi += _NV_BM_GROUP) {
+        const __m256i _nv_v = _mm256_load_si256 ((const __m256i *)&nv_map[_nv_wi]);
+        if (_mm256_testz_si256 (_nv_v, _nv_v)) {
+            continue;
+        }
+        return __nv_bm_group_word (nv_map, _nv_wi);
+    }
+    return nv_nwords;
+}
+
+__attribute__ ((target ("avx2"))) static void __nv_bm_merge_avx2 (uint64_t * nv_lmap, uint64_t * nv_gmap, nvi_t nv_nwords)
+{
+    for (nvi_t _nv_wi = 0; _nv_wi < nv_nwords; _nv_wi += _NV_BM_GROUP) {
+        const __m256i _nv_g = _mm256_load_si256 ((const __m256i *)&nv_gmap[_nv_wi]);
+        _mm256_store_si256 ((__m256i *)&nv_lmap[_nv_wi],
+                            _mm256_or_si256 (_mm256_load_si256 ((const __m256i *)&nv_lmap[_nv_wi]), _nv_g));
+        _mm256_store_si256 ((__m256i *)&nv_gmap[_nv_wi], _mm256_setzero_si256 ());
+    }
+}
+#endif
+
+static nvi_t __nv_bm_scan (const uint64_t * nv_map, nvi_t nv_from, nvi_t nv_nwords)
+{
+#if NOVA_BM_X86
+    switch (__nv_bm_isa ()) {
+    case _NV_BM_ISA_AVX2:
+        return __nv_bm_scan_avx2 (nv_map, nv_from, nv_nwords);
+    case _NV_BM_ISA_SSE41:
+        return __nv_bm_scan_sse41 (nv_map, nv_from, nv_nwords);
+    default:
+        break;
+    }
+#endif
+    return __nv_bm_scan_base (nv_map, nv_from, nv_nwords);
+}
+
+/* Fold the foreign map into the local map, and clear the foreign map.
+ * FPGM must be locked.
+ */
+static void __nv_bm_merge (uint64_t * nv_lmap, uint64_t * nv_gmap, nvi_t nv_nwords)
+{
+#if NOVA_BM_X86
+    if (__nv_bm_isa () == _NV_BM_ISA_AVX2) {
+        __nv_bm_merge_avx2 (nv_lmap, nv_gmap, nv_nwords);
+        return;
+    }
+#endif
+    for (nvi_t _nv_wi = 0; _nv_wi < nv_nwords; _nv_wi++) {
+        nv_lmap[_nv_wi] |= nv_gmap[_nv_wi];
+        nv_gmap[_nv_wi] = 0;
+    }
+}
+
+nova_res_t __nv_bmblock_fmt (nova_block_t * nv_block, nova_smobjsz_t nv_osz)
+{
+    /*
+     * Operating assumption: block is empty, with no extant referrents.
+     */
+    const nvi_t _nv_smobjpoolsz = nova_read_cfg (NV_SMOBJ_POOLSIZE);
+
+    /* Size the maps for the object count we'd get without them; that's an upper
+     * bound, so the maps always cover the (slightly smaller) real object count.
+     */
+    const nvi_t _nv_mapsz = __nv_bm_mapsz (_nv_smobjpoolsz / nv_osz);
+    const nvi_t _nv_ocnt  = (_nv_smobjpoolsz - 2 * _nv_mapsz) / nv_osz;
+
+    nv_block->nv_osz  = nv_osz;
+    nv_block->nv_ocnt = _nv_ocnt;
+    __atomic_store_n (&nv_block->nv_acnt, 0, __ATOMIC_RELEASE);
+
+#if NOVA_MODE_DEBUG
+    memset (nv_block->nv_base, 0, _nv_smobjpoolsz);
+#else
+    memset (nv_block->nv_base, 0, 2 * _nv_mapsz);
+#endif
+
+    /* Everything is free: set the first _nv_ocnt bits of the local map.
+     */
+    uint64_t * _nv_lmap = nv_block->nv_base;
+    memset (_nv_lmap, 0xff, (_nv_ocnt >> 6) << 3);
+    if (_nv_ocnt & 63) {
+        _nv_lmap[_nv_ocnt >> 6] = ((uint64_t)1 << (_nv_ocnt & 63)) - 1;
+    }
+
+    nv_block->nv_fpl = _nv_lmap;
+    __atomic_store_n (&nv_block->nv_fpg, NULL, __ATOMIC_RELEASE);
+    __c11_atomic_fetch_or (&nv_block->nv_blfl, NOVA_BLFL_BITMAP, __ATOMIC_ACQ_REL);
+
+    return nova_ok;
+}
+
+/* Allocate from the local map, starting at the FPL cursor.
+ */
+static nova_res_t __nv_bmblock_alloc_inner (nova_block_t * nv_block, void ** nv_obj)
+{
+    uint64_t * _nv_lmap     = nv_block->nv_base;
+    const nvi_t _nv_mapsz   = __nv_bm_mapsz (nv_block->nv_ocnt);
+    const nvi_t _nv_nwords  = _nv_mapsz >> 3;
+    const nvi_t _nv_wi      = __nv_bm_scan (_nv_lmap, (nvi_t)((uint64_t *)nv_block->nv_fpl - _nv_lmap), _nv_nwords);
+    if (__builtin_expect (_nv_wi == _nv_nwords, 0)) {
+        nv_block->nv_fpl = NULL;
+        return nova_fail;
+    }
+
+    const nvi_t _nv_bi = __builtin_ctzll (_nv_lmap[_nv_wi]);
+    /* Clear the lowest set bit.
+     */
+    _nv_lmap[_nv_wi] &= _nv_lmap[_nv_wi] - 1;
+    nv_block->nv_fpl = &_nv_lmap[_nv_wi & ~(nvi_t)(_NV_BM_GROUP - 1)];
+
+    *nv_obj = (uint8_t *)nv_block->nv_base + 2 * _nv_mapsz + ((_nv_wi << 6) + _nv_bi) * nv_block->nv_osz;
+
+    __atomic_add_fetch (&nv_block->nv_acnt, 1, __ATOMIC_ACQ_REL);
+
+    return nova_ok;
+}
+
+/* Pull the foreign map into the local map, if there's anything in it.
+ */
+static nova_res_t __nv_bmblock_reclaim (nova_block_t * nv_block)
+{
+    if (__builtin_expect (__atomic_load_n (&nv_block->nv_fpg, __ATOMIC_ACQUIRE) == NULL, 0)) {
+        return nova_fail;
+    }
+
+    nvmutex_lock (&nv_block->nv_fpgm);
+    __nv_bmblock_reclaim_sl (nv_block);
+    nvmutex_unlock (&nv_block->nv_fpgm);
+
+    return nova_ok;
+}
+
+void __nv_bmblock_reclaim_sl (nova_block_t * nv_block)
+{
+    if (__atomic_load_n (&nv_block->nv_fpg, __ATOMIC_ACQUIRE) == NULL) {
+        return;
+    }
+
+    const nvi_t _nv_mapsz = __nv_bm_mapsz (nv_block->nv_ocnt);
+    __nv_bm_merge (nv_block->nv_base, (uint64_t *)((uint8_t *)nv_block->nv_base + _nv_mapsz), _nv_mapsz >> 3);
+    __atomic_store_n (&nv_block->nv_fpg, NULL, __ATOMIC_RELEASE);
+
+    nv_block->nv_fpl = nv_block->nv_base;
+}
+
+nvi_t __nv_bmblock_for_each_free (nova_block_t * nv_block, nova_objfn_t nv_fn)
+{
+    uint64_t * _nv_lmap   = nv_block->nv_base;
+    const nvi_t _nv_mapsz = __nv_bm_mapsz (nv_block->nv_ocnt);
+    uint8_t * _nv_objbase = (uint8_t *)nv_block->nv_base + 2 * _nv_mapsz;
+    nvi_t _nv_n           = 0;
+
+    __nv_bmblock_reclaim (nv_block);
+
+    /* Bits past nv_ocnt are never set, so whole words are fine.
+     */
+    for (nvi_t _nv_wi = 0; _nv_wi < ((nvi_t)nv_block->nv_ocnt + 63) >> 6; _nv_wi++) {
+        for (uint64_t _nv_w = _nv_lmap[_nv_wi]; _nv_w != 0; _nv_w &= _nv_w - 1) {
+            nv_fn (_nv_objbase + ((_nv_wi << 6) + __builtin_ctzll (_nv_w)) * nv_block->nv_osz);
+            _nv_n++;
+        }
+    }
+
+    return _nv_n;
+}
+
+nova_res_t __nv_bmblock_alloc (nova_block_t * nv_block, void ** nv_obj)
+{
+    if (__builtin_expect (nv_block->nv_fpl != NULL, 1)) {
+        if (__builtin_expect (nova_ok == __nv_bmblock_alloc_inner (nv_block, nv_obj), 1)) {
+            return nova_ok;
+        }
+    }
+    if (nova_ok == __nv_bmblock_reclaim (nv_block)) {
+        return __nv_bmblock_alloc_inner (nv_block, nv_obj);
+    }
+    return nova_fail;
+}
+
+nova_res_t __nv_bmblock_alloc_bulk (nova_block_t * nv_block,
+                                    void ** nv_objs,
+                                    nvi_t nv_n,
+                                    nvi_t * nv_got)
+{
+    uint64_t * _nv_lmap    = nv_block->nv_base;
+    const nvi_t _nv_mapsz  = __nv_bm_mapsz (nv_block->nv_ocnt);
+    const nvi_t _nv_nwords = _nv_mapsz >> 3;
+    uint8_t * _nv_objbase  = (uint8_t *)nv_block->nv_base + 2 * _nv_mapsz;
+    nvi_t _nv_got          = 0;
+
+    if (nv_block->nv_fpl == NULL) {
+        __nv_bmblock_reclaim (nv_block);
+    }
+
+    /* Take whole words at a time: every set bit we consume is one object, and
+     * the word gets written back once.
+     */
+    nvi_t _nv_wi = nv_block->nv_fpl == NULL ? _nv_nwords : (nvi_t)((uint64_t *)nv_block->nv_fpl - _nv_lmap);
+    while (_nv_got < nv_n) {
+        _nv_wi = __nv_bm_scan (_nv_lmap, _nv_wi & ~(nvi_t)(_NV_BM_GROUP - 1), _nv_nwords);
+        if (_nv_wi == _nv_nwords) {
+            break;
+        }
+        uint64_t _nv_w = _nv_lmap[_nv_wi];
+        while (_nv_w != 0 && _nv_got < nv_n) {
+            nv_objs[_nv_got++] = _nv_objbase + ((_nv_wi << 6) + __builtin_ctzll (_nv_w)) * nv_block->nv_osz;
+            _nv_w &= _nv_w - 1;
+        }
+        _nv_lmap[_nv_wi] = _nv_w;
+    }
+    nv_block->nv_fpl = _nv_wi == _nv_nwords ? NULL : &_nv_lmap[_nv_wi & ~(nvi_t)(_NV_BM_GROUP - 1)];
+
+    __atomic_add_fetch (&nv_block->nv_acnt, _nv_got, __ATOMIC_ACQ_REL);
+    *nv_got = _nv_got;
+
+    return _nv_got ? nova_ok : nova_fail;
+}
+
+nova_res_t __nv_bmblock_release (nova_block_t * nv_block,
+                                 void ** nv_objs,
+                                 nvi_t nv_n,
+                                 uint16_t nv_blfl,
+                                 nova_smobjcnt_t * nv_racnt)
+{
+    const nvi_t _nv_mapsz = __nv_bm_mapsz (nv_block->nv_ocnt);
+    uint8_t * _nv_objbase = (uint8_t *)nv_block->nv_base + 2 * _nv_mapsz;
+    /* Size classes are powers of two, so no division here.
+     */
+    const nvi_t _nv_oszl2 = __builtin_ctz (nv_block->nv_osz);
+
+    /* Same ownership argument as __nv_block_dealloc: it's fine for a local
+     * deallocation to take the foreign path, never the other way around.
+     */
+    int _nv_held = 0;
+    if (__builtin_expect (__nv_block_dealloc_is_local (nv_block, &_nv_held), 1)) {
+        uint64_t * _nv_lmap = nv_block->nv_base;
+        nvi_t _nv_lowest    = _nv_mapsz >> 3;
+        for (nvi_t _nv_i = 0; _nv_i < nv_n; _nv_i++) {
+            const nvi_t _nv_oi = (nvi_t)((uint8_t *)nv_objs[_nv_i] - _nv_objbase) >> _nv_oszl2;
+            _nv_lmap[_nv_oi >> 6] |= (uint64_t)1 << (_nv_oi & 63);
+            if ((_nv_oi >> 6) < _nv_lowest) {
+                _nv_lowest = _nv_oi >> 6;
+            }
+        }
+        /* Pull the cursor back if we freed something in front of it.
+         */
+        uint64_t * _nv_cursor = &_nv_lmap[_nv_lowest & ~(nvi_t)(_NV_BM_GROUP - 1)];
+        if (nv_block->nv_fpl == NULL || _nv_cursor < (uint64_t *)nv_block->nv_fpl) {
+            nv_block->nv_fpl = _nv_cursor;
+        }
+        if (_nv_held) {
+            nvmutex_unlock (&nv_block->nv_fpgm);
+        }
+        *nv_racnt = __atomic_sub_fetch (&nv_block->nv_acnt, (nova_smobjcnt_t)nv_n, __ATOMIC_ACQ_REL);
+    } else {
+        uint64_t * _nv_gmap = (uint64_t *)((uint8_t *)nv_block->nv_base + _nv_mapsz);
+        if (!_nv_held) {
+            nvmutex_lock (&nv_block->nv_fpgm);
+        }
+        /* Same as the free list case: if the block was reset while we were on our
+         * way here, the objects went with it, and the maps may not even be the
+         * ones they were allocated from anymore.
+         */
+        if (__builtin_expect (__nv_block_was_reset (nv_block, nv_blfl), 0)) {
+            nvmutex_unlock (&nv_block->nv_fpgm);
+            return nova_fail;
+        }
+        for (nvi_t _nv_i = 0; _nv_i < nv_n; _nv_i++) {
+            const nvi_t _nv_oi = (nvi_t)((uint8_t *)nv_objs[_nv_i] - _nv_objbase) >> _nv_oszl2;
+            _nv_gmap[_nv_oi >> 6] |= (uint64_t)1 << (_nv_oi & 63);
+        }
+        __atomic_store_n (&nv_block->nv_fpg, _nv_gmap, __ATOMIC_RELEASE);
+#if NOVA_BLOCK_MIGRATION
+        __nv_block_note_remote_sl (nv_block, nv_n);
+#endif
+        *nv_racnt = __atomic_sub_fetch (&nv_block->nv_acnt, (nova_smobjcnt_t)nv_n, __ATOMIC_ACQ_REL);
+        nvmutex_unlock (&nv_block->nv_fpgm);
+    }
+
+    return nova_ok;
+}
@@ -2,8 +2,9 @@
 
 /* UTILITY ZONE ***************************************************************/
 
-/* __atomic */ uintptr_t _nv_dealloc_csize_cache     = 0;
-/* __atomic */ uintptr_t _nv_dealloc_smobjplsz_cache = 0;
+/* __atomic */ uintptr_t _nv_dealloc_csize_cache     = NOVA_CFG_CHUNKSIZE;
+/* __atomic */ uintptr_t _nv_dealloc_smobjplsz_cache = NOVA_CFG_SMOBJ_POOLSIZE;
+/* __atomic */ uintptr_t _nv_dealloc_hdrpools_cache  = 1;
 
 nova_res_t __nv_cache_reload_from_cfg (uintptr_t nv_override, nvcfg_t nv_cfg, uintptr_t * nv_cache)
 {
@@ -0,0 +1,163 @@
+#include "nova.h"
+
+/*******************************************************************************
+ * CONFIGURATION HANDLING
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Indexed by nvcfg_t. The derived entries are filled in by __nv_cfg_derive, and
+ * are 0 until then.
+ */
+static nvi_t _nv_cfg[] = {
+    [NV_CHUNKSIZE]        = NOVA_CFG_CHUNKSIZE,
+    [NV_SMOBJ_POOLSIZE]   = NOVA_CFG_SMOBJ_POOLSIZE,
+    [NV_SMOBJ_POOLCOUNT]  = NOVA_CFG_SMOBJ_POOLCOUNT,
+    [NV_CHUNK_HDRPOOLS]   = 0,
+    [NV_CHUNK_BLOCKCOUNT] = 0,
+};
+
+/* Chunk geometry is baked into every chunk (and every lookup of an object's
+ * block), so it's fixed from the first chunk on (see __nv_cfg_freeze). nv_cfgl
+ * guards the geometry entries against changes while they're frozen, and the
+ * derived entries against the lazy derivation in nova_read_cfg.
+ */
+static nova_mutex_t _nv_cfgl = PTHREAD_MUTEX_INITIALIZER;
+/* __atomic */ static int _nv_cfg_frozen = 0;
+
+/* Works out how many pools the chunk header needs, given the chunk and pool
+ * sizes: the header pools have to hold the nova_chunk_t, and one block header, one
+ * pool map bit and one nova_rfstat_t for every pool that *isn't* a header pool.
+ * Returns 0 if there's no such split.
+ */
+static nvi_t __nv_cfg_hdrpools (nvi_t nv_csize, nvi_t nv_plsz)
+{
+    const nvi_t _nv_npools = nv_csize / nv_plsz;
+    for (nvi_t _nv_h = 1; _nv_h < _nv_npools; _nv_h++) {
+        const nvi_t _nv_nb  = _nv_npools - _nv_h;
+        const nvi_t _nv_hdr = __builtin_offsetof (nova_chunk_t, nv_blocks)
+            + _nv_nb * sizeof (nova_block_t)
+            + ((_nv_nb + 63) >> 6) * sizeof (uint64_t)
+            + _nv_nb * sizeof (nova_rfstat_t);
+        if (_nv_hdr <= _nv_h * nv_plsz) {
+            return _nv_h;
+        }
+    }
+    return 0;
+}
+
+static nova_res_t __nv_cfg_derive (nvi_t nv_csize, nvi_t nv_plsz, nvi_t * nv_hdrpools, nvi_t * nv_nblocks)
+{
+    if (nv_csize == 0 || (nv_csize & (nv_csize - 1)) != 0
+        || nv_plsz == 0 || (nv_plsz & (nv_plsz - 1)) != 0
+        || nv_plsz > 0x10000 || nv_plsz >= nv_csize) {
+        return nova_fail;
+    }
+    const nvi_t _nv_h = __nv_cfg_hdrpools (nv_csize, nv_plsz);
+    if (_nv_h == 0) {
+        return nova_fail;
+    }
+    const nvi_t _nv_nb = nv_csize / nv_plsz - _nv_h;
+    /* nv_ocnt of a span is 16 bits. */
+    if (_nv_nb > 0xffff) {
+        return nova_fail;
+    }
+    *nv_hdrpools = _nv_h;
+    *nv_nblocks  = _nv_nb;
+    return nova_ok;
+}
+
+nvi_t nova_read_cfg (nvcfg_t nv_cfg)
+{
+    if (__builtin_expect (nv_cfg >= NV_CHUNK_HDRPOOLS
+                              && 0 == __atomic_load_n (&_nv_cfg[nv_cfg], __ATOMIC_ACQUIRE),
+                          0)) {
+        /* First read of the derived entries with the default geometry; under
+         * the lock, so that it can't land on top of a nova_set_cfg.
+         */
+        nvmutex_lock (&_nv_cfgl);
+        if (0 == __atomic_load_n (&_nv_cfg[nv_cfg], __ATOMIC_ACQUIRE)) {
+            nvi_t _nv_h, _nv_nb;
+            __nv_cfg_derive (_nv_cfg[NV_CHUNKSIZE], _nv_cfg[NV_SMOBJ_POOLSIZE], &_nv_h, &_nv_nb);
+            __atomic_store_n (&_nv_cfg[NV_CHUNK_BLOCKCOUNT], _nv_nb, __ATOMIC_RELEASE);
+            __atomic_store_n (&_nv_cfg[NV_CHUNK_HDRPOOLS], _nv_h, __ATOMIC_RELEASE);
+        }
+        nvmutex_unlock (&_nv_cfgl);
+    }
+    return __atomic_load_n (&_nv_cfg[nv_cfg], __ATOMIC_ACQUIRE);
+}
+
+void __nv_cfg_freeze (void)
+{
+    if (__builtin_expect (__atomic_load_n (&_nv_cfg_frozen, __ATOMIC_ACQUIRE), 1)) {
+        return;
+    }
+    /* Taking the lock waits out a nova_set_cfg that's already under way.
+     */
+    nvmutex_lock (&_nv_cfgl);
+    __atomic_store_n (&_nv_cfg_frozen, 1, __ATOMIC_RELEASE);
+    nvmutex_unlock (&_nv_cfgl);
+}
+
+nova_res_t nova_set_cfg (nvcfg_t nv_cfg, nvi_t nv_value)
+{
+    nova_res_t _nv_res = nova_fail;
+    nvi_t _nv_h, _nv_nb;
+
+    nvmutex_lock (&_nv_cfgl);
+    nvi_t _nv_csize = _nv_cfg[NV_CHUNKSIZE];
+    nvi_t _nv_plsz  = _nv_cfg[NV_SMOBJ_POOLSIZE];
+
+    if (__builtin_expect (nv_cfg != NV_SMOBJ_POOLCOUNT && _nv_cfg_frozen, 0)) {
+#if NOVA_MODE_DEBUG
+        __nv_error (NVE_BADCFG, nv_cfg, "nova_set_cfg(...): chunk geometry can't change once there are chunks.");
+#endif
+        goto out;
+    }
+
+    switch (nv_cfg) {
+    case NV_CHUNKSIZE:
+        _nv_csize = nv_value;
+        break;
+    case NV_SMOBJ_POOLSIZE:
+        _nv_plsz = nv_value;
+        break;
+    case NV_SMOBJ_POOLCOUNT:
+        if (nv_value < 2) {
+#if NOVA_MODE_DEBUG
+            __nv_error (NVE_BADCFG, nv_cfg, "nova_set_cfg(...): heaps need at least one sized linkage.");
+#endif
+            goto out;
+        }
+        __atomic_store_n (&_nv_cfg[NV_SMOBJ_POOLCOUNT], nv_value, __ATOMIC_RELEASE);
+        _nv_res = nova_ok;
+        goto out;
+    default:
+#if NOVA_MODE_DEBUG
+        __nv_error (NVE_BADCFG, nv_cfg, "nova_set_cfg(...): parameter is derived, and can't be set.");
+#endif
+        goto out;
+    }
+
+    if (nova_ok != __nv_cfg_derive (_nv_csize, _nv_plsz, &_nv_h, &_nv_nb)) {
+#if NOVA_MODE_DEBUG
+        __nv_error (NVE_BADCFG, nv_cfg, "nova_set_cfg(...): invalid chunk geometry (chunk size %zu, pool size %zu).", _nv_csize, _nv_plsz);
+#endif
+        goto out;
+    }
+
+    __atomic_store_n (&_nv_cfg[NV_CHUNKSIZE], _nv_csize, __ATOMIC_RELEASE);
+    __atomic_store_n (&_nv_cfg[NV_SMOBJ_POOLSIZE], _nv_plsz, __ATOMIC_RELEASE);
+    __atomic_store_n (&_nv_cfg[NV_CHUNK_BLOCKCOUNT], _nv_nb, __ATOMIC_RELEASE);
+    __atomic_store_n (&_nv_cfg[NV_CHUNK_HDRPOOLS], _nv_h, __ATOMIC_RELEASE);
+
+    /* The dealloc path doesn't go through here. */
+    __nv_cache_reload_from_cfg (0, NV_CHUNKSIZE, &_nv_dealloc_csize_cache);
+    __nv_cache_reload_from_cfg (0, NV_SMOBJ_POOLSIZE, &_nv_dealloc_smobjplsz_cache);
+    __nv_cache_reload_from_cfg (0, NV_CHUNK_HDRPOOLS, &_nv_dealloc_hdrpools_cache);
+    _nv_res = nova_ok;
+
+out:
+    nvmutex_unlock (&_nv_cfgl);
+    return _nv_res;
+}
@@ -13,62 +13,109 @@ NOVA_DOCSTUB ();
 
 nova_res_t nv_chunk_create (nova_chunk_t ** nv_chunk)
 {
+    __nv_cfg_freeze ();
     nvi_t _nv_chunksize_cache = nova_read_cfg (NV_CHUNKSIZE);
 
     /* In order for the block lookup to actually work properly, we need to ensure
-     * that the chunk is properly aligned (i.e. aligned to its own size) */
-    nvr_t r = posix_memalign ((void **)nv_chunk,
-                              _nv_chunksize_cache,
-                              _nv_chunksize_cache);
-    if (__builtin_expect (r != 0, 0)) {
+     * that the chunk is properly aligned (i.e. aligned to its own size); the
+     * arena does this for us, and only if it's out of address space do we go
+     * to posix_memalign. */
+    if (nova_ok != __nv_arena_chunk_alloc (nv_chunk)) {
+        nvr_t r = posix_memalign ((void **)nv_chunk,
+                                  _nv_chunksize_cache,
+                                  _nv_chunksize_cache);
+        if (__builtin_expect (r != 0, 0)) {
 #if NOVA_MODE_DEBUG
-        if (r == ENOMEM) /* OOM */
-            __nv_error (NVE_CHUNKALLOC_DRY);
-        if (r == EINVAL)
-            __nv_error (NVE_BADCFG, NV_CHUNKSIZE, "nv_chunk_create(...): chunksize not a multiple of the system page size.");
+            if (r == ENOMEM) /* OOM */
+                __nv_error (NVE_CHUNKALLOC_DRY);
+            if (r == EINVAL)
+                __nv_error (NVE_BADCFG, NV_CHUNKSIZE, "nv_chunk_create(...): chunksize not a multiple of the system page size.");
 #endif
-        /* Normal failure: leave it to the caller, but don't print debug info.
-         */
-        return nova_fail;
+            /* Normal failure: leave it to the caller, but don't print debug info.
+             */
+            return nova_fail;
+        }
     }
-    (*nv_chunk)->nv_next = NULL;
+    (*nv_chunk)->nv_next   = NULL;
+    (*nv_chunk)->nv_spnx   = NULL;
+    (*nv_chunk)->nv_spheap = NULL;
+    (*nv_chunk)->nv_nidle  = 0;
+    (*nv_chunk)->nv_dmsz   = 0;
 
-    /* size of a single block */
-    nvi_t _nv_smobj_poolsize_cache = nova_read_cfg (NV_SMOBJ_POOLSIZE);
-    /* Yes, 64, not 63. */
-    if (_nv_smobj_poolsize_cache < __builtin_offsetof(struct nova_chunk, nv_blocks[64])) {
+    /* Geometry is validated when it's configured, so the header pools always
+     * have room for all the block headers and the pool map.
+     */
+    nvi_t _nv_nblocks_cache = nova_read_cfg (NV_CHUNK_BLOCKCOUNT);
 #if NOVA_MODE_DEBUG
-        __nv_error (NVE_BADCFG, NV_SMOBJ_POOLSIZE, "nv_chunk_create(...): small object poolsize too small.");
-#endif
+    if (_nv_nblocks_cache == 0) {
+        __nv_error (NVE_BADCFG, NV_SMOBJ_POOLSIZE, "nv_chunk_create(...): chunk has no room for blocks.");
+        __nv_chunk_destroy (*nv_chunk);
         return nova_fail;
     }
-    uint8_t * locator = (uint8_t *)(*nv_chunk);
-    locator += _nv_smobj_poolsize_cache;
-    for (nvi_t i = 0; i < 63; i++) {
-        nv_block_init (&(*nv_chunk)->nv_blocks[i], locator);
-        locator += _nv_smobj_poolsize_cache;
+#endif
+    /* Block headers are initialized lazily (see __nv_block_init_lazy); all we
+     * do here is mark them as such. That saves a mutex init per block for
+     * blocks that are never requested, and keeps chunk creation down to one
+     * store per header.
+     */
+    for (nvi_t i = 0; i < _nv_nblocks_cache; i++) {
+        (*nv_chunk)->nv_blocks[i].nv_base = NULL;
+    }
+    /* Pool map starts out empty, the slack is left as is. */
+    uint64_t * _nv_pmap = __nv_chunk_pmap (*nv_chunk);
+    for (nvi_t i = 0; i < ((_nv_nblocks_cache + 63) >> 6); i++) {
+        _nv_pmap[i] = 0;
     }
     return nova_ok;
 }
 
+uint64_t * __nv_chunk_pmap (nova_chunk_t * nv_chunk)
+{
+    return (uint64_t *)&nv_chunk->nv_blocks[nova_read_cfg (NV_CHUNK_BLOCKCOUNT)];
+}
+
+void * __nv_chunk_slack (nova_chunk_t * nv_chunk, nvi_t * nv_size)
+{
+    const nvi_t _nv_nblocks = nova_read_cfg (NV_CHUNK_BLOCKCOUNT);
+    nova_rfstat_t * _nv_rfs = (nova_rfstat_t *)&__nv_chunk_pmap (nv_chunk)[(_nv_nblocks + 63) >> 6];
+    uint8_t * _nv_slack     = (uint8_t *)&_nv_rfs[_nv_nblocks];
+    uint8_t * _nv_end       = (uint8_t *)nv_chunk
+        + nova_read_cfg (NV_CHUNK_HDRPOOLS) * nova_read_cfg (NV_SMOBJ_POOLSIZE);
+    *nv_size = (nvi_t)(_nv_end - _nv_slack);
+    return _nv_slack;
+}
+
 nova_res_t __nv_chunk_release_blocks_to (
     nova_chunk_t * nv_chunk,
     nova_heap_t * nv_receiver,
     nvi_t nv_begin,
     nvi_t nv_end)
 {
-    nova_lkg_t * _nv_ulkg = &nv_receiver->nv_lkgs[0];
-    nvmutex_lock (&_nv_ulkg->nv_ll);
+    if (nv_begin >= nv_end) {
+        return nova_ok;
+    }
+
+    /* The chunk is fresh, so nobody else can see these blocks yet: we can build
+     * the chain without any of the FPGMs, and then push the whole thing onto
+     * the unsized linkage at once.
+     */
+    const nova_tid_t _nv_tid = __nv_tid ();
     for (nvi_t i = nv_begin; i < nv_end; i++) {
-        nvmutex_lock (&nv_chunk->nv_blocks[i].nv_fpgm);
-        __nv_regional_lkg_receive_block_nl_sl (&nv_receiver->nv_lkgs[0], &nv_chunk->nv_blocks[i]);
+        nova_block_t * _nv_block = &nv_chunk->nv_blocks[i];
+        _nv_block->nv_owner      = _nv_tid;
+        _nv_block->nv_lkgnx      = (i + 1 == nv_end) ? NULL : &nv_chunk->nv_blocks[i + 1];
     }
-    nvmutex_unlock (&_nv_ulkg->nv_ll);
-    return nova_ok;
+
+    return __nv_ulkg_push (&nv_receiver->nv_lkgs[0],
+                           &nv_chunk->nv_blocks[nv_begin],
+                           &nv_chunk->nv_blocks[nv_end - 1]);
 }
 
 nova_res_t __nv_chunk_destroy (nova_chunk_t * nv_chunk)
 {
+    if (__nv_arena_owns (nv_chunk)) {
+        return __nv_arena_chunk_release (nv_chunk);
+    }
     free (nv_chunk);
     return nova_ok;
 }
@@ -96,8 +143,60 @@ nova_res_t nv_chunk_destroy_chained (nova_chunk_t * nv_begin, nvi_t nv_number)
 
 nova_res_t nv_chunk_bind_to_root (nova_chunk_t * nv_chunk, nova_heap_t * nv_heap)
 {
-    nv_chunk->nv_next              = ((nova_chunk_t **)nv_heap)[-2];
-    ((nova_chunk_t **)nv_heap)[-2] = nv_chunk;
+    /* Span allocators create chunks too, without holding any of the root's
+     * locks, so the push has to be lock-free.
+     */
+    nova_chunk_t ** _nv_chunks = &NOVA_RHEAP_PFX (nv_heap)->nv_chunks;
+    nv_chunk->nv_next          = __atomic_load_n (_nv_chunks, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n (_nv_chunks,
+                                         &nv_chunk->nv_next,
+                                         nv_chunk,
+                                         /* weak = */ 1,
+                                         __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE))
+        ;
 
     return nova_ok;
 }
+
+nova_res_t __nv_chunk_unbind_from_root (nova_chunk_t * nv_chunk, nova_heap_t * nv_heap)
+{
+    /* Binds only ever swing the head of the list, so everything behind the
+     * head is ours to relink (as long as we're the only unbinder, hence the
+     * lock); the head itself needs a CAS, and if that fails, somebody pushed
+     * in front of us and it's not the head anymore.
+     */
+    nova_mutex_t * _nv_chunkl  = &NOVA_RHEAP_PFX (nv_heap)->nv_chunkl;
+    nova_chunk_t ** _nv_chunks = &NOVA_RHEAP_PFX (nv_heap)->nv_chunks;
+    nvmutex_lock (_nv_chunkl);
+    for (;;) {
+        nova_chunk_t * _nv_head = __atomic_load_n (_nv_chunks, __ATOMIC_ACQUIRE);
+        if (_nv_head == nv_chunk) {
+            if (__atomic_compare_exchange_n (_nv_chunks,
+                                             &_nv_head,
+                                             nv_chunk->nv_next,
+                                             /* weak = */ 0,
+                                             __ATOMIC_ACQ_REL,
+                                             __ATOMIC_ACQUIRE)) {
+                break;
+            }
+            continue;
+        }
+        for (nova_chunk_t * _nvc = _nv_head; _nvc != NULL; _nvc = _nvc->nv_next) {
+            if (_nvc->nv_next == nv_chunk) {
+                _nvc->nv_next     = nv_chunk->nv_next;
+                nv_chunk->nv_next = NULL;
+                nvmutex_unlock (_nv_chunkl);
+                return nova_ok;
+            }
+        }
+        nvmutex_unlock (_nv_chunkl);
+#if NOVA_MODE_DEBUG
+        __nv_error (NVE_BADVAL, "__nv_chunk_unbind_from_root(%p, %p): chunk isn't bound to the heap.", nv_chunk, nv_heap);
+#endif
+        return nova_fail;
+    }
+    nvmutex_unlock (_nv_chunkl);
+    nv_chunk->nv_next = NULL;
+    return nova_ok;
+}
@@ -0,0 +1,149 @@
+#include "nova.h"
+
+/* fprintf, vfprintf, stderr */
+#include <stdio.h>
+/* va_list, va_start, va_arg, va_end */
+#include <stdarg.h>
+/* abort */
+#include <stdlib.h>
+
+/*******************************************************************************
+ * ERROR REPORTING
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Errors are reported, not handled: whoever calls __nv_error still returns
+ * nova_fail (or NULL) to its own caller, which is where the client finds out.
+ * The one exception is NVE_IMPOSSIBLE, after which there's no telling what state
+ * the heaps are in, so we stop right there.
+ */
+
+static const char * __nv_error_name (nve_t nv_err)
+{
+    switch (nv_err) {
+    case NVE_OK:
+        return "ok";
+    case NVE_FAIL:
+        return "failure";
+    case NVE_BADCFG:
+        return "bad configuration";
+    case NVE_BADVAL:
+        return "bad value";
+    case NVE_BADCALL:
+        return "bad call";
+    case NVE_IMPOSSIBLE:
+        return "impossible situation";
+    case NVE_HIERARCHY:
+        return "bad heap hierarchy";
+    case NVE_CASCADE:
+        return "cascade";
+    case NVE_DESYNC:
+        return "desynchronization";
+    case NVE_CHUNKALLOC_DRY:
+        return "out of memory for chunks";
+    case NVE_STRUCTALLOC_DRY:
+        return "out of memory for structures";
+    case NVE_KERN_THREADID_XNU:
+        return "no thread id from the kernel";
+    }
+    return "unknown error";
+}
+
+void __nv_error (nve_t nv_err, ...)
+{
+    va_list _nv_args;
+    va_start (_nv_args, nv_err);
+
+    fprintf (stderr, "nova: %s", __nv_error_name (nv_err));
+    /* Parameters as documented on nve_t.
+     */
+    switch (nv_err) {
+    case NVE_BADCFG:
+        fprintf (stderr, " (parameter %d)", (int)va_arg (_nv_args, nvcfg_t));
+        /* fallthrough */
+    case NVE_BADVAL:
+    case NVE_BADCALL:
+    case NVE_IMPOSSIBLE:
+    case NVE_HIERARCHY:
+    case NVE_CASCADE:
+    case NVE_DESYNC: {
+        const char * _nv_efmt = va_arg (_nv_args, const char *);
+        fputs (": ", stderr);
+        vfprintf (stderr, _nv_efmt, _nv_args);
+        break;
+    }
+    case NVE_STRUCTALLOC_DRY:
+        fprintf (stderr, ": %s", va_arg (_nv_args, const char *));
+        break;
+    case NVE_KERN_THREADID_XNU:
+        fprintf (stderr, ": kernel error %d", va_arg (_nv_args, int));
+        break;
+    default:
+        break;
+    }
+    fputc ('\n', stderr);
+
+    va_end (_nv_args);
+
+    if (nv_err == NVE_IMPOSSIBLE) {
+        abort ();
+    }
+}
+
+void __nv_dbg_assert (int nv_assert_expr, const char * nv_efmt, ...)
+{
+    if (__builtin_expect (nv_assert_expr, 1)) {
+        return;
+    }
+
+    va_list _nv_args;
+    va_start (_nv_args, nv_efmt);
+    fputs ("nova: assertion failed: ", stderr);
+    vfprintf (stderr, nv_efmt, _nv_args);
+    fputc ('\n', stderr);
+    va_end (_nv_args);
+
+    abort ();
+}
+
+/*******************************************************************************
+ * DEBUG-MODE VALIDATION
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+#if NOVA_MODE_DEBUG
+
+/* Cheap sanity checks on what the deallocation paths are handed; these catch
+ * pointers that were never nova's, not races (nothing here takes a lock, and
+ * the counts are allowed to move under us).
+ */
+
+nova_res_t __nvd_validate_block (nova_block_t * nv_block)
+{
+    if (__builtin_expect (nv_block == NULL || ((uintptr_t)nv_block & (sizeof (nova_block_t) - 1)) != 0, 0)) {
+        __nv_error (NVE_BADVAL, "__nvd_validate_block(%p): not a block header", nv_block);
+        return nova_fail;
+    }
+    if (__builtin_expect (nv_block->nv_base == NULL || nv_block->nv_osz == 0 || nv_block->nv_ocnt == 0, 0)) {
+        __nv_error (NVE_BADVAL, "__nvd_validate_block(%p): block isn't formatted", nv_block);
+        return nova_fail;
+    }
+    return nova_ok;
+}
+
+nova_res_t __nvd_validate_range (void * nv_range_base,
+                                 nvi_t nv_range_size,
+                                 void * nv_obj)
+{
+    if (__builtin_expect ((uint8_t *)nv_obj < (uint8_t *)nv_range_base
+                              || (uint8_t *)nv_obj >= (uint8_t *)nv_range_base + nv_range_size,
+                          0)) {
+        __nv_error (NVE_BADVAL, "__nvd_validate_range(%p, %zu, %p): object out of range", nv_range_base, nv_range_size, nv_obj);
+        return nova_fail;
+    }
+    return nova_ok;
+}
+
+#endif /* NOVA_MODE_DEBUG */
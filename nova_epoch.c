@@ -0,0 +1,282 @@
+#include "nova.h"
+
+/* malloc, free */
+#include <stdlib.h>
+
+/*******************************************************************************
+ * CLIENT INTERFACE : DEFERRED DEALLOCATION
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Quiescent-state reclamation for lock-free structures: an object that has been
+ * unlinked may still be in use by readers that found it before that, so
+ * nova_free_deferred only notes it down, and it's actually freed once every
+ * participating thread has been through nova_quiesce (i.e. has let go of every
+ * reference it held) twice over.
+ *
+ * There's one global epoch. Each participating thread has a record, where
+ * nova_quiesce announces the epoch it has seen; the epoch moves on once every
+ * record announces the current one. Objects deferred in epoch e are then safe
+ * to free once the epoch reaches e + 2: everybody has quiesced since the epoch
+ * went to e + 1, which was after the objects were unlinked.
+ *
+ * Deferred objects go on the thread's limbo list, in batches of pointers
+ * (allocated once every NOVA_DEFER_BATCH objects, not once per object; the
+ * objects themselves can't be written to, since readers may still be looking at
+ * them). A batch only holds objects from one epoch, and is freed in one go with
+ * nova_free_bulk when its time comes.
+ *
+ * Records are never freed; a thread that exits marks its record idle, for the
+ * next new thread to take over, and leaves its limbo batches on a shared orphan
+ * list, which whoever quiesces next works through.
+ */
+
+#define NOVA_DEFER_BATCH 254
+/* nv_epoch of a record whose thread doesn't hold any references */
+#define NOVA_EPOCH_IDLE ((nvi_t)-1)
+
+typedef struct nova_dbatch
+{
+    struct nova_dbatch * nv_next;
+    /* epoch the objects were deferred in */
+    nvi_t nv_epoch;
+    nvi_t nv_n;
+    void * nv_objs[NOVA_DEFER_BATCH];
+} nova_dbatch_t;
+
+typedef struct nova_eprec
+{
+    /* __atomic */ nvi_t nv_epoch;
+    /* __atomic */ int nv_inuse;
+    /* set once, before the record is published */
+    struct nova_eprec * nv_next;
+    /* The rest belongs to the thread using the record. Limbo list, oldest batch
+     * first; the last one is the one being filled.
+     */
+    nova_dbatch_t * nv_lfirst;
+    nova_dbatch_t * nv_llast;
+    /* one drained batch kept around for the next one */
+    nova_dbatch_t * nv_spare;
+} nova_eprec_t;
+
+/* __atomic */ static nvi_t __nv_epoch = 0;
+/* __atomic; pushed onto, never popped */
+static nova_eprec_t * __nv_eprecs = NULL;
+
+static _Thread_local nova_eprec_t * __nv_eprec_local = NULL;
+
+static pthread_once_t __nv_epoch_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t __nv_epoch_key;
+
+/* Batches left behind by exited threads, in no particular order. */
+static nova_mutex_t __nv_orphans_lock = PTHREAD_MUTEX_INITIALIZER;
+/* __atomic */ static nova_dbatch_t * __nv_orphans = NULL;
+
+static void __nv_epoch_thread_exit (void * nv_rec)
+{
+    nova_eprec_t * _nv_rec = nv_rec;
+
+    /* The thread doesn't hold anything anymore, so it stops holding up the
+     * epoch; its batches still have to wait their turn, on the orphan list.
+     */
+    __atomic_store_n (&_nv_rec->nv_epoch, NOVA_EPOCH_IDLE, __ATOMIC_SEQ_CST);
+    if (_nv_rec->nv_lfirst != NULL) {
+        nvmutex_lock (&__nv_orphans_lock);
+        _nv_rec->nv_llast->nv_next = __nv_orphans;
+        __atomic_store_n (&__nv_orphans, _nv_rec->nv_lfirst, __ATOMIC_RELEASE);
+        nvmutex_unlock (&__nv_orphans_lock);
+    }
+    free (_nv_rec->nv_spare);
+    _nv_rec->nv_lfirst = _nv_rec->nv_llast = _nv_rec->nv_spare = NULL;
+
+    __nv_eprec_local = NULL;
+    __atomic_store_n (&_nv_rec->nv_inuse, 0, __ATOMIC_RELEASE);
+}
+
+static void __nv_epoch_key_init (void)
+{
+    pthread_key_create (&__nv_epoch_key, __nv_epoch_thread_exit);
+}
+
+/* Give the calling thread a record, taking over an idle one if there is one.
+ * The record stays idle unless `nv_announce`: a thread that only defers objects
+ * doesn't hold any references, and mustn't hold the epoch up.
+ */
+static nova_eprec_t * __nv_epoch_register (int nv_announce)
+{
+    if (__builtin_expect (0 != pthread_once (&__nv_epoch_key_once, __nv_epoch_key_init), 0)) {
+        return NULL;
+    }
+
+    nova_eprec_t * _nv_rec = NULL;
+    for (nova_eprec_t * _nvc = __atomic_load_n (&__nv_eprecs, __ATOMIC_ACQUIRE); _nvc != NULL; _nvc = _nvc->nv_next) {
+        int _nv_free = 0;
+        if (__atomic_load_n (&_nvc->nv_inuse, __ATOMIC_RELAXED) == 0
+            && __atomic_compare_exchange_n (&_nvc->nv_inuse, &_nv_free, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            _nv_rec = _nvc;
+            break;
+        }
+    }
+    if (_nv_rec == NULL) {
+        _nv_rec = malloc (sizeof (nova_eprec_t));
+        if (__builtin_expect (_nv_rec == NULL, 0)) {
+            return NULL;
+        }
+        _nv_rec->nv_epoch  = NOVA_EPOCH_IDLE;
+        _nv_rec->nv_inuse  = 1;
+        _nv_rec->nv_lfirst = _nv_rec->nv_llast = _nv_rec->nv_spare = NULL;
+        _nv_rec->nv_next   = __atomic_load_n (&__nv_eprecs, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n (&__nv_eprecs, &_nv_rec->nv_next, _nv_rec, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+
+    if (__builtin_expect (0 != pthread_setspecific (__nv_epoch_key, _nv_rec), 0)) {
+        __atomic_store_n (&_nv_rec->nv_inuse, 0, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    /* Announcing an epoch that's already behind only holds the next advance up
+     * until we quiesce.
+     */
+    if (nv_announce) {
+        __atomic_store_n (&_nv_rec->nv_epoch, __atomic_load_n (&__nv_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    }
+    __nv_eprec_local = _nv_rec;
+
+    return _nv_rec;
+}
+
+/* Free a batch's objects, then keep the batch as the spare (or let it go).
+ */
+static void __nv_dbatch_drain (nova_eprec_t * nv_rec, nova_dbatch_t * nv_batch)
+{
+    nova_free_bulk (nv_batch->nv_objs, nv_batch->nv_n);
+    if (nv_rec != NULL && nv_rec->nv_spare == NULL) {
+        nv_rec->nv_spare = nv_batch;
+    } else {
+        free (nv_batch);
+    }
+}
+
+/* Drain the orphans deferred before epoch `nv_safe`, if nobody else is on it.
+ */
+static void __nv_epoch_adopt_orphans (nova_eprec_t * nv_rec, nvi_t nv_safe)
+{
+    if (__atomic_load_n (&__nv_orphans, __ATOMIC_ACQUIRE) == NULL
+        || nova_ok != nvmutex_trylock (&__nv_orphans_lock)) {
+        return;
+    }
+    nova_dbatch_t *_nv_ripe = NULL, **_nv_link = &__nv_orphans;
+    while (*_nv_link != NULL) {
+        nova_dbatch_t * _nvc = *_nv_link;
+        if (_nvc->nv_epoch < nv_safe) {
+            *_nv_link     = _nvc->nv_next;
+            _nvc->nv_next = _nv_ripe;
+            _nv_ripe      = _nvc;
+        } else {
+            _nv_link = &_nvc->nv_next;
+        }
+    }
+    nvmutex_unlock (&__nv_orphans_lock);
+
+    while (_nv_ripe != NULL) {
+        nova_dbatch_t * _nv_next = _nv_ripe->nv_next;
+        __nv_dbatch_drain (nv_rec, _nv_ripe);
+        _nv_ripe = _nv_next;
+    }
+}
+
+nova_res_t nova_free_deferred (void * nv_obj)
+{
+    if (__builtin_expect (nv_obj == NULL, 0)) {
+        return nova_ok;
+    }
+
+    nova_eprec_t * _nv_rec = __nv_eprec_local;
+    if (__builtin_expect (_nv_rec == NULL, 0)) {
+        _nv_rec = __nv_epoch_register (0);
+        if (__builtin_expect (_nv_rec == NULL, 0)) {
+            return nova_fail;
+        }
+    }
+
+    /* The object was unlinked before we got here, so it's enough to go by
+     * whatever the epoch is now.
+     */
+    const nvi_t _nv_e      = __atomic_load_n (&__nv_epoch, __ATOMIC_SEQ_CST);
+    nova_dbatch_t * _nv_db = _nv_rec->nv_llast;
+    if (__builtin_expect (_nv_db == NULL || _nv_db->nv_epoch != _nv_e || _nv_db->nv_n == NOVA_DEFER_BATCH, 0)) {
+        _nv_db = _nv_rec->nv_spare;
+        if (_nv_db != NULL) {
+            _nv_rec->nv_spare = NULL;
+        } else {
+            _nv_db = malloc (sizeof (nova_dbatch_t));
+            if (__builtin_expect (_nv_db == NULL, 0)) {
+                return nova_fail;
+            }
+        }
+        _nv_db->nv_next  = NULL;
+        _nv_db->nv_epoch = _nv_e;
+        _nv_db->nv_n     = 0;
+        if (_nv_rec->nv_llast != NULL) {
+            _nv_rec->nv_llast->nv_next = _nv_db;
+        } else {
+            _nv_rec->nv_lfirst = _nv_db;
+        }
+        _nv_rec->nv_llast = _nv_db;
+    }
+    _nv_db->nv_objs[_nv_db->nv_n++] = nv_obj;
+
+    return nova_ok;
+}
+
+nvi_t nova_quiesce (void)
+{
+    nova_eprec_t * _nv_rec = __nv_eprec_local;
+    if (__builtin_expect (_nv_rec == NULL, 0)) {
+        /* First time: from here on, the thread holds things up until it
+         * quiesces.
+         */
+        __nv_epoch_register (1);
+        return 0;
+    }
+
+    nvi_t _nv_e = __atomic_load_n (&__nv_epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&_nv_rec->nv_epoch, _nv_e, __ATOMIC_SEQ_CST);
+
+    /* Everybody (who holds anything) has seen _nv_e: move on. Records can only
+     * be behind, never ahead; if somebody beat us to it, so much the better.
+     */
+    int _nv_all = 1;
+    for (nova_eprec_t * _nvc = __atomic_load_n (&__nv_eprecs, __ATOMIC_ACQUIRE); _nvc != NULL; _nvc = _nvc->nv_next) {
+        const nvi_t _nv_ce = __atomic_load_n (&_nvc->nv_epoch, __ATOMIC_SEQ_CST);
+        if (_nv_ce != NOVA_EPOCH_IDLE && _nv_ce != _nv_e) {
+            _nv_all = 0;
+            break;
+        }
+    }
+    if (_nv_all) {
+        __atomic_compare_exchange_n (&__nv_epoch, &_nv_e, _nv_e + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+
+    /* Anything deferred two epochs ago (or before) is out of everybody's hands.
+     */
+    const nvi_t _nv_now = __atomic_load_n (&__nv_epoch, __ATOMIC_SEQ_CST);
+    if (_nv_now < 2) {
+        return 0;
+    }
+    const nvi_t _nv_safe = _nv_now - 1;
+    nvi_t _nv_freed      = 0;
+    while (_nv_rec->nv_lfirst != NULL && _nv_rec->nv_lfirst->nv_epoch < _nv_safe) {
+        nova_dbatch_t * _nv_db = _nv_rec->nv_lfirst;
+        _nv_rec->nv_lfirst     = _nv_db->nv_next;
+        if (_nv_rec->nv_lfirst == NULL) {
+            _nv_rec->nv_llast = NULL;
+        }
+        _nv_freed += _nv_db->nv_n;
+        __nv_dbatch_drain (_nv_rec, _nv_db);
+    }
+    __nv_epoch_adopt_orphans (_nv_rec, _nv_safe);
+
+    return _nv_freed;
+}
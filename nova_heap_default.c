@@ -0,0 +1,127 @@
+#include "nova.h"
+
+/* free */
+#include <stdlib.h>
+
+/*******************************************************************************
+ * HEAP HANDLING : DEFAULT HEAPS
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Every thread gets a local heap of its own the first time it asks for one (see
+ * nova_default_heap), under whatever regional heap is the default parent at the
+ * time. The heap sits in a thread-local, so finding it is a single TLS load, and
+ * in a pthread key, whose destructor drops it when the thread exits.
+ *
+ * The heap is dropped on the exiting thread itself rather than through
+ * nova_heap_drop_async: with NOVA_TID_RECYCLING, the thread's id goes back up for
+ * grabs right after, and the heap's blocks have to have let go of it by then.
+ */
+
+__thread nova_heap_t * __nv_dheap_local = NULL;
+/* Whether the thread id was set up for the default heap (and so gets dropped
+ * along with it).
+ */
+static _Thread_local int __nv_dheap_owns_tid = 0;
+
+static pthread_once_t __nv_dheap_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t __nv_dheap_key;
+
+/* Guards the default parent, and the reference we hold on it. */
+static nova_mutex_t __nv_dheap_parent_lock = PTHREAD_MUTEX_INITIALIZER;
+static nova_heap_t * __nv_dheap_parent     = NULL;
+
+static void __nv_dheap_thread_exit (void * nv_heap)
+{
+    /* Another key's destructor may still allocate after this; it just gets a
+     * fresh heap (and the key gets another round of destructors).
+     */
+    __nv_dheap_local = NULL;
+    __nv_local_heap_drop ((nova_heap_t *)nv_heap);
+
+    if (__nv_dheap_owns_tid) {
+        __nv_dheap_owns_tid = 0;
+        __nv_tid_thread_drop ();
+    }
+}
+
+static void __nv_dheap_key_init (void)
+{
+    pthread_key_create (&__nv_dheap_key, __nv_dheap_thread_exit);
+}
+
+nova_res_t nova_set_default_parent (nova_heap_t * nv_parent)
+{
+    if (nv_parent != NULL) {
+        __nv_regional_heap_incref (nv_parent);
+    }
+
+    nvmutex_lock (&__nv_dheap_parent_lock);
+    nova_heap_t * _nv_old = __nv_dheap_parent;
+    __nv_dheap_parent     = nv_parent;
+    nvmutex_unlock (&__nv_dheap_parent_lock);
+
+    /* Heaps already made under the old parent hold references of their own.
+     */
+    if (_nv_old != NULL) {
+        __nv_regional_heap_decref (_nv_old);
+    }
+
+    return nova_ok;
+}
+
+nova_heap_t * __nv_default_heap_create ()
+{
+    if (__builtin_expect (0 != pthread_once (&__nv_dheap_key_once, __nv_dheap_key_init), 0)) {
+        return NULL;
+    }
+
+    /* Blocks are handed out by thread id, so the thread needs one before it
+     * allocates anything.
+     */
+    if (__nv_tid () == 0) {
+        if (__builtin_expect (nova_ok != __nv_tid_thread_init (), 0)) {
+            return NULL;
+        }
+        __nv_dheap_owns_tid = 1;
+    }
+
+    nova_heap_t * _nv_heap;
+    if (__builtin_expect (nova_ok != nv_heap_create (&_nv_heap), 0)) {
+        return NULL;
+    }
+
+    nvmutex_lock (&__nv_dheap_parent_lock);
+    nova_heap_t * _nv_parent = __nv_dheap_parent;
+    if (_nv_parent != NULL) {
+        __nv_regional_heap_incref (_nv_parent);
+    }
+    nvmutex_unlock (&__nv_dheap_parent_lock);
+
+    if (__builtin_expect (_nv_parent == NULL, 0)) {
+#if NOVA_MODE_DEBUG
+        __nv_error (NVE_HIERARCHY, "__nv_default_heap_create(): no default parent heap (see nova_set_default_parent).");
+#endif
+        free (_nv_heap);
+        return NULL;
+    }
+    nv_heap_bind_parent (_nv_heap, _nv_parent);
+
+    if (__builtin_expect (0 != pthread_setspecific (__nv_dheap_key, _nv_heap), 0)) {
+        __nv_local_heap_drop (_nv_heap);
+        return NULL;
+    }
+    __nv_dheap_local = _nv_heap;
+
+    return _nv_heap;
+}
+
+void * nova_malloc (nvi_t nv_size)
+{
+    nova_heap_t * _nv_heap = nova_default_heap ();
+    if (__builtin_expect (_nv_heap == NULL, 0)) {
+        return NULL;
+    }
+    return nova_alloc (_nv_heap, nv_size);
+}
@@ -12,8 +12,7 @@ NOVA_DOCSTUB ();
 nova_res_t nv_heap_create (nova_heap_t ** nv_heap)
 {
     nvi_t _num_lkgs = nova_read_cfg (NV_SMOBJ_POOLCOUNT);
-    (*nv_heap)      = malloc (sizeof (nova_heap_t *)
-                         + sizeof (nvi_t)
+    (*nv_heap)      = malloc (sizeof (nova_heap_t)
                          + (sizeof (nova_lkg_t)
                             * _num_lkgs));
     if ((*nv_heap) == NULL) {
@@ -29,13 +28,34 @@ nova_res_t nv_heap_init (nova_heap_t * nv_heap, nvi_t nv_ln)
         nv_lkg_init (&nv_heap->nv_lkgs[i]);
         nv_heap->nv_lkgs[i].nv_heap = nv_heap;
     }
-    nv_heap_bind_parent (nv_heap, NULL);
+    /* Not through nv_heap_bind_parent: there's no old parent to leave.
+     */
+    nv_heap->nv_parent_heap = NULL;
+    nv_heap->nv_sibnx       = NULL;
+    nv_heap->nv_dropnx      = NULL;
     return nova_ok;
 }
 
 nova_res_t nv_heap_bind_parent (nova_heap_t * nv_child, nova_heap_t * nv_parent)
 {
+    /* Parents are always regional (or root) heaps, and keep track of their
+     * children so that siblings can find each other.
+     */
+    if (nv_child->nv_parent_heap != NULL) {
+        __nv_regional_heap_abandon (nv_child->nv_parent_heap, nv_child);
+    }
     nv_child->nv_parent_heap = nv_parent;
+    if (nv_parent != NULL) {
+        /* NV_SMOBJ_POOLCOUNT can go up after the parent was made; a child with
+         * more linkages than its parent would ask it for (and hand it) blocks
+         * of classes it has no linkage for. The linkages past the parent's are
+         * still empty here, so they can just go.
+         */
+        while (nv_child->nv_ln > nv_parent->nv_ln) {
+            nvmutex_drop (&nv_child->nv_lkgs[--nv_child->nv_ln].nv_ll);
+        }
+        __nv_regional_heap_adopt (nv_parent, nv_child);
+    }
 
     return nova_ok;
 }
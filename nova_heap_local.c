@@ -34,15 +34,17 @@ nova_res_t __nv_local_heap_alloc (nova_heap_t * nv_heap, void ** nv_obj, nova_sm
 
 nova_res_t __nv_local_heap_drop (nova_heap_t * nv_heap)
 {
-    /* First, drop the linkages.
+    /* Get out of the sibling list first, so that nobody steals from linkages
+     * that are being torn down.
+     */
+    __nv_regional_heap_abandon (nv_heap->nv_parent_heap, nv_heap);
+
+    /* Then, drop the linkages. Each one hands its blocks to the parent in one
+     * splice, so there's no need to hold any of the parent's locks out here.
      */
-    nvmutex_lock (&nv_heap->nv_parent_heap->nv_lkgs[0].nv_ll);
     for (nvi_t _nv_li = 0; _nv_li < nv_heap->nv_ln; _nv_li++) {
-        nvmutex_lock (&nv_heap->nv_parent_heap->nv_lkgs[_nv_li].nv_ll);
         __nv_local_lkg_drop (&nv_heap->nv_lkgs[_nv_li]);
-        nvmutex_unlock (&nv_heap->nv_parent_heap->nv_lkgs[_nv_li].nv_ll);
     }
-    nvmutex_unlock (&nv_heap->nv_parent_heap->nv_lkgs[0].nv_ll);
 
     /* Notify the parent heap of destruction; we know it's a regional, so we just
      * pass it a decref message.
@@ -55,14 +57,78 @@ nova_res_t __nv_local_heap_drop (nova_heap_t * nv_heap)
     return nova_ok;
 }
 
-nova_res_t __nv_local_heap_pass_evac_nl_sl (nova_heap_t * nv_heap,
-                                            nova_block_t * nv_ev_block)
+nvi_t __nv_local_heap_trim (nova_heap_t * nv_heap, nvi_t nv_policy)
+{
+    nova_heap_t * _nv_parent = nv_heap->nv_parent_heap;
+    nvi_t _nv_given          = 0;
+
+    if (__builtin_expect (_nv_parent == NULL, 0)) {
+#if NOVA_MODE_DEBUG
+        __nv_error (NVE_HIERARCHY, "__nv_local_heap_trim(%p): orphaned local heap.", nv_heap);
+#endif
+        return 0;
+    }
+
+    /* Parked blocks: empty, so they go up as one chain; no locks involved.
+     */
+    if (nv_policy & NOVA_TRIM_EMPTY) {
+        _nv_given += __nv_ulkg_pass (&nv_heap->nv_lkgs[0], &_nv_parent->nv_lkgs[0]);
+    }
+
+    /* Sparse blocks: one size class at a time, the same way the linkages are
+     * dropped, so refills from the regional heap are only ever held up for the
+     * length of a splice.
+     *
+     * Fully empty blocks never sit in the bins for long (the deallocation that
+     * empties one sends it upstream), so NOVA_TRIM_EMPTY doesn't need to look
+     * there.
+     */
+    if (nv_policy & NOVA_TRIM_SPARSE) {
+        for (nvi_t _nv_li = 1; _nv_li < nv_heap->nv_ln && _nv_li < _nv_parent->nv_ln; _nv_li++) {
+            nova_lkg_t * _nv_lkg = &nv_heap->nv_lkgs[_nv_li];
+            /* Racy peek; at worst we miss a block that a foreign deallocation
+             * is moving into the bin right now, and the next trim gets it.
+             */
+            if (__atomic_load_n (&_nv_lkg->nv_bins[NOVA_LKG_BIN_LO], __ATOMIC_RELAXED) == NULL) {
+                continue;
+            }
+            _nv_given += __nv_local_lkg_trim (_nv_lkg);
+        }
+    }
+
+    return _nv_given;
+}
+
+nvi_t __nv_local_heap_reset (nova_heap_t * nv_heap)
+{
+    nvi_t _nv_n = 0;
+
+    /* Parked blocks are already as reset as they're going to get.
+     */
+    for (nvi_t _nv_li = 1; _nv_li < nv_heap->nv_ln; _nv_li++) {
+        _nv_n += __nv_local_lkg_reset (&nv_heap->nv_lkgs[_nv_li]);
+    }
+
+    return _nv_n;
+}
+
+nvi_t __nv_local_heap_transfer (nova_heap_t * nv_heap, nova_tid_t nv_owner)
 {
-    return __nv_regional_heap_take_evac_block_nl_sl (nv_heap->nv_parent_heap, nv_ev_block);
+    nvi_t _nv_n = 0;
+
+    /* Parked blocks are empty, and get their owner when they're taken off the
+     * unsized linkage; nothing to do there.
+     */
+    for (nvi_t _nv_li = 1; _nv_li < nv_heap->nv_ln; _nv_li++) {
+        _nv_n += __nv_local_lkg_transfer (&nv_heap->nv_lkgs[_nv_li], nv_owner);
+    }
+
+    return _nv_n;
 }
 
 nova_res_t __nv_local_heap_req_block (nova_heap_t * nv_heap,
                                       nova_smobjsz_t nv_osz,
+                                      nvi_t nv_n,
                                       nova_block_t ** nv_block)
 {
     /* NOTE: we leave it up to the call site to have canonicalized the osz
@@ -77,8 +143,8 @@ nova_res_t __nv_local_heap_req_block (nova_heap_t * nv_heap,
      * references to it. Which is, y'know, kinda not cool for an allocator to do.
      */
 
-    if (nova_ok == nv_lkg_req_block (&nv_heap->nv_lkgs[0], nv_block)) {
-        /* It's unsized, so we format it here.
+    if (0 < nv_lkg_req_blocks (&nv_heap->nv_lkgs[0], 1, nv_block)) {
+        /* It's unsized (parked by an earlier batch refill), so we format it here.
          */
         __nv_block_fmt (*nv_block, nv_osz);
 
@@ -91,14 +157,7 @@ nova_res_t __nv_local_heap_req_block (nova_heap_t * nv_heap,
      * Instead, we go directly to the regional heap (if we have one, which we
      * really should).
      */
-    if (__builtin_expect (nv_heap->nv_parent_heap != NULL, 1)) {
-        /* The regional is a bicameral heap just like this one, so it has
-         * jurisdiction on block formatting.
-         */
-        return __nv_regional_heap_req_block (nv_heap->nv_parent_heap,
-                                             nv_osz,
-                                             nv_block);
-    } else {
+    if (__builtin_expect (nv_heap->nv_parent_heap == NULL, 0)) {
 #if NOVA_MODE_DEBUG
         /* In release, this should fail quietly, but we _do_ want to make sure
          * that it fails loudly in debug mode.
@@ -107,4 +166,28 @@ nova_res_t __nv_local_heap_req_block (nova_heap_t * nv_heap,
 #endif
         return nova_fail;
     }
+
+    /* The regional is a bicameral heap just like this one, so it has
+     * jurisdiction on block formatting.
+     */
+    if (nova_ok != __nv_regional_heap_req_block (nv_heap->nv_parent_heap, nv_osz, nv_n, nv_block)) {
+        return nova_fail;
+    }
+
+    /* Park whatever came along with the block on our unsized linkage, so that
+     * the next few refills (for any size class) don't have to go upstream.
+     */
+    nova_block_t * _nv_extra = (*nv_block)->nv_lkgnx;
+    (*nv_block)->nv_lkgnx    = NULL;
+    if (_nv_extra != NULL) {
+        const nova_tid_t _nv_tid = __nv_tid ();
+        nova_block_t * _nv_last  = _nv_extra;
+        for (nova_block_t * _nvc = _nv_extra; _nvc != NULL; _nvc = _nvc->nv_lkgnx) {
+            _nvc->nv_owner = _nv_tid;
+            _nv_last       = _nvc;
+        }
+        __nv_ulkg_push (&nv_heap->nv_lkgs[0], _nv_extra, _nv_last);
+    }
+
+    return nova_ok;
 }
@@ -13,27 +13,34 @@ nova_res_t __nv_regional_heap_create (nova_heap_t ** nv_heap)
     nvi_t _num_lkgs = nova_read_cfg (NV_SMOBJ_POOLCOUNT);
     /* We do a little bit of magic here; we want the heap's normal members to
      * be accessible at their normal places, and we want fast access to the
-     * reference count member. The only logical place we can put the refcount,
-     * because the heap is a DST, is at a negative offset, then. */
-    (*nv_heap) = malloc (
-        /* Refcount at heap - 1 */
-        sizeof (uint64_t)
+     * reference count member and the span allocator. The only logical place we
+     * can put those, because the heap is a DST, is at a negative offset, then;
+     * see nova_rheap_pfx_t. */
+    nova_rheap_pfx_t * _nv_pfx = malloc (
+        /* Prefix at heap - 1 */
+        sizeof (nova_rheap_pfx_t)
         /* nova_heap_t */
-        + sizeof (nova_heap_t *)
-        + sizeof (nvi_t)
+        + sizeof (nova_heap_t)
         + (sizeof (nova_lkg_t)
            * _num_lkgs));
 
     /* Check the malloc result.
      */
-    if ((*nv_heap) == NULL) {
+    if (_nv_pfx == NULL) {
         return nova_fail;
     }
 
-    /* Set up refcount and skip the pointer to the heap.
+    /* Set up refcount and span allocator, and skip the pointer to the heap.
+     * Regional heaps don't keep a chunk list, but we zero it anyways so that a
+     * stray read doesn't go anywhere interesting.
      */
-    *((uint64_t *)*nv_heap) = 0;
-    (*nv_heap)              = (void *)&((uint64_t *)*nv_heap)[1];
+    _nv_pfx->nv_refcnt = 0;
+    _nv_pfx->nv_chunks   = NULL;
+    _nv_pfx->nv_children = NULL;
+    nvmutex_init (&_nv_pfx->nv_sibl);
+    nvmutex_init (&_nv_pfx->nv_chunkl);
+    __nv_spa_init (&_nv_pfx->nv_spa);
+    (*nv_heap) = (nova_heap_t *)&_nv_pfx[1];
 
     /* Finish up with normal heap initialization.
      */
@@ -42,48 +49,22 @@ nova_res_t __nv_regional_heap_create (nova_heap_t ** nv_heap)
 
 nova_res_t __nv_root_heap_create (nova_heap_t ** nv_heap)
 {
-    nvi_t _num_lkgs = nova_read_cfg (NV_SMOBJ_POOLCOUNT);
-    /* We do a little bit of magic here; we want the heap's normal members to
-     * be accessible at their normal places, and we want fast access to the
-     * reference count member. The only logical place we can put the refcount,
-     * because the heap is a DST, is at a negative offset, then.
-     * We also need to put in a root chunk list pointer, and we do that here.
-     */
-    (*nv_heap) = malloc (
-        /* Chunk pointer at heap - 2 */
-        sizeof (nova_chunk_t *)
-        /* Refcount at heap - 1 */
-        + sizeof (uint64_t)
-        /* nova_heap_t */
-        + sizeof (nova_heap_t *)
-        + sizeof (nvi_t)
-        + (sizeof (nova_lkg_t)
-           * _num_lkgs));
-    /* Check the malloc result.
+    /* Same layout as any other regional heap; the only difference is that the
+     * root actually uses the chunk list in its prefix.
      */
-    if ((*nv_heap) == NULL) {
+    if (nova_ok != __nv_regional_heap_create (nv_heap)) {
         return nova_fail;
     }
-
-    /* Set up the chunk list root pointer, 'cuz we're the root heap.
-     */
-    *((nova_chunk_t **)nv_heap) = NULL;
-    /* Set up the reference count variable, and skip the heap pointer past all
-     * this nasty business;
-     * IMPORTANT: assumes 64-bit pointers.
-     */
-    ((uint64_t *)*nv_heap)[1] = 0;
-    (*nv_heap)                = (void *)&((uint64_t *)*nv_heap)[2];
-    /* Perform the normal heap initialization.
-     */
-    return nv_heap_init (*nv_heap, _num_lkgs);
+    NOVA_RHEAP_PFX (*nv_heap)->nv_chunks = NULL;
+    (*nv_heap)->nv_lkgs[0].nv_uroot      = 1;
+    return nova_ok;
 }
 
 nova_res_t __nv_regional_heap_incref (nova_heap_t * nv_heap)
 {
     /* Nice and simple; use fetch_add so as not to create a temporary.
      */
-    __atomic_add_fetch (&((uint64_t *)nv_heap)[-1], 1, __ATOMIC_ACQ_REL);
+    __atomic_add_fetch (&NOVA_RHEAP_PFX (nv_heap)->nv_refcnt, 1, __ATOMIC_ACQ_REL);
 
     return nova_ok;
 }
@@ -100,7 +81,7 @@ nova_res_t __nv_regional_heap_decref (nova_heap_t * nv_heap)
      * Note the sub_fetch instead of fetch_sub; sub_fetch returns the post-op
      * value, fetch_sub returns the pre-op value.
      */
-    if (0 == __atomic_sub_fetch (&((uint64_t *)nv_heap)[-1], 1, __ATOMIC_ACQ_REL)) {
+    if (0 == __atomic_sub_fetch (&NOVA_RHEAP_PFX (nv_heap)->nv_refcnt, 1, __ATOMIC_ACQ_REL)) {
         /* Check if it's the root heap
          */
         if (nv_heap->nv_parent_heap != NULL) {
@@ -117,16 +98,56 @@ nova_res_t __nv_regional_heap_decref (nova_heap_t * nv_heap)
     return nova_ok;
 }
 
+nova_res_t __nv_regional_heap_adopt (nova_heap_t * nv_heap, nova_heap_t * nv_child)
+{
+    nova_rheap_pfx_t * _nv_pfx = NOVA_RHEAP_PFX (nv_heap);
+
+    nvmutex_lock (&_nv_pfx->nv_sibl);
+    nv_child->nv_sibnx   = _nv_pfx->nv_children;
+    _nv_pfx->nv_children = nv_child;
+    nvmutex_unlock (&_nv_pfx->nv_sibl);
+
+    return nova_ok;
+}
+
+nova_res_t __nv_regional_heap_abandon (nova_heap_t * nv_heap, nova_heap_t * nv_child)
+{
+    nova_rheap_pfx_t * _nv_pfx = NOVA_RHEAP_PFX (nv_heap);
+
+    /* Anyone walking the list (i.e. stealing) does so under nv_sibl, so once
+     * we're through here, nobody is going to come looking at nv_child's
+     * linkages through its parent anymore.
+     */
+    nvmutex_lock (&_nv_pfx->nv_sibl);
+    for (nova_heap_t ** _nv_link = &_nv_pfx->nv_children; *_nv_link != NULL; _nv_link = &(*_nv_link)->nv_sibnx) {
+        if (*_nv_link == nv_child) {
+            *_nv_link = nv_child->nv_sibnx;
+            break;
+        }
+    }
+    nv_child->nv_sibnx = NULL;
+    nvmutex_unlock (&_nv_pfx->nv_sibl);
+
+    return nova_ok;
+}
+
 nova_res_t __nv_regional_heap_drop (nova_heap_t * nv_heap)
 {
     if (nv_heap->nv_parent_heap != NULL) {
-        nvmutex_lock (&nv_heap->nv_parent_heap->nv_lkgs[0].nv_ll);
+        __nv_regional_heap_abandon (nv_heap->nv_parent_heap, nv_heap);
+
+        /* Same as local heaps: every linkage goes up to the parent's in one
+         * splice, without holding the parent's locks in the meantime.
+         */
         for (nvi_t _nv_li = 0; _nv_li < nv_heap->nv_ln; _nv_li++) {
-            nvmutex_lock (&nv_heap->nv_parent_heap->nv_lkgs[_nv_li].nv_ll);
             __nv_regional_lkg_drop (&nv_heap->nv_lkgs[_nv_li]);
-            nvmutex_unlock (&nv_heap->nv_parent_heap->nv_lkgs[_nv_li].nv_ll);
         }
-        nvmutex_unlock (&nv_heap->nv_parent_heap->nv_lkgs[0].nv_ll);
+
+        /* Span chunks go up to the parent as well: there may still be live spans
+         * in them, and even if there aren't, the chunks are on the root's list
+         * and can't just be freed here.
+         */
+        __nv_spa_pass (&NOVA_RHEAP_PFX (nv_heap)->nv_spa, nv_heap->nv_parent_heap);
 
         /* Notify the parent heap of the drop (before nv_heap is free'd).
          */
@@ -140,104 +161,94 @@ nova_res_t __nv_regional_heap_drop (nova_heap_t * nv_heap)
          *
          * The problem is that we need a reference to the first chunk, and it's
          * not like that's super easy to find--that, however, is why we have a
-         * separate creation function for root heaps: we can include an extra
-         * pointer at offset -2.
+         * separate creation function for root heaps: the chunk list lives in
+         * the prefix. Span chunks are on that list too, so this takes care of
+         * the span allocator as well.
          */
-        nv_chunk_destroy_chained (&((nova_chunk_t *)nv_heap)[-2],
+        nv_chunk_destroy_chained (NOVA_RHEAP_PFX (nv_heap)->nv_chunks,
                                   /* nv_number = */ 0);
     }
 
     /* Short circuit nv_heap_destroy; atm, all it does is `free()` on the heap.
+     * Root and ordinary regional heaps have the same prefix.
      */
-    if (nv_heap->nv_parent_heap != NULL) {
-        free ((nova_heap_t *)&((uint64_t *)nv_heap)[-1]);
-    } else {
-        /* Root heap needs to be deallocated from oofset -2 because of the chunk ptr. */
-        free ((nova_heap_t *)&((uint64_t *)nv_heap)[-2]);
-    }
+    nvmutex_drop (&NOVA_RHEAP_PFX (nv_heap)->nv_sibl);
+    nvmutex_drop (&NOVA_RHEAP_PFX (nv_heap)->nv_chunkl);
+    free (NOVA_RHEAP_PFX (nv_heap));
     return nova_ok;
 }
 
-nova_res_t __nv_regional_heap_take_evac_block_nl_sl (nova_heap_t * nv_heap,
-                                                     nova_block_t * nv_ev_block)
-{
-    /* The ULKG LL and appropriate SLKG LL are already locked for this heap.
-     * Theoretically,
-     */
-
-    /* If it's empty, then we can go ahead and pass it to the unsized linkage.
-     */
-    if (0 == __atomic_load_n (&nv_ev_block->nv_acnt, __ATOMIC_ACQUIRE)) {
-        /* Unsized linkage is always going to be linkage 0.
-         */
-        if (nova_ok
-            == __nv_regional_lkg_receive_block_nl_sl (
-                &nv_heap->nv_lkgs[0],
-                nv_ev_block)) {
-            return nova_ok;
-        }
-    } else {
-        /* If it's sized, then we just pass it on.
-         * There's porbably a way to funnel the LI up from the dying heap, but
-         * that'd extra complexity n' stuff.
-         */
-        if (nova_ok
-            == __nv_regional_lkg_receive_block_nl_sl (
-                &nv_heap->nv_lkgs[__nv_lindex (nv_ev_block->nv_osz)],
-                nv_ev_block)) {
-            return nova_ok;
-        }
-    }
-
-    __nv_error (
-        NVE_IMPOSSIBLE,
-        "__nv_regional_heap_take_evac_block_nl_sl(%p, %p):"
-        " heap's linkages refused to receive block.");
-
-    return nova_fail;
-}
-
 nova_res_t __nv_regional_heap_req_block (nova_heap_t * nv_heap,
                                          nova_smobjsz_t nv_osz,
+                                         nvi_t nv_n,
                                          nova_block_t ** nv_block)
 {
-    if (nova_ok == nv_lkg_req_block (&nv_heap->nv_lkgs[0], nv_block)) {
+    /* Empty blocks come out in batches; only the first one is formatted, the
+     * rest are for the requester to park.
+     */
+    if (0 < nv_lkg_req_blocks (&nv_heap->nv_lkgs[0], nv_n, nv_block)) {
         __nv_block_fmt (*nv_block, nv_osz);
         return nova_ok;
     }
 
-    if (nova_ok == nv_lkg_req_block (&nv_heap->nv_lkgs[__nv_lindex (nv_osz)], nv_block)) {
+    /* Children never have more linkages than we do (see nv_heap_bind_parent);
+     * a class past ours just doesn't get looked for here.
+     */
+    const nvi_t _nv_li = __nv_lindex (nv_osz);
+    if (_nv_li < nv_heap->nv_ln && nova_ok == nv_lkg_req_block (&nv_heap->nv_lkgs[_nv_li], nv_block)) {
         return nova_ok;
     }
 
     if (nv_heap->nv_parent_heap != NULL) {
         return __nv_regional_heap_req_block (nv_heap->nv_parent_heap,
                                              nv_osz,
+                                             nv_n,
                                              nv_block);
-    } else {
-        /* Root heap.
-         */
+    }
 
-        {
-            nova_chunk_t * _nv_chunk;
-            if (__builtin_expect (nova_ok != nv_chunk_create (&_nv_chunk), 0)) {
-                __nv_error (NVE_CASCADE,
-                            "__nv_regional_heap_req_block(%p, %us, %p):"
-                            " cascading error imminent: chunk allocation failed from"
-                            " root heap");
-                return nova_fail;
-            }
-            __nv_chunk_release_blocks_to (_nv_chunk, nv_heap, 0, 63);
-            /* Take care of the chunk list.
-             */
-            nv_chunk_bind_to_root (_nv_chunk, nv_heap);
-        }
+    /* Root heap, with nothing sized either: new chunk.
+     */
+    if (nova_ok != __nv_regional_heap_req_empty (nv_heap, nv_n, nv_block)) {
+        return nova_fail;
+    }
+    __nv_block_fmt (*nv_block, nv_osz);
+    return nova_ok;
+}
 
-        if (nova_ok == nv_lkg_req_block (&nv_heap->nv_lkgs[0], nv_block)) {
-            __nv_block_fmt (*nv_block, nv_osz);
-            return nova_ok;
-        } else {
+nova_res_t __nv_regional_heap_req_empty (nova_heap_t * nv_heap,
+                                         nvi_t nv_n,
+                                         nova_block_t ** nv_chain)
+{
+    if (0 < nv_lkg_req_blocks (&nv_heap->nv_lkgs[0], nv_n, nv_chain)) {
+        return nova_ok;
+    }
+
+    if (nv_heap->nv_parent_heap != NULL) {
+        return __nv_regional_heap_req_empty (nv_heap->nv_parent_heap, nv_n, nv_chain);
+    }
+
+    /* Root heap.
+     */
+    {
+        nova_chunk_t * _nv_chunk;
+        if (__builtin_expect (nova_ok != nv_chunk_create (&_nv_chunk), 0)) {
+            __nv_error (NVE_CASCADE,
+                        "__nv_regional_heap_req_empty(%p, %zu, %p):"
+                        " cascading error imminent: chunk allocation failed from"
+                        " root heap",
+                        nv_heap,
+                        nv_n,
+                        nv_chain);
             return nova_fail;
         }
+        __nv_chunk_release_blocks_to (_nv_chunk, nv_heap, 0, nova_read_cfg (NV_CHUNK_BLOCKCOUNT));
+        /* Take care of the chunk list.
+         */
+        nv_chunk_bind_to_root (_nv_chunk, nv_heap);
     }
+
+    if (0 < nv_lkg_req_blocks (&nv_heap->nv_lkgs[0], nv_n, nv_chain)) {
+        return nova_ok;
+    }
+    return nova_fail;
 }
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "nova.h"
+
+/*******************************************************************************
+ * CLIENT INTERFACE : INLINE FAST PATHS
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* nova_alloc and nova_free go through three or four out-of-line calls (client
+ * interface -> local heap -> local linkage -> block) before they touch a free
+ * list, with everything passed back through out-parameters. The common cases
+ * don't need any of that:
+ *
+ *  - allocation: the linkage for the class has a head block, with objects on
+ *    its local free list. Pop one off and bump the count.
+ *  - deallocation: the object is on the head block of one of the calling
+ *    thread's linkages. Push it onto the local free list and drop the count;
+ *    a head block is never binned, passed up or stolen, so there's no settling
+ *    to do (see __nv_block_acnt_settle).
+ *
+ * Those are what's in here; everything else (bitmap blocks, spans, sliding,
+ * refills, foreign frees) falls through to the out-of-line versions, which
+ * handle every case. Both have to stay in step with __nv_block_alloc_inner and
+ * __nv_block_dealloc.
+ *
+ * Link against the static LTO build (`make libnova.a`) to get the same inlining
+ * for the out-of-line paths.
+ */
+
+/* Thread id of the calling thread, as returned by __nv_tid; 0 until it has one.
+ * __thread rather than _Thread_local, which C++ doesn't have.
+ */
+extern __thread nova_tid_t __nv_tid_local;
+
+/* Same as __nv_smobj_block. */
+static inline __attribute__ ((always_inline)) nova_block_t * __nv_inline_smobj_block (void * nv_obj)
+{
+    const uintptr_t _nv_csize_lcache = __atomic_load_n (&_nv_dealloc_csize_cache, __ATOMIC_ACQUIRE);
+    const uintptr_t _nv_sops_lcache  = __atomic_load_n (&_nv_dealloc_smobjplsz_cache, __ATOMIC_ACQUIRE);
+    const uintptr_t _nv_hdrp_lcache  = __atomic_load_n (&_nv_dealloc_hdrpools_cache, __ATOMIC_ACQUIRE);
+
+    nova_chunk_t * _nv_chunk = (nova_chunk_t *)((uintptr_t)nv_obj & ~(_nv_csize_lcache - 1));
+    return &_nv_chunk->nv_blocks[((uintptr_t)nv_obj & (_nv_csize_lcache - 1)) / _nv_sops_lcache - _nv_hdrp_lcache];
+}
+
+/** nova_alloc, with the head-block case inlined.
+ * \behaviour with a constant `nv_size`, the class and linkage fold away as in
+ *            nova_alloc_const.
+ */
+static inline __attribute__ ((always_inline)) void * nova_alloc_inline (nova_heap_t * nv_heap, nvi_t nv_size)
+{
+    const nvi_t _nv_osz = NOVA_CANONICAL_OSZ (nv_size);
+    const nvi_t _nv_li  = NOVA_LINDEX (nv_size);
+
+    if (__builtin_expect (_nv_li < nv_heap->nv_ln
+                              && _nv_osz <= __atomic_load_n (&_nv_dealloc_smobjplsz_cache, __ATOMIC_RELAXED)
+                              && _nv_osz <= UINT16_MAX,
+                          1)) {
+        /* Only the owner ever changes the head, or takes from its FPL.
+         */
+        nova_block_t * _nvc_head = __atomic_load_n (&nv_heap->nv_lkgs[_nv_li].nv_head, __ATOMIC_ACQUIRE);
+        if (__builtin_expect (_nvc_head != NULL
+                                  && !(__c11_atomic_load (&_nvc_head->nv_blfl, __ATOMIC_RELAXED) & NOVA_BLFL_BITMAP)
+                                  && _nvc_head->nv_fpl != NULL,
+                              1)) {
+            void * _nv_obj            = _nvc_head->nv_fpl;
+            const uint16_t _nv_nooff  = *(uint16_t *)_nv_obj;
+            _nvc_head->nv_fpl         = (_nv_nooff != 0xffff) ? (uint8_t *)_nvc_head->nv_base + _nv_nooff : NULL;
+            __atomic_add_fetch (&_nvc_head->nv_acnt, 1, __ATOMIC_ACQ_REL);
+            return _nv_obj;
+        }
+    }
+    return nova_alloc (nv_heap, nv_size);
+}
+
+/** nova_free, with the local head-block case inlined.
+ * \notes in debug mode, this is just nova_free, which validates the object.
+ */
+static inline __attribute__ ((always_inline)) void nova_free_inline (void * nv_obj)
+{
+#if !NOVA_MODE_DEBUG
+    if (__builtin_expect (nv_obj != NULL, 1)) {
+        nova_block_t * _nv_block = __nv_inline_smobj_block (nv_obj);
+        const uint16_t _nv_blfl  = __c11_atomic_load (&_nv_block->nv_blfl, __ATOMIC_RELAXED);
+        const nova_tid_t _nv_tid = __nv_tid_local;
+
+        /* If we own the block, nobody else can take the head flag off it (or hand
+         * it to somebody else) while we're here; owners are never 0.
+         */
+        if (__builtin_expect ((_nv_blfl & (NOVA_BLFL_ISHEAD | NOVA_BLFL_BITMAP | NOVA_BLFL_SPAN)) == NOVA_BLFL_ISHEAD
+                                  && _nv_tid != 0
+                                  && _nv_tid == __atomic_load_n (&_nv_block->nv_owner, __ATOMIC_ACQUIRE),
+                              1)) {
+            *(uint16_t *)nv_obj = (_nv_block->nv_fpl != NULL)
+                ? (uint16_t)((uint8_t *)_nv_block->nv_fpl - (uint8_t *)_nv_block->nv_base)
+                : 0xffff;
+            _nv_block->nv_fpl = nv_obj;
+            __atomic_sub_fetch (&_nv_block->nv_acnt, (nova_smobjcnt_t)1, __ATOMIC_ACQ_REL);
+            return;
+        }
+    }
+#endif
+    nova_free (nv_obj);
+}
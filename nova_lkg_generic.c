@@ -13,10 +13,16 @@ nova_res_t nv_lkg_init (nova_lkg_t * nv_lkg)
      * to occur just-in-time on the allocation paths, because we have no idea
      * whether this linkage will ever actually see any action.
      */
-    nv_lkg->nv_head = NULL;
+    nv_lkg->nv_head  = NULL;
+    nv_lkg->nv_uhead = 0;
+    nv_lkg->nv_uroot = 0;
     /* the only expensive operation: initializing the mutex. */
     nvmutex_init (&nv_lkg->nv_ll);
     nv_lkg->nv_heap = NULL;
+    for (nvi_t _nv_bi = 0; _nv_bi < NOVA_LKG_NBINS; _nv_bi++) {
+        nv_lkg->nv_bins[_nv_bi] = NULL;
+    }
+    nv_lkg->nv_rfdmd = 1;
 
     /* this is basically a never-fail (ignoring the invalid-linkage-pointer case
      * and the mutex-init-gone-horribly-awry cases), so we're pretty much safe to
@@ -52,6 +58,11 @@ nova_res_t nv_lkg_req_block (nova_lkg_t * nv_lkg, nova_block_t ** nv_block)
         if (nv_lkg->nv_head != NULL) {
             nv_lkg->nv_head->nv_lkgpr = NULL;
         }
+        /* The block is in transit until the requester files it somewhere; a NULL
+         * nv_lkg tells deallocators on the empty/empty-enough paths to leave the
+         * block alone, since it isn't on any list they could unlink it from.
+         */
+        __atomic_store_n (&(*nv_block)->nv_lkg, NULL, __ATOMIC_RELEASE);
         /* We're clear to unlock here: no remaining changes to nv_head or the
          * side linkages of any blocks on this chain.
          *
@@ -65,6 +76,11 @@ nova_res_t nv_lkg_req_block (nova_lkg_t * nv_lkg, nova_block_t ** nv_block)
          */
         (*nv_block)->nv_lkgnx = NULL;
 
+        /* First time anybody's asked for this block since its chunk was
+         * created; set up the header (and its FPGM) now.
+         */
+        __nv_block_init_lazy (*nv_block);
+
         /* FPGM is expected to be locked at this ponit
          */
         nvmutex_lock (&(*nv_block)->nv_fpgm);
@@ -77,3 +93,198 @@ nova_res_t nv_lkg_req_block (nova_lkg_t * nv_lkg, nova_block_t ** nv_block)
     nvmutex_unlock (&nv_lkg->nv_ll);
     return nova_fail;
 }
+
+nvi_t nv_lkg_req_blocks (nova_lkg_t * nv_lkg, nvi_t nv_n, nova_block_t ** nv_chain)
+{
+    nova_block_t * _nv_first;
+    const nvi_t _nv_got = __nv_ulkg_pop (nv_lkg, nv_n, &_nv_first);
+    if (_nv_got == 0) {
+        return 0;
+    }
+
+    /* Everything on the chain is empty and off the linkage, so the rest can be
+     * done at leisure.
+     */
+    for (nova_block_t * _nvc = _nv_first; _nvc != NULL; _nvc = _nvc->nv_lkgnx) {
+        __nv_block_init_lazy (_nvc);
+    }
+    nvmutex_lock (&_nv_first->nv_fpgm);
+
+    *nv_chain = _nv_first;
+    return _nv_got;
+}
+
+#if NOVA_BLOCK_MIGRATION
+static nova_heap_t * __nv_heap_root_of (nova_heap_t * nv_heap)
+{
+    while (nv_heap->nv_parent_heap != NULL) {
+        nv_heap = nv_heap->nv_parent_heap;
+    }
+    return nv_heap;
+}
+
+/* Producer/consumer pairs: one thread allocates, another frees. Left alone, the
+ * producer's regional heap gets every block back, and the consumer's keeps asking
+ * the root for more. If most of nv_block went back through the calling thread
+ * (which is about to empty it), hand it to the calling thread's regional heap
+ * instead; NULL to leave it with nv_receiver.
+ *
+ * The calling thread's default heap is the only one of its heaps we can find from
+ * here, so that's the one whose parent gets the block. Blocks never leave their
+ * root: nova_reclaim only looks at its own chunks.
+ */
+static nova_heap_t * __nv_lkg_empty_migrate_to (nova_block_t * nv_block, nova_heap_t * nv_receiver)
+{
+    nova_heap_t * _nv_dheap = __nv_dheap_local;
+    if (_nv_dheap == NULL || _nv_dheap->nv_parent_heap == NULL || _nv_dheap->nv_parent_heap == nv_receiver) {
+        return NULL;
+    }
+
+    const nova_tid_t _nv_tid     = __nv_tid ();
+    const nova_rfstat_t * _nv_rf = __nv_block_rfstat (nv_block);
+    if (_nv_rf->nv_rftid != _nv_tid
+        || _nv_tid == __atomic_load_n (&nv_block->nv_owner, __ATOMIC_ACQUIRE)
+        || 2 * _nv_rf->nv_rfcnt < nv_block->nv_ocnt) {
+        return NULL;
+    }
+
+    if (__nv_heap_root_of (_nv_dheap->nv_parent_heap) != __nv_heap_root_of (nv_receiver)) {
+        return NULL;
+    }
+    return _nv_dheap->nv_parent_heap;
+}
+#endif
+
+nova_res_t __nv_lkg_empty (nova_block_t * nv_block)
+{
+    nova_lkg_t * _nv_lkg = nv_block->nv_lkg;
+    nova_heap_t * _nv_receiver;
+
+    /* Take the block off its linkage. Only local linkages give their blocks a
+     * nv_lkg (blocks resting on regional linkages have a NULL one; see
+     * __nv_lkg_pass_up), and a local block that isn't the head is binned, so
+     * it goes up to the parent heap.
+     */
+    __nv_local_lkg_unbin_nl (_nv_lkg, nv_block);
+    _nv_receiver = ((nova_heap_t *)_nv_lkg->nv_heap)->nv_parent_heap;
+    if (__builtin_expect (_nv_receiver == NULL, 0)) {
+        /* Orphaned local heap: park it on the local heap's own unsized linkage.
+         */
+        _nv_receiver = _nv_lkg->nv_heap;
+    }
+#if NOVA_BLOCK_MIGRATION
+    else {
+        nova_heap_t * _nv_consumer = __nv_lkg_empty_migrate_to (nv_block, _nv_receiver);
+        if (_nv_consumer != NULL) {
+            _nv_receiver = _nv_consumer;
+        }
+    }
+#endif
+    __atomic_store_n (&nv_block->nv_lkg, NULL, __ATOMIC_RELEASE);
+
+    /* The block is off every list and its FPGM is still locked, so nobody can
+     * get at it once we let go of the LL.
+     */
+    nvmutex_unlock (&_nv_lkg->nv_ll);
+
+    /* Unsized linkages are lock-free; unlocks the FPGM on landing.
+     */
+    __nv_ulkg_receive_block_sl (&_nv_receiver->nv_lkgs[0], nv_block);
+
+    return nova_ok;
+}
+
+nova_res_t __nv_lkg_empty_e (nova_block_t * nv_block)
+{
+    nova_lkg_t * _nv_lkg = nv_block->nv_lkg;
+
+    /* Only local linkages are sorted (and only local blocks can get here in
+     * the first place; see __nv_lkg_empty).
+     */
+    if (__c11_atomic_load (&nv_block->nv_blfl, __ATOMIC_ACQUIRE) & NOVA_BLFL_BINNED) {
+        /* Recompute the bin from scratch rather than assuming the block moved
+         * down by exactly one: a few more deallocations may have landed since
+         * the one that got us here.
+         */
+        __nv_local_lkg_unbin_nl (_nv_lkg, nv_block);
+        __nv_local_lkg_bin_nl (_nv_lkg, nv_block);
+    }
+
+    nvmutex_unlock (&_nv_lkg->nv_ll);
+
+    return nova_ok;
+}
+
+void __nv_lkg_release_nl (nova_block_t * nv_block)
+{
+    __c11_atomic_fetch_and (&nv_block->nv_blfl, (uint16_t) ~(NOVA_BLFL_BINNED | NOVA_BLFL_BINMASK), __ATOMIC_ACQ_REL);
+    /* Whoever allocated from the block isn't going to anymore; every
+     * deallocation from here on takes the foreign path. (Thread ids start at 1.)
+     */
+    __atomic_store_n (&nv_block->nv_owner, 0, __ATOMIC_RELEASE);
+    /* Deallocations that empty the block (or move it into a different bin) find
+     * its linkage through nv_lkg; anybody who gets our LL after this sees NULL,
+     * and leaves the block be.
+     */
+    __atomic_store_n (&nv_block->nv_lkg, NULL, __ATOMIC_RELEASE);
+}
+
+nova_res_t __nv_lkg_pass_up (nova_heap_t * nv_heap, nvi_t nv_li, nova_block_t * nv_chain)
+{
+    nova_block_t *_nv_efirst = NULL, *_nv_elast = NULL;
+    nova_block_t *_nv_sfirst = NULL, *_nv_slast = NULL;
+    nova_block_t * _nv_next;
+
+    /* Sort the chain out before we take any locks; this is the only part that
+     * is linear in the number of blocks.
+     *
+     * A block that's empty now stays empty (it has no objects left to
+     * deallocate). One that empties after this point just sits on the sized
+     * linkage until somebody asks for a block of its class: with a NULL nv_lkg,
+     * nobody is going to move it.
+     */
+    for (nova_block_t * _nvc = nv_chain; _nvc != NULL; _nvc = _nv_next) {
+        _nv_next       = _nvc->nv_lkgnx;
+        _nvc->nv_lkgnx = NULL;
+        if (0 == __atomic_load_n (&_nvc->nv_acnt, __ATOMIC_ACQUIRE)) {
+            _nvc->nv_lkgpr = NULL;
+            if (_nv_elast != NULL) {
+                _nv_elast->nv_lkgnx = _nvc;
+            } else {
+                _nv_efirst = _nvc;
+            }
+            _nv_elast = _nvc;
+        } else {
+            _nvc->nv_lkgpr = _nv_slast;
+            if (_nv_slast != NULL) {
+                _nv_slast->nv_lkgnx = _nvc;
+            } else {
+                _nv_sfirst = _nvc;
+            }
+            _nv_slast = _nvc;
+        }
+    }
+
+    if (_nv_efirst != NULL) {
+        __nv_ulkg_push (&nv_heap->nv_lkgs[0], _nv_efirst, _nv_elast);
+    }
+
+    if (_nv_sfirst != NULL) {
+        if (__builtin_expect (nv_li >= nv_heap->nv_ln, 0)) {
+#if NOVA_MODE_DEBUG
+            __nv_error (NVE_HIERARCHY, "__nv_lkg_pass_up(%p, %zu, %p): heap has no linkage for this class.", nv_heap, nv_li, nv_chain);
+#endif
+            return nova_fail;
+        }
+        nova_lkg_t * _nv_lkg = &nv_heap->nv_lkgs[nv_li];
+        nvmutex_lock (&_nv_lkg->nv_ll);
+        _nv_slast->nv_lkgnx = _nv_lkg->nv_head;
+        if (_nv_lkg->nv_head != NULL) {
+            _nv_lkg->nv_head->nv_lkgpr = _nv_slast;
+        }
+        _nv_lkg->nv_head = _nv_sfirst;
+        nvmutex_unlock (&_nv_lkg->nv_ll);
+    }
+
+    return nova_ok;
+}
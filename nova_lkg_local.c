@@ -6,91 +6,369 @@
 
 NOVA_DOCSTUB ();
 
-nova_res_t __nv_local_lkg_drop (nova_lkg_t * nv_lkg)
+/* Layout of a local linkage:
+ *
+ *  nv_head          the block currently being allocated from (NOVA_BLFL_ISHEAD);
+ *                   not on any list.
+ *  nv_bins[FULL]    blocks with no free objects
+ *  nv_bins[HI]      blocks with more than 3/4 of their objects allocated
+ *  nv_bins[MID]     blocks with between 1/2 and 3/4 of their objects allocated
+ *  nv_bins[LO]      blocks with less than 1/2 of their objects allocated
+ *
+ * Bins are NULL-terminated doubly linked lists through nv_lkgpr/nv_lkgnx, and are
+ * guarded by the linkage's LL. When the head runs dry, the new head is the fullest
+ * non-full block: that packs live objects into as few pools as possible, and lets
+ * the mostly-empty blocks at the bottom drain completely and go back upstream
+ * (see __nv_lkg_empty).
+ */
+
+nova_res_t __nv_local_lkg_bin_nl (nova_lkg_t * nv_lkg, nova_block_t * nv_block)
+{
+    const nvi_t _nv_bin = NOVA_LKG_BIN (nv_block->nv_ocnt,
+                                        __atomic_load_n (&nv_block->nv_acnt, __ATOMIC_ACQUIRE));
+
+    nv_block->nv_lkgpr = NULL;
+    nv_block->nv_lkgnx = nv_lkg->nv_bins[_nv_bin];
+    if (nv_block->nv_lkgnx != NULL) {
+        nv_block->nv_lkgnx->nv_lkgpr = nv_block;
+    }
+    nv_lkg->nv_bins[_nv_bin] = nv_block;
+
+    /* Bin bits first, then the flag, so that anyone who sees NOVA_BLFL_BINNED
+     * (and then locks the LL to make sure) sees a valid bin.
+     */
+    __c11_atomic_fetch_or (&nv_block->nv_blfl, (uint16_t)(_nv_bin << NOVA_BLFL_BINSHIFT), __ATOMIC_ACQ_REL);
+    __c11_atomic_fetch_or (&nv_block->nv_blfl, NOVA_BLFL_BINNED, __ATOMIC_ACQ_REL);
+
+    return nova_ok;
+}
+
+nova_res_t __nv_local_lkg_unbin_nl (nova_lkg_t * nv_lkg, nova_block_t * nv_block)
+{
+    const nvi_t _nv_bin = (__c11_atomic_load (&nv_block->nv_blfl, __ATOMIC_ACQUIRE) & NOVA_BLFL_BINMASK)
+                          >> NOVA_BLFL_BINSHIFT;
+
+    if (nv_block->nv_lkgpr != NULL) {
+        nv_block->nv_lkgpr->nv_lkgnx = nv_block->nv_lkgnx;
+    } else {
+        nv_lkg->nv_bins[_nv_bin] = nv_block->nv_lkgnx;
+    }
+    if (nv_block->nv_lkgnx != NULL) {
+        nv_block->nv_lkgnx->nv_lkgpr = nv_block->nv_lkgpr;
+    }
+    nv_block->nv_lkgpr = nv_block->nv_lkgnx = NULL;
+
+    __c11_atomic_fetch_and (&nv_block->nv_blfl, (uint16_t) ~(NOVA_BLFL_BINNED | NOVA_BLFL_BINMASK), __ATOMIC_ACQ_REL);
+
+    return nova_ok;
+}
+
+nova_block_t * __nv_local_lkg_steal_nl (nova_lkg_t * nv_lkg)
+{
+    nova_heap_t * _nv_heap     = nv_lkg->nv_heap;
+    const nvi_t _nv_li         = (nvi_t)(nv_lkg - _nv_heap->nv_lkgs);
+    nova_rheap_pfx_t * _nv_pfx = NOVA_RHEAP_PFX (_nv_heap->nv_parent_heap);
+    nova_block_t * _nvn        = NULL;
+
+    /* Lock order: our LL -> nv_sibl -> sibling's LL -> FPGM. Siblings steal from
+     * each other, so the sibling's LL is only ever tried; if it's busy, its owner
+     * is using it, and it's the wrong place to take from anyways.
+     */
+    nvmutex_lock (&_nv_pfx->nv_sibl);
+    for (nova_heap_t * _nv_sib = _nv_pfx->nv_children; _nv_sib != NULL && _nvn == NULL; _nv_sib = _nv_sib->nv_sibnx) {
+        if (_nv_sib == _nv_heap || _nv_li >= _nv_sib->nv_ln) {
+            continue;
+        }
+        nova_lkg_t * _nv_slkg = &_nv_sib->nv_lkgs[_nv_li];
+        if (nova_ok != nvmutex_trylock (&_nv_slkg->nv_ll)) {
+            continue;
+        }
+
+        /* Leave the sibling at least one block to fall back on, so that two
+         * heaps can't just keep passing the same block back and forth.
+         */
+        nova_block_t * _nvc = _nv_slkg->nv_bins[NOVA_LKG_BIN_LO];
+        if (_nvc != NULL && _nvc->nv_lkgnx != NULL) {
+            /* With the FPGM locked, the old owner is either done with the FPL or
+             * hasn't checked nv_owner yet (see __nv_block_dealloc_is_local).
+             */
+            nvmutex_lock (&_nvc->nv_fpgm);
+            __nv_local_lkg_unbin_nl (_nv_slkg, _nvc);
+            __atomic_store_n (&_nvc->nv_owner, __nv_tid (), __ATOMIC_RELEASE);
+            /* Both LLs are held, so whoever is waiting on the old one to mark
+             * the block empty (or empty enough) will notice the move.
+             */
+            __atomic_store_n (&_nvc->nv_lkg, nv_lkg, __ATOMIC_RELEASE);
+            _nvn = _nvc;
+        }
+        nvmutex_unlock (&_nv_slkg->nv_ll);
+    }
+    nvmutex_unlock (&_nv_pfx->nv_sibl);
+
+    return _nvn;
+}
+
+nvi_t __nv_local_lkg_trim (nova_lkg_t * nv_lkg)
 {
-    /* Allocation is not going to be happening here; this method is occurring in the owning thread.
+    nova_heap_t * _nv_heap = nv_lkg->nv_heap;
+    nvi_t _nv_n            = 0;
+
+    /* The bin is already a chain; all that's left is to let go of the blocks
+     * one by one, which only needs our own LL.
      */
     nvmutex_lock (&nv_lkg->nv_ll);
-    /* Optional: at this point, there are no more allocations, so foreign deallocations
-     *           are actually fine to go through to the head; instead of doing an atomic
-     *           load, we do a swap, and NULL the head. */
-    nova_block_t * _nv_head = __atomic_exchange_n (&nv_lkg->nv_head, NULL, __ATOMIC_ACQ_REL);
+    nova_block_t * _nv_chain         = nv_lkg->nv_bins[NOVA_LKG_BIN_LO];
+    nv_lkg->nv_bins[NOVA_LKG_BIN_LO] = NULL;
+    for (nova_block_t * _nvc = _nv_chain; _nvc != NULL; _nvc = _nvc->nv_lkgnx) {
+        __nv_lkg_release_nl (_nvc);
+        _nv_n++;
+    }
+    /* Whatever this linkage needs next, it isn't a burst.
+     */
+    nv_lkg->nv_rfdmd = 1;
+    nvmutex_unlock (&nv_lkg->nv_ll);
 
-    /* Couple notes on the implementation:
-     *
-     * We handle the head as a separate case, because we need to clear nv_blfl,
-     * and it'd be a waste of cycles to do that for any of the others.
-     *
-     * We lock the FPGMs on all of the blocks that we release. Since we are the
-     * owning thread here, the owning thread reference should be invalid from this
-     * point onwards.
-     * @TODO test this assumption
-     *
-     * We use the order left-of-head, right-of-head, head: the only significant
-     * part of this is that the head is only handled after all the other cases.
-     * This is necessary because left-of-head and right-of-head rely on the head's
-     * side-pointers being in a valid state: if we evac head too early, then
-     * the receiving linkage will (probably) modify nv_lkgpr and nv_lkgnx,
-     * which would invalidate left-of-head and right-of-head if they were to
-     * be processed after the head.
+    if (_nv_chain != NULL) {
+        __nv_lkg_pass_up (_nv_heap->nv_parent_heap, (nvi_t)(nv_lkg - _nv_heap->nv_lkgs), _nv_chain);
+    }
+
+    return _nv_n;
+}
+
+nvi_t __nv_local_lkg_reset (nova_lkg_t * nv_lkg)
+{
+    nova_heap_t * _nv_heap   = nv_lkg->nv_heap;
+    nova_block_t * _nv_first = NULL;
+    nova_block_t * _nv_last  = NULL;
+    nvi_t _nv_n              = 0;
+
+    /* Same shape as __nv_local_lkg_drop, except that the blocks stay with us:
+     * they go on our own unsized linkage, as though they had come along with a
+     * batch refill, and get formatted (for whatever class wants them first)
+     * on their way back out. That's what keeps this linear in blocks.
+     */
+    nvmutex_lock (&nv_lkg->nv_ll);
+
+    /* The head isn't on any bin; whatever its side links say is stale.
+     */
+    nova_block_t * _nv_curr = __atomic_exchange_n (&nv_lkg->nv_head, NULL, __ATOMIC_ACQ_REL);
+    if (_nv_curr != NULL) {
+        _nv_curr->nv_lkgnx = _nv_curr->nv_lkgpr = NULL;
+    }
+    nvi_t _nv_bi = 0;
+    for (;;) {
+        while (_nv_curr != NULL) {
+            nova_block_t * _nv_ncurr = _nv_curr->nv_lkgnx;
+
+            nvmutex_lock (&_nv_curr->nv_fpgm);
+            __nv_block_reset_sl (_nv_curr);
+            nvmutex_unlock (&_nv_curr->nv_fpgm);
+
+            _nv_curr->nv_lkgnx = _nv_first;
+            _nv_first          = _nv_curr;
+            if (_nv_last == NULL) {
+                _nv_last = _nv_curr;
+            }
+            _nv_n++;
+
+            _nv_curr = _nv_ncurr;
+        }
+        if (_nv_bi == NOVA_LKG_NBINS) {
+            break;
+        }
+        _nv_curr                = nv_lkg->nv_bins[_nv_bi];
+        nv_lkg->nv_bins[_nv_bi] = NULL;
+        _nv_bi++;
+    }
+
+    nvmutex_unlock (&nv_lkg->nv_ll);
+
+    if (_nv_first != NULL) {
+        __nv_ulkg_push (&_nv_heap->nv_lkgs[0], _nv_first, _nv_last);
+    }
+
+    return _nv_n;
+}
+
+nvi_t __nv_local_lkg_transfer (nova_lkg_t * nv_lkg, nova_tid_t nv_owner)
+{
+    nvi_t _nv_n = 0;
+
+    /* The blocks stay where they are; the LL keeps siblings from stealing any of
+     * them halfway through, and the FPGM keeps foreign deallocators off the FPG.
+     */
+    nvmutex_lock (&nv_lkg->nv_ll);
+
+    nova_block_t * _nvc = __atomic_load_n (&nv_lkg->nv_head, __ATOMIC_ACQUIRE);
+    if (_nvc != NULL) {
+        nvmutex_lock (&_nvc->nv_fpgm);
+        __nv_block_transfer_sl (_nvc, nv_owner);
+        nvmutex_unlock (&_nvc->nv_fpgm);
+        _nv_n++;
+    }
+    for (nvi_t _nv_bi = 0; _nv_bi < NOVA_LKG_NBINS; _nv_bi++) {
+        for (_nvc = nv_lkg->nv_bins[_nv_bi]; _nvc != NULL; _nvc = _nvc->nv_lkgnx) {
+            nvmutex_lock (&_nvc->nv_fpgm);
+            __nv_block_transfer_sl (_nvc, nv_owner);
+            nvmutex_unlock (&_nvc->nv_fpgm);
+            _nv_n++;
+        }
+    }
+
+    nvmutex_unlock (&nv_lkg->nv_ll);
+
+    return _nv_n;
+}
+
+nova_res_t __nv_local_lkg_alloc_near (nova_lkg_t * nv_lkg, nova_block_t * nv_block, void ** nv_obj)
+{
+    /* Unlocked first pass: most hints that are going to fail, fail here.
      */
+    if (__atomic_load_n (&nv_block->nv_lkg, __ATOMIC_ACQUIRE) != nv_lkg
+        || __atomic_load_n (&nv_block->nv_owner, __ATOMIC_ACQUIRE) != __nv_tid ()) {
+        return nova_fail;
+    }
 
-    /* we use __nv_local_heap_pass_evac_nl_sl here.
-     * nl -> non-locking evac (tells heap to assume that preparation has occurred)
-     * sl -> state:locked (FPGM locked)
+    /* A binned block is only ever allocated from here, and the LL and FPGM
+     * between them keep everybody else off it: siblings can't steal it, and
+     * the empty/empty-enough paths wait for us and then see the new count.
      */
+    nvmutex_lock (&nv_lkg->nv_ll);
+    if (__builtin_expect (__atomic_load_n (&nv_block->nv_lkg, __ATOMIC_ACQUIRE) != nv_lkg
+                              || !(__c11_atomic_load (&nv_block->nv_blfl, __ATOMIC_ACQUIRE) & NOVA_BLFL_BINNED),
+                          0)) {
+        nvmutex_unlock (&nv_lkg->nv_ll);
+        return nova_fail;
+    }
+    nvmutex_lock (&nv_block->nv_fpgm);
+    if (nv_block->nv_fpl == NULL) {
+        nv_block->nv_fpl = __atomic_exchange_n (&nv_block->nv_fpg, NULL, __ATOMIC_ACQUIRE);
+    }
+    if (__builtin_expect (nv_block->nv_fpl == NULL, 0)) {
+        nvmutex_unlock (&nv_block->nv_fpgm);
+        nvmutex_unlock (&nv_lkg->nv_ll);
+        return nova_fail;
+    }
+    __nv_block_alloc_inner (nv_block, nv_obj);
 
-    /* Handle left-of-head: dominant list-search side-link: nv_lkgpr
+    /* The count went up, which the bins otherwise never see; file the block
+     * again from scratch.
      */
-    nova_block_t *_nv_curr = _nv_head->nv_lkgpr, *_nv_ncurr = NULL;
-    while (_nv_curr != NULL) {
-        nvmutex_lock (&_nv_curr->nv_fpgm);
-
-        _nv_ncurr = _nv_curr->nv_lkgpr;
-        /* Probably not entirely necessary, but we do it necessary, for neatness'
-         * sake. This isn't a hotpath, but we might want to stick this in a debug
-         * bracket at some point anyway.
-         */
-        _nv_curr->nv_lkgpr = _nv_curr->nv_lkgnx = NULL;
-        /* nv_lkg->nv_heap is not modified in the linkage's lifetime, so no
-         * ALdAcq here.
-         */
-        __nv_local_heap_pass_evac_nl_sl (((nova_lkg_t *)nv_lkg)->nv_heap, _nv_curr);
+    __nv_local_lkg_unbin_nl (nv_lkg, nv_block);
+    __nv_local_lkg_bin_nl (nv_lkg, nv_block);
+
+    nvmutex_unlock (&nv_block->nv_fpgm);
+    nvmutex_unlock (&nv_lkg->nv_ll);
+
+    return nova_ok;
+}
+
+void __nv_local_lkg_disown (nova_lkg_t * nv_lkg)
+{
+    /* The owner frees into its head without the FPGM (see nova_free_inline), so
+     * the head has to stop being one while we're still in the owning thread:
+     * file it like any other block, and take the owner off it, so every later
+     * free takes the foreign path.
+     */
+    nvmutex_lock (&nv_lkg->nv_ll);
 
-        _nv_curr = _nv_ncurr;
+    nova_block_t * _nv_head = __atomic_load_n (&nv_lkg->nv_head, __ATOMIC_ACQUIRE);
+    if (_nv_head != NULL) {
+        nvmutex_lock (&_nv_head->nv_fpgm);
+        __c11_atomic_fetch_and (&_nv_head->nv_blfl, (uint16_t)~NOVA_BLFL_ISHEAD, __ATOMIC_ACQ_REL);
+        __nv_local_lkg_bin_nl (nv_lkg, _nv_head);
+        __atomic_store_n (&nv_lkg->nv_head, NULL, __ATOMIC_RELEASE);
+        __atomic_store_n (&_nv_head->nv_owner, 0, __ATOMIC_RELEASE);
+        nvmutex_unlock (&_nv_head->nv_fpgm);
     }
 
-    /* Handle right-of-head: dominant list-search side-link: nv_lkgnx
+#if !NOVA_BLOCK_STEALING
+    /* Without stealing, the owner doesn't take the FPGM for the rest of its
+     * blocks either.
      */
-    _nv_curr = _nv_head->nv_lkgnx->nv_lkgnx, _nv_ncurr = NULL;
-    while (_nv_curr != NULL) {
-        nvmutex_lock (&_nv_curr->nv_fpgm);
+    for (nvi_t _nv_bi = 0; _nv_bi < NOVA_LKG_NBINS; _nv_bi++) {
+        for (nova_block_t * _nvc = nv_lkg->nv_bins[_nv_bi]; _nvc != NULL; _nvc = _nvc->nv_lkgnx) {
+            nvmutex_lock (&_nvc->nv_fpgm);
+            __atomic_store_n (&_nvc->nv_owner, 0, __ATOMIC_RELEASE);
+            nvmutex_unlock (&_nvc->nv_fpgm);
+        }
+    }
+#endif
+
+    nvmutex_unlock (&nv_lkg->nv_ll);
+}
 
-        _nv_ncurr          = _nv_curr->nv_lkgnx;
-        _nv_curr->nv_lkgpr = _nv_curr->nv_lkgnx = NULL;
-        __nv_local_heap_pass_evac_nl_sl (((nova_lkg_t *)nv_lkg)->nv_heap, _nv_curr);
+nova_res_t __nv_local_lkg_drop (nova_lkg_t * nv_lkg)
+{
+    /* Allocation is not going to be happening here. This runs either in the
+     * owning thread, or on the maintenance thread after nova_heap_drop_async
+     * has disowned the linkage (see __nv_local_lkg_disown), in which case the
+     * owner may still be freeing into it, but only ever through the FPGM.
+     */
+    nova_heap_t * _nv_heap = nv_lkg->nv_heap;
 
-        _nv_curr = _nv_ncurr;
+    if (NOVA_LKG_UNSIZED (nv_lkg)) {
+        /* Parked blocks (see __nv_local_heap_req_block); they're empty, so they
+         * go straight up, no locks involved.
+         */
+        __nv_ulkg_pass (nv_lkg, &_nv_heap->nv_parent_heap->nv_lkgs[0]);
+        nvmutex_drop (&nv_lkg->nv_ll);
+        return nova_ok;
     }
 
-    /* Handle the head; not that much different from the normal case, *but* we
-     * do need to get rid of nv_blfl.
+    /* Detach everything under our own LL: the head and the bins go onto one
+     * chain (through nv_lkgnx), and every block on it is let go of on the way.
+     * Deallocations that want to refile or empty one of these blocks only ever
+     * try for the LL (see __nv_block_lock_lkg), and find a NULL nv_lkg once
+     * we're done with it.
+     *
+     * The parent's LL isn't involved until the chain is ready to be spliced in,
+     * and then only for constant time; the old way (one evacuation per block
+     * with the parent's LL held throughout) would stall every refill from the
+     * parent for as long as it took to walk the heap.
      */
-    nvmutex_lock (&_nv_head->nv_fpgm);
-    _nv_head->nv_lkgnx = _nv_head->nv_lkgpr = NULL;
-    /* @MARK head-fix */
-    __c11_atomic_fetch_and (&_nv_head->nv_blfl, ~NOVA_BLFL_ISHEAD, __ATOMIC_ACQ_REL);
+    nvmutex_lock (&nv_lkg->nv_ll);
 
-    __nv_local_heap_pass_evac_nl_sl (((nova_lkg_t *)nv_lkg)->nv_heap, _nv_head);
+    nova_block_t * _nv_chain = __atomic_exchange_n (&nv_lkg->nv_head, NULL, __ATOMIC_ACQ_REL);
+    if (_nv_chain != NULL) {
+        /* The head flag only ever changes with the FPGM locked.
+         * @MARK head-fix */
+        nvmutex_lock (&_nv_chain->nv_fpgm);
+        __c11_atomic_fetch_and (&_nv_chain->nv_blfl, (uint16_t)~NOVA_BLFL_ISHEAD, __ATOMIC_ACQ_REL);
+        __nv_lkg_release_nl (_nv_chain);
+        nvmutex_unlock (&_nv_chain->nv_fpgm);
+        _nv_chain->nv_lkgnx = _nv_chain->nv_lkgpr = NULL;
+    }
 
-    /* Not sure if we need to do an unlock here, but it feels like some
-     * standards-conforming thing that's probably better to do than not.
-     * We need to drop the linkage modification mutex here because this is the
+    for (nvi_t _nv_bi = 0; _nv_bi < NOVA_LKG_NBINS; _nv_bi++) {
+        nova_block_t * _nv_curr = nv_lkg->nv_bins[_nv_bi];
+        nv_lkg->nv_bins[_nv_bi] = NULL;
+        while (_nv_curr != NULL) {
+            nova_block_t * _nv_ncurr = _nv_curr->nv_lkgnx;
+            /* Under the FPGM, so that nobody in __nv_block_lock_lkg is still
+             * holding on to this linkage once we're done here.
+             */
+            nvmutex_lock (&_nv_curr->nv_fpgm);
+            __nv_lkg_release_nl (_nv_curr);
+            nvmutex_unlock (&_nv_curr->nv_fpgm);
+            /* Order on the chain doesn't matter; __nv_lkg_pass_up sorts it out.
+             */
+            _nv_curr->nv_lkgnx = _nv_chain;
+            _nv_chain          = _nv_curr;
+            _nv_curr           = _nv_ncurr;
+        }
+    }
+
+    /* We need to drop the linkage modification mutex here because this is the
      * linkage's end-of-life.
      */
     nvmutex_unlock (&nv_lkg->nv_ll);
     nvmutex_drop (&nv_lkg->nv_ll);
 
+    if (_nv_chain != NULL) {
+        __nv_lkg_pass_up (_nv_heap->nv_parent_heap, (nvi_t)(nv_lkg - _nv_heap->nv_lkgs), _nv_chain);
+    }
+
     return nova_ok;
 }
 
@@ -114,184 +392,168 @@ nova_res_t __nv_local_lkg_alloc (nova_lkg_t * nv_lkg,
     nova_block_t * _nvc_head = __atomic_load_n (&nv_lkg->nv_head, __ATOMIC_ACQUIRE);
 
     /*
-     * CHECK FOR NULL HEAD; THIS IS pull.upstream-direct.
+     * TRY A NORMAL ALLOCATION.
      */
 
-    if (__builtin_expect (_nvc_head == NULL, 0)) {
-        /* this linkage doesn't actually have any blocks in it yet, so we have to
-         * add one. benefit: block is guaranteed to have at least one free object.
-         */
-        if (__builtin_expect (
-                nova_fail == __nv_local_heap_req_block (nv_heap, __nv_canonicalize_osz (nv_osz), &_nvc_head),
-                0)) {
-            (*nv_obj) = NULL;
-            return nova_fail;
+    if (__builtin_expect (_nvc_head != NULL, 1)) {
+        if (__builtin_expect (nova_ok == __nv_block_alloc (_nvc_head, nv_obj), 1)) {
+            return nova_ok;
         }
-        /* @MARK block cleanup */
-        _nvc_head->nv_owner = __nv_tid ();
-        _nvc_head->nv_lkgnx = NULL;
-        _nvc_head->nv_lkgpr = NULL;
-        _nvc_head->nv_lkg   = nv_lkg;
-        /* We assume that the block was formatted by __nv_local_heap_req_block:
-         * this is so that if we do accidentally hit a block that was resting
-         * in a sized chain, we don't accidentally screw up it's deallocation
-         * structures.
-         */
-
-        /* Set up nv_blfl.
-         */
-        __c11_atomic_fetch_or (&_nvc_head->nv_blfl, NOVA_BLFL_ISHEAD, __ATOMIC_ACQ_REL);
+    }
 
-        nvmutex_lock (&nv_lkg->nv_ll);
-        __atomic_store_n (&nv_lkg->nv_head, _nvc_head, __ATOMIC_RELEASE);
+    /*
+     * THE HEAD IS DRY (OR MISSING): RETIRE IT INTO THE FULL BIN, AND SLIDE IN
+     * THE FULLEST NON-FULL BLOCK.
+     */
 
-        /*
-         * note: the block is guaranteed to have it's nv_fpgm in a locked state.
-         *       we don't unlock it until after it's set up as head to prevent
-         *       foreign deallocations.
-         */
-        nvmutex_unlock (&_nvc_head->nv_fpgm);
+    nvmutex_lock (&nv_lkg->nv_ll);
 
-        /* Now, all we have to do is unlock the linkage mutex. */
-        nvmutex_unlock (&nv_lkg->nv_ll);
+    if (_nvc_head != NULL) {
+        /* step 1: lock the foreign deallocation mutex on the head. the head is immobile,
+         * so we can perform surgery. */
+        nvmutex_lock (&_nvc_head->nv_fpgm);
 
-        return __nv_block_alloc (_nvc_head, nv_obj);
-    }
+        if (__builtin_expect (__atomic_load_n (&_nvc_head->nv_fpg, __ATOMIC_ACQUIRE) != NULL, 0)) {
+            /* Some foreign deallocations landed between the failed allocation and
+             * the FPGM lock; no point in sliding, just go again.
+             */
+            nvmutex_unlock (&_nvc_head->nv_fpgm);
+            nvmutex_unlock (&nv_lkg->nv_ll);
+            return __nv_block_alloc (_nvc_head, nv_obj);
+        }
 
-    /*
-     * TRY A NORMAL ALLOCATION.
-     */
+        /* step 2: remove the head flag. we can do this 'cuz we got the foreign deallocation
+         *         mutex locked-- head flag only ever changes while the FPGM is locked. */
+        __c11_atomic_fetch_and (&_nvc_head->nv_blfl, (uint16_t)~NOVA_BLFL_ISHEAD, __ATOMIC_ACQ_REL);
+        __nv_local_lkg_bin_nl (nv_lkg, _nvc_head);
+        __atomic_store_n (&nv_lkg->nv_head, NULL, __ATOMIC_RELEASE);
 
-    if (__builtin_expect (nova_ok == __nv_block_alloc (_nvc_head, nv_obj), 1)) {
-        return nova_ok;
+        nvmutex_unlock (&_nvc_head->nv_fpgm);
     }
 
     /*
-     * TRY A SLIDE; THIS IS slide.right.
-     */
-
-    /* okay, so, block allocation failed, time to try to slide a block.
+     * TRY A SLIDE; THIS IS slide.bin.
      */
 
-    /* <edit:ignore> A slight problem here: if the slidee is deallocated from concurrently
-     * to this function, it locks the FPGM before the LL, while this function
-     * locks the LL after locking the FPGM.
-     * Basically, what we have to do here is try to lock the FPGM, and if
-     * that fails, then we unlock the LL, sleep for a few nanoseconds, and relock
-     * the LL, and retry </edit:ignore>
-     *
-     * EDIT: we don't actually need to do this; we're switching __nv_block_dealloc
-     * to locking the LL instead of the FPGM on the Block:Empty case.
-     */
-
-    nvmutex_lock (&nv_lkg->nv_ll);
-    _nvc_head = __atomic_load_n (&nv_lkg->nv_head, __ATOMIC_ACQUIRE);
-    if (_nvc_head->nv_lkgnx != NULL) {
-        /* This is a relatively simple procedure; the FPGM locks prevent any
-         * concurrent modification because we're currently located in the
-         * owning thread.
-         * EDIT: There is, however, as indicated previously, a possible deadlock
-         * that could emerge here, so we take care of that here.
-         */
+    for (nvi_t _nv_bi = NOVA_LKG_BIN_HI; _nv_bi < NOVA_LKG_NBINS; _nv_bi++) {
+        nova_block_t * _nvn = nv_lkg->nv_bins[_nv_bi];
+        if (_nvn == NULL) {
+            continue;
+        }
 
-        /* Lock the current head.
+        /* Lock the slidee, and headify it. The LL is held, so the empty and
+         * empty-enough paths can't get at it while we do.
          */
-        nvmutex_lock (&_nvc_head->nv_fpgm);
+        nvmutex_lock (&_nvn->nv_fpgm);
+        __nv_local_lkg_unbin_nl (nv_lkg, _nvn);
+        __c11_atomic_fetch_or (&_nvn->nv_blfl, NOVA_BLFL_ISHEAD, __ATOMIC_ACQ_REL);
+        __atomic_store_n (&nv_lkg->nv_head, _nvn, __ATOMIC_RELEASE);
+        nvmutex_unlock (&_nvn->nv_fpgm);
 
-        /* Lock the slidee, and headify it <edit:ignore>(protecting for deadlock)</edit:ignore>.
-         * Don't need to worry about deadlock anymore.
+        /* The bins were enough this time; ask for less next time we go upstream.
          */
-        nvmutex_lock (&_nvc_head->nv_lkgnx->nv_fpgm);
-#if 0
-        while (nova_fail == nvmutex_trylock (&_nvc_head->nv_lkgnx->nv_fpgm)) {
-            nvmutex_unlock (&nv_lkg->nv_ll);
-            /* sleep for ~1 microsecond */
-            nanosleep ((const struct timespec[]) { { 0, 1000 } }, NULL);
-
-            nvmutex_lock (&nv_lkg->nv_ll);
-        }
-#endif
+        nv_lkg->nv_rfdmd = (nv_lkg->nv_rfdmd > 1) ? (nv_lkg->nv_rfdmd >> 1) : 1;
 
-        /* Only unhead the current head once we finished the anti-deadlock loop.
-         */
-        __c11_atomic_fetch_and (&_nvc_head->nv_blfl, ~NOVA_BLFL_ISHEAD, __ATOMIC_ACQ_REL);
-
-        __c11_atomic_fetch_or (&_nvc_head->nv_blfl, NOVA_BLFL_ISHEAD, __ATOMIC_ACQ_REL);
+        nvmutex_unlock (&nv_lkg->nv_ll);
 
-#if NOVA_MODE_DEBUG
-        /* Scope _nvx_head locally so it doesn't leak.
+        /* acnt < ocnt, and acnt never undercounts the live objects, so there is a
+         * free object on either the FPL or the FPG.
          */
-        {
-            nova_block_t * _nvx_head = _nvc_head;
-            __atomic_compare_exchange_n (&nv_lkg->nv_head, &_nvx_head, _nvc_head->nv_lkgnx, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
-            if (_nvx_head != _nvc_head) {
-                __nv_error (NVE_DESYNC, "__nv_local_lkg_alloc: unsanctioned concurrent modification to nv_head");
-                return nova_fail;
-            }
-        }
-#else
-        __atomic_store_n (&nv_lkg->nv_head, _nvc_head->nv_lkgnx, __ATOMIC_RELEASE);
-#endif
-        nvmutex_unlock (&_nvc_head->nv_fpgm);
-        _nvc_head = _nvc_head->nv_lkgnx;
-        /* Unlock the new head, now that blfl has been dealt with.
-         */
-        nvmutex_unlock (&_nvc_head->nv_fpgm);
-
-        if (__builtin_expect (nova_ok == __nv_block_alloc (_nvc_head, nv_obj), 1)) {
+        if (__builtin_expect (nova_ok == __nv_block_alloc (_nvn, nv_obj), 1)) {
             return nova_ok;
         }
 
         /* this should be impossible. */
-        __nv_error (NVE_IMPOSSIBLE, "__nv_local_lkg_alloc: nova has entered an invalid state: right-of-head block on linkage could not be allocated from.");
+        __nv_error (NVE_IMPOSSIBLE, "__nv_local_lkg_alloc: nova has entered an invalid state: binned non-full block on linkage could not be allocated from.");
+        (*nv_obj) = NULL;
+        return nova_fail;
     }
 
+#if NOVA_BLOCK_STEALING
     /*
-     * LAST RESORT: SLIDE LEFT slide.left AND PULL FROM UPSTREAM pull.upstream-req.
+     * TRY A STEAL; THIS IS steal.sibling.
      */
 
-    /* okay, so, block allocation failed, and we need to grab a new block.
-     * the linkage has already been locked, so we just have to do the following: */
+    if (__builtin_expect (nv_lkg->nv_heap != NULL && ((nova_heap_t *)nv_lkg->nv_heap)->nv_parent_heap != NULL, 1)) {
+        nova_block_t * _nvn = __nv_local_lkg_steal_nl (nv_lkg);
+        if (_nvn != NULL) {
+            __c11_atomic_fetch_or (&_nvn->nv_blfl, NOVA_BLFL_ISHEAD, __ATOMIC_ACQ_REL);
+            __atomic_store_n (&nv_lkg->nv_head, _nvn, __ATOMIC_RELEASE);
+            nvmutex_unlock (&_nvn->nv_fpgm);
+            nvmutex_unlock (&nv_lkg->nv_ll);
+
+            /* Same as a slide: it came out of a bin, so it has a free object.
+             */
+            return __nv_block_alloc (_nvn, nv_obj);
+        }
+    }
+#endif
+
+    /*
+     * LAST RESORT: PULL FROM UPSTREAM pull.upstream-req.
+     */
 
-    /* step 1: lock the foreign deallocation mutex on the head. the head is immobile,
-     * so we can perform surgery. */
-    nvmutex_lock (&_nvc_head->nv_fpgm);
+    /* Up here: a label can't be followed by a declaration. */
+    nvi_t _nv_rfn;
+nv_lkg_alloc___pull___:
+    /* Back-to-back trips upstream mean the linkage is in a burst; ask for more
+     * each time, so that the extras (parked on the heap's unsized linkage) cover
+     * the next few refills.
+     */
+    _nv_rfn          = nv_lkg->nv_rfdmd;
+    nv_lkg->nv_rfdmd = (_nv_rfn < NOVA_REFILL_MAXBATCH / 2) ? (_nv_rfn << 1) : NOVA_REFILL_MAXBATCH;
 
-    /* step 2: remove the head flag. we can do this 'cuz we got the foreign deallocation
-     *         mutex locked-- head flag only ever changes while the FPGM is locked. */
-    __c11_atomic_fetch_and (&_nvc_head->nv_blfl, ~NOVA_BLFL_ISHEAD, __ATOMIC_ACQ_REL);
+    /* We don't hold the LL across the request: it may go all the way up to the
+     * root heap, and there's nothing on this linkage that needs protecting in the
+     * meantime (the head is NULL, and we're the only ones who allocate).
+     */
+    nvmutex_unlock (&nv_lkg->nv_ll);
 
     nova_block_t * _nvn;
     if (__builtin_expect (
-            nova_fail == __nv_local_heap_req_block (nv_heap, __nv_canonicalize_osz (nv_osz), &_nvn),
+            nova_fail == __nv_local_heap_req_block (nv_heap, __nv_canonicalize_osz (nv_osz), _nv_rfn, &_nvn),
             0)) {
         (*nv_obj) = NULL;
         return nova_fail;
     }
 
+    /* @MARK block cleanup */
     _nvn->nv_owner = __nv_tid ();
-    _nvn->nv_lkg   = nv_lkg;
-    /* Again: formatting is handled by __nv_local_heap_req_block. */
+    _nvn->nv_lkgnx = NULL;
+    _nvn->nv_lkgpr = NULL;
+    /* We assume that the block was formatted by __nv_local_heap_req_block:
+     * this is so that if we do accidentally hit a block that was resting
+     * in a sized chain, we don't accidentally screw up it's deallocation
+     * structures.
+     */
 
-    __c11_atomic_fetch_or (&_nvn->nv_blfl, NOVA_BLFL_ISHEAD, __ATOMIC_ACQ_REL);
+    nvmutex_lock (&nv_lkg->nv_ll);
+    __atomic_store_n (&_nvn->nv_lkg, nv_lkg, __ATOMIC_RELEASE);
 
-    /* the side pointers of the blocks in this linkage can only be modified
-     * while the linkage modification mutex is locked.
+    /* A dying heap passes its full blocks up along with the rest (see
+     * __nv_lkg_pass_up), and they come back down like any other sized block.
+     * Foreign deallocations only lower nv_acnt with the FPGM held, so this one
+     * really has nothing free; keep it (binned as full, so its deallocations
+     * find their way here), and go again.
      */
-    _nvn->nv_lkgpr = _nvc_head;
-    _nvn->nv_lkgnx = _nvc_head->nv_lkgnx;
-
-    _nvc_head->nv_lkgnx = _nvn;
-    if (_nvn->nv_lkgnx != NULL) {
-        _nvn->nv_lkgnx->nv_lkgpr = _nvn;
+    if (__builtin_expect (__atomic_load_n (&_nvn->nv_acnt, __ATOMIC_ACQUIRE) == _nvn->nv_ocnt, 0)) {
+        __nv_local_lkg_bin_nl (nv_lkg, _nvn);
+        nvmutex_unlock (&_nvn->nv_fpgm);
+        goto nv_lkg_alloc___pull___;
     }
-    nvmutex_unlock (&_nvc_head->nv_fpgm);
+
+    __c11_atomic_fetch_or (&_nvn->nv_blfl, NOVA_BLFL_ISHEAD, __ATOMIC_ACQ_REL);
     __atomic_store_n (&nv_lkg->nv_head, _nvn, __ATOMIC_RELEASE);
 
-    /* Don't unlock the new head's FPGM until it's in place */
+    /*
+     * note: the block is guaranteed to have it's nv_fpgm in a locked state.
+     *       we don't unlock it until after it's set up as head to prevent
+     *       foreign deallocations.
+     */
     nvmutex_unlock (&_nvn->nv_fpgm);
 
-    /* At this point, there's nothing we can really do.
-     */
-    return __nv_block_alloc (_nvc_head, nv_obj);
+    /* Now, all we have to do is unlock the linkage mutex. */
+    nvmutex_unlock (&nv_lkg->nv_ll);
+
+    return __nv_block_alloc (_nvn, nv_obj);
 }
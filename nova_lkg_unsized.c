@@ -0,0 +1,220 @@
+#include "nova.h"
+
+/*******************************************************************************
+ * LINKAGE HANDLING : UNSIZED LINKAGES
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Unsized linkages (nv_lkgs[0] of every heap) only ever hold empty blocks, which
+ * nobody can be deallocating into; so there's no reason to ever take one out of
+ * the middle of the list, and the linkage can be a plain Treiber stack through
+ * nv_lkgnx, with no LL involved. That matters most for the root heap's, which
+ * every refill in the process eventually goes through.
+ *
+ * nv_uhead packs the top block's address into the low NOVA_ULKG_TAGSHIFT bits,
+ * and a modification counter into the bits above that. Every successful push or
+ * pop bumps the counter, so a CAS against a stale nv_uhead fails even if the
+ * same block ended up back on top in the meantime (ABA). That is also what makes
+ * popping several blocks at once safe: if the CAS goes through, nothing touched
+ * the stack since we walked it.
+ *
+ * The nv_lkgnx reads during the walk can race with whoever popped the block from
+ * under us; the counter check throws those walks away, and the memory itself is
+ * never unmapped while the heap is alive, so the reads are harmless.
+ *
+ * Blocks on an unsized linkage have a NULL nv_lkg, same as blocks in transit:
+ * nobody can be deallocating into an empty block, and a deallocation that is
+ * still on its way out of __nv_block_acnt_release (having emptied the block just
+ * before it was passed up) must not come looking for it on a linkage it can't be
+ * unlinked from.
+ *
+ * The root heap's linkage also keeps count, per chunk, of how many of the
+ * chunk's blocks are on it (nv_nidle; see nova_maint.c). Pushes count the blocks
+ * in before the CAS, pops count them out after it; so a chunk can only ever look
+ * completely idle when every one of its blocks is on the stack or on its way
+ * there. Pops drop the blocks of chunks that nova_reclaim has released, and
+ * whoever pops the last of them gets rid of the chunk.
+ */
+
+static inline nova_block_t * __nv_ulkg_ptr (uintptr_t nv_uhead)
+{
+    return (nova_block_t *)(nv_uhead & NOVA_ULKG_PTRMASK);
+}
+
+static inline uintptr_t __nv_ulkg_next (uintptr_t nv_uhead, nova_block_t * nv_top)
+{
+    return ((nv_uhead & ~NOVA_ULKG_PTRMASK) + ((uintptr_t)1 << NOVA_ULKG_TAGSHIFT))
+        | (uintptr_t)nv_top;
+}
+
+static inline nova_chunk_t * __nv_ulkg_chunk (nova_block_t * nv_block, nvi_t nv_csize)
+{
+    return (nova_chunk_t *)((uintptr_t)nv_block & ~(uintptr_t)(nv_csize - 1));
+}
+
+nova_res_t __nv_ulkg_push (nova_lkg_t * nv_lkg, nova_block_t * nv_first, nova_block_t * nv_last)
+{
+    const nvi_t _nv_csize = nv_lkg->nv_uroot ? nova_read_cfg (NV_CHUNKSIZE) : 0;
+
+    /* The chain is ours until the CAS goes through.
+     */
+    for (nova_block_t * _nvc = nv_first;; _nvc = _nvc->nv_lkgnx) {
+        _nvc->nv_lkgpr = NULL;
+        __atomic_store_n (&_nvc->nv_lkg, NULL, __ATOMIC_RELEASE);
+        if (_nv_csize != 0) {
+            __atomic_add_fetch (&__nv_ulkg_chunk (_nvc, _nv_csize)->nv_nidle, 1, __ATOMIC_ACQ_REL);
+        }
+        if (_nvc == nv_last) {
+            break;
+        }
+    }
+
+    uintptr_t _nv_old = __atomic_load_n (&nv_lkg->nv_uhead, __ATOMIC_ACQUIRE);
+    do {
+        __atomic_store_n (&nv_last->nv_lkgnx, __nv_ulkg_ptr (_nv_old), __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n (&nv_lkg->nv_uhead,
+                                           &_nv_old,
+                                           __nv_ulkg_next (_nv_old, nv_first),
+                                           /* weak = */ 1,
+                                           __ATOMIC_ACQ_REL,
+                                           __ATOMIC_ACQUIRE));
+
+    return nova_ok;
+}
+
+static nvi_t __nv_ulkg_pop_raw (nova_lkg_t * nv_lkg, nvi_t nv_n, nova_block_t ** nv_chain)
+{
+    uintptr_t _nv_old = __atomic_load_n (&nv_lkg->nv_uhead, __ATOMIC_ACQUIRE);
+    nova_block_t * _nv_last;
+    nvi_t _nv_got;
+
+    do {
+        _nv_last = NULL;
+        _nv_got  = 0;
+        for (nova_block_t * _nvc = __nv_ulkg_ptr (_nv_old);
+             _nvc != NULL && _nv_got < nv_n;
+             _nvc = __atomic_load_n (&_nvc->nv_lkgnx, __ATOMIC_RELAXED)) {
+            _nv_last = _nvc;
+            _nv_got++;
+        }
+        if (_nv_got == 0) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n (&nv_lkg->nv_uhead,
+                                           &_nv_old,
+                                           __nv_ulkg_next (_nv_old, __atomic_load_n (&_nv_last->nv_lkgnx, __ATOMIC_RELAXED)),
+                                           /* weak = */ 1,
+                                           __ATOMIC_ACQ_REL,
+                                           __ATOMIC_ACQUIRE));
+
+    /* The chain is ours now; nv_lkg is already NULL, as it should be for blocks
+     * in transit (see nv_lkg_req_block).
+     */
+    __atomic_store_n (&_nv_last->nv_lkgnx, NULL, __ATOMIC_RELAXED);
+    *nv_chain = __nv_ulkg_ptr (_nv_old);
+
+    return _nv_got;
+}
+
+/* Count a chain just popped off the root's linkage out of its chunks, and take
+ * out the blocks of dying chunks; the rest is left in *nv_first .. *nv_last.
+ * Returns how many are left.
+ */
+static nvi_t __nv_ulkg_root_settle (nova_lkg_t * nv_lkg, nova_block_t ** nv_first, nova_block_t ** nv_last)
+{
+    const nvi_t _nv_csize = nova_read_cfg (NV_CHUNKSIZE);
+    nova_block_t *_nv_first = NULL, *_nv_last = NULL, *_nv_next;
+    nvi_t _nv_kept = 0;
+
+    for (nova_block_t * _nvc = *nv_first; _nvc != NULL; _nvc = _nv_next) {
+        _nv_next                 = _nvc->nv_lkgnx;
+        nova_chunk_t * _nv_chunk = __nv_ulkg_chunk (_nvc, _nv_csize);
+        const nvi_t _nv_nidle    = __atomic_sub_fetch (&_nv_chunk->nv_nidle, 1, __ATOMIC_ACQ_REL);
+        if (__builtin_expect (_nv_nidle & NOVA_CHUNK_DYING, 0)) {
+            if (_nv_nidle == NOVA_CHUNK_DYING) {
+                /* That was the last of its blocks, so none of the rest of the
+                 * chain is in it.
+                 */
+                __nv_chunk_unbind_from_root (_nv_chunk, nv_lkg->nv_heap);
+                __nv_chunk_destroy (_nv_chunk);
+            }
+            continue;
+        }
+
+        _nvc->nv_lkgnx = NULL;
+        if (_nv_last != NULL) {
+            _nv_last->nv_lkgnx = _nvc;
+        } else {
+            _nv_first = _nvc;
+        }
+        _nv_last = _nvc;
+        _nv_kept++;
+    }
+
+    *nv_first = _nv_first;
+    *nv_last  = _nv_last;
+    return _nv_kept;
+}
+
+nvi_t __nv_ulkg_pop (nova_lkg_t * nv_lkg, nvi_t nv_n, nova_block_t ** nv_chain)
+{
+    if (__builtin_expect (!nv_lkg->nv_uroot, 1)) {
+        return __nv_ulkg_pop_raw (nv_lkg, nv_n, nv_chain);
+    }
+
+    /* Root: keep going until we have nv_n live blocks, or the stack is dry.
+     */
+    nova_block_t *_nv_first = NULL, *_nv_last = NULL;
+    nvi_t _nv_got = 0;
+    while (_nv_got < nv_n) {
+        nova_block_t *_nv_cfirst, *_nv_clast;
+        if (0 == __nv_ulkg_pop_raw (nv_lkg, nv_n - _nv_got, &_nv_cfirst)) {
+            break;
+        }
+        const nvi_t _nv_k = __nv_ulkg_root_settle (nv_lkg, &_nv_cfirst, &_nv_clast);
+        if (_nv_k == 0) {
+            continue;
+        }
+        if (_nv_last != NULL) {
+            _nv_last->nv_lkgnx = _nv_cfirst;
+        } else {
+            _nv_first = _nv_cfirst;
+        }
+        _nv_last = _nv_clast;
+        _nv_got += _nv_k;
+    }
+
+    if (_nv_got != 0) {
+        *nv_chain = _nv_first;
+    }
+    return _nv_got;
+}
+
+nova_res_t __nv_ulkg_receive_block_sl (nova_lkg_t * nv_lkg, nova_block_t * nv_block)
+{
+    /* Empty block, so nobody is going to come looking for the FPGM; unlock it
+     * before the push, since the next popper is going to lock it.
+     */
+    nv_block->nv_owner = __nv_tid ();
+    nvmutex_unlock (&nv_block->nv_fpgm);
+
+    return __nv_ulkg_push (nv_lkg, nv_block, nv_block);
+}
+
+nvi_t __nv_ulkg_pass (nova_lkg_t * nv_from, nova_lkg_t * nv_to)
+{
+    nova_block_t * _nv_first;
+    const nvi_t _nv_n = __nv_ulkg_pop (nv_from, NOVA_ULKG_ALL, &_nv_first);
+    if (_nv_n == 0) {
+        return 0;
+    }
+
+    nova_block_t * _nv_last = _nv_first;
+    while (_nv_last->nv_lkgnx != NULL) {
+        _nv_last = _nv_last->nv_lkgnx;
+    }
+    __nv_ulkg_push (nv_to, _nv_first, _nv_last);
+
+    return _nv_n;
+}
@@ -0,0 +1,249 @@
+#include "nova.h"
+
+/* pthread_cond_timedwait, clock_gettime */
+#include <time.h>
+/* madvise */
+#include <sys/mman.h>
+#include <errno.h>
+
+/*******************************************************************************
+ * HEAP HANDLING : MAINTENANCE
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Chunks are only ever created by the root heap, and until now only ever
+ * destroyed with it; after a burst, the process holds on to its peak. Empty
+ * blocks do make it back up to the root's unsized linkage eventually (see
+ * __nv_lkg_empty), and the linkage keeps count of them per chunk (nv_nidle; see
+ * nova_lkg_unsized.c), so once a chunk's count is full, the chunk can go.
+ *
+ * The unsized linkage is a lock-free stack, so there's no taking blocks out of
+ * the middle of it, and taking the whole stack would leave every refill in the
+ * meantime to think there's nothing idle and create a new chunk. Instead, a
+ * released chunk is marked NOVA_CHUNK_DYING (the same CAS checks that its count
+ * is still full), its pools go back to the system on the spot, and its blocks are
+ * left where they are: pops drop them as they come off, and the last one to come
+ * off takes the header pools with it (see __nv_ulkg_pop).
+ *
+ * Only arena chunks are released: popping from the stack reads nv_lkgnx of
+ * blocks that may have been popped by somebody else in the meantime, and an
+ * arena chunk's memory stays mapped after it's released, where a
+ * posix_memalign'd one may well not.
+ *
+ * The same thread also takes heap teardown off the threads that own the heaps
+ * (see nova_heap_drop_async): a thread on its way out just queues its local
+ * heap, and the evacuation, the decref (and possibly the regional drop that
+ * comes with it) and the frees all happen over here.
+ */
+
+typedef struct nova_maint
+{
+    /* one reclaim at a time, so that nv_keep means something */
+    nova_mutex_t nv_rl;
+    /* the rest is guarded by nv_ml */
+    nova_mutex_t nv_ml;
+    pthread_cond_t nv_mc;
+    pthread_t nv_thread;
+    int nv_running;
+    int nv_stop;
+    nova_heap_t * nv_root;
+    nvi_t nv_period_ms;
+    nvi_t nv_keep;
+    /* heaps to drop, chained through nv_dropnx (most recent first) */
+    nova_heap_t * nv_drops;
+} nova_maint_t;
+
+static nova_maint_t _nv_maint = {
+    .nv_rl      = PTHREAD_MUTEX_INITIALIZER,
+    .nv_ml      = PTHREAD_MUTEX_INITIALIZER,
+    .nv_mc      = PTHREAD_COND_INITIALIZER,
+    .nv_running = 0,
+    .nv_stop    = 0,
+    .nv_drops   = NULL,
+};
+
+nvi_t nova_reclaim (nova_heap_t * nv_root, nvi_t nv_keep)
+{
+    const nvi_t _nv_nb    = nova_read_cfg (NV_CHUNK_BLOCKCOUNT);
+    const nvi_t _nv_hdrsz = nova_read_cfg (NV_CHUNK_HDRPOOLS) * nova_read_cfg (NV_SMOBJ_POOLSIZE);
+    nova_rheap_pfx_t * _nv_pfx = NOVA_RHEAP_PFX (nv_root);
+    nvi_t _nv_nkept = 0, _nv_released = 0;
+
+    nvmutex_lock (&_nv_maint.nv_rl);
+    /* Keeps the chunks we look at from being unbound (and destroyed) under us.
+     */
+    nvmutex_lock (&_nv_pfx->nv_chunkl);
+    for (nova_chunk_t * _nvc = __atomic_load_n (&_nv_pfx->nv_chunks, __ATOMIC_ACQUIRE); _nvc != NULL; _nvc = _nvc->nv_next) {
+        /* Span chunks never have blocks on the unsized linkage, so their count
+         * is never full.
+         */
+        nvi_t _nv_full = _nv_nb;
+        if (__atomic_load_n (&_nvc->nv_nidle, __ATOMIC_ACQUIRE) != _nv_full) {
+            continue;
+        }
+        if (_nv_nkept < nv_keep || !__nv_arena_owns (_nvc)) {
+            _nv_nkept++;
+            continue;
+        }
+        if (!__atomic_compare_exchange_n (&_nvc->nv_nidle, &_nv_full, NOVA_CHUNK_DYING | _nv_nb, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            /* A refill got to it first. */
+            continue;
+        }
+
+        /* None of its blocks are going to be handed out again, so the pools
+         * can go now; the headers are still in use by the stack.
+         */
+#ifdef MADV_DONTNEED
+        madvise ((uint8_t *)_nvc + _nv_hdrsz, _nv_nb * nova_read_cfg (NV_SMOBJ_POOLSIZE), MADV_DONTNEED);
+#endif
+        _nv_released++;
+    }
+    nvmutex_unlock (&_nv_pfx->nv_chunkl);
+
+    nvmutex_unlock (&_nv_maint.nv_rl);
+
+    return _nv_released;
+}
+
+/* Drop a chain of heaps taken off nv_drops. Nothing locked.
+ */
+static void __nv_maint_drop_chain (nova_heap_t * nv_chain)
+{
+    while (nv_chain != NULL) {
+        nova_heap_t * _nv_next = nv_chain->nv_dropnx;
+        __nv_local_heap_drop (nv_chain);
+        nv_chain = _nv_next;
+    }
+}
+
+static void __nv_maint_deadline (struct timespec * nv_ts)
+{
+    clock_gettime (CLOCK_REALTIME, nv_ts);
+    nv_ts->tv_sec += _nv_maint.nv_period_ms / 1000;
+    nv_ts->tv_nsec += (long)(_nv_maint.nv_period_ms % 1000) * 1000000L;
+    if (nv_ts->tv_nsec >= 1000000000L) {
+        nv_ts->tv_sec++;
+        nv_ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void * __nv_maint_main (void * nv_arg)
+{
+    (void)nv_arg;
+    struct timespec _nv_ts;
+
+    nvmutex_lock (&_nv_maint.nv_ml);
+    __nv_maint_deadline (&_nv_ts);
+    while (!_nv_maint.nv_stop) {
+        /* Wait out the period, or until there's something to drop (or we're
+         * told to stop). Drops don't push the deadline back, so a steady stream
+         * of them doesn't hold up the reclaims.
+         */
+        int _nv_r = 0;
+        while (!_nv_maint.nv_stop && _nv_maint.nv_drops == NULL && _nv_r != ETIMEDOUT) {
+            _nv_r = pthread_cond_timedwait (&_nv_maint.nv_mc, &_nv_maint.nv_ml, &_nv_ts);
+        }
+        if (_nv_maint.nv_stop) {
+            break;
+        }
+
+        nova_heap_t * _nv_drops = _nv_maint.nv_drops;
+        nova_heap_t * _nv_root  = _nv_maint.nv_root;
+        const nvi_t _nv_keep    = _nv_maint.nv_keep;
+        _nv_maint.nv_drops      = NULL;
+        nvmutex_unlock (&_nv_maint.nv_ml);
+
+        /* Drops first: whatever they give back to the root may well be
+         * reclaimable right away.
+         */
+        __nv_maint_drop_chain (_nv_drops);
+        if (_nv_r == ETIMEDOUT) {
+            nova_reclaim (_nv_root, _nv_keep);
+        }
+
+        nvmutex_lock (&_nv_maint.nv_ml);
+        if (_nv_r == ETIMEDOUT) {
+            __nv_maint_deadline (&_nv_ts);
+        }
+    }
+    /* Nothing gets queued once nv_stop is set (see nova_heap_drop_async), so
+     * this is the last of them.
+     */
+    nova_heap_t * _nv_drops = _nv_maint.nv_drops;
+    _nv_maint.nv_drops      = NULL;
+    nvmutex_unlock (&_nv_maint.nv_ml);
+
+    __nv_maint_drop_chain (_nv_drops);
+
+    return NULL;
+}
+
+nova_res_t nova_maint_start (nova_heap_t * nv_root, nvi_t nv_period_ms, nvi_t nv_keep)
+{
+    nova_res_t _nv_res = nova_fail;
+
+    nvmutex_lock (&_nv_maint.nv_ml);
+    if (__builtin_expect (_nv_maint.nv_running, 0)) {
+#if NOVA_MODE_DEBUG
+        __nv_error (NVE_BADVAL, "nova_maint_start(%p, %zu, %zu): maintenance thread is already running.", nv_root, nv_period_ms, nv_keep);
+#endif
+        goto out;
+    }
+    _nv_maint.nv_root      = nv_root;
+    _nv_maint.nv_period_ms = nv_period_ms;
+    _nv_maint.nv_keep      = nv_keep;
+    _nv_maint.nv_stop      = 0;
+    if (0 == pthread_create (&_nv_maint.nv_thread, NULL, __nv_maint_main, NULL)) {
+        _nv_maint.nv_running = 1;
+        _nv_res              = nova_ok;
+    }
+
+out:
+    nvmutex_unlock (&_nv_maint.nv_ml);
+    return _nv_res;
+}
+
+nova_res_t nova_maint_stop (void)
+{
+    nvmutex_lock (&_nv_maint.nv_ml);
+    if (!_nv_maint.nv_running) {
+        nvmutex_unlock (&_nv_maint.nv_ml);
+        return nova_ok;
+    }
+    _nv_maint.nv_stop = 1;
+    pthread_cond_signal (&_nv_maint.nv_mc);
+    nvmutex_unlock (&_nv_maint.nv_ml);
+
+    pthread_join (_nv_maint.nv_thread, NULL);
+
+    nvmutex_lock (&_nv_maint.nv_ml);
+    _nv_maint.nv_running = 0;
+    nvmutex_unlock (&_nv_maint.nv_ml);
+
+    return nova_ok;
+}
+
+nova_res_t nova_heap_drop_async (nova_heap_t * nv_heap)
+{
+    /* The drop may well happen on another thread while we keep on freeing, so
+     * the heap has to stop being ours first.
+     */
+    for (nvi_t _nv_li = 1; _nv_li < nv_heap->nv_ln; _nv_li++) {
+        __nv_local_lkg_disown (&nv_heap->nv_lkgs[_nv_li]);
+    }
+
+    nvmutex_lock (&_nv_maint.nv_ml);
+    if (__builtin_expect (!_nv_maint.nv_running || _nv_maint.nv_stop, 0)) {
+        /* Nobody to hand it to.
+         */
+        nvmutex_unlock (&_nv_maint.nv_ml);
+        return __nv_local_heap_drop (nv_heap);
+    }
+    nv_heap->nv_dropnx = _nv_maint.nv_drops;
+    _nv_maint.nv_drops = nv_heap;
+    pthread_cond_signal (&_nv_maint.nv_mc);
+    nvmutex_unlock (&_nv_maint.nv_ml);
+
+    return nova_ok;
+}
@@ -23,6 +23,7 @@ nova_res_t nvmutex_init (nova_mutex_t * nv_mutex)
      * much guaranteed-success if called properly.
      */
     pthread_mutexattr_t _nv_pmattr;
+    pthread_mutexattr_init (&_nv_pmattr);
     pthread_mutexattr_settype (&_nv_pmattr, PTHREAD_MUTEX_NORMAL);
     pthread_mutex_init (nv_mutex, &_nv_pmattr);
     pthread_mutexattr_destroy (&_nv_pmattr);
@@ -0,0 +1,194 @@
+#include "nova.h"
+
+/* malloc, free */
+#include <stdlib.h>
+
+/*******************************************************************************
+ * HEAP HANDLING : OBJECT CACHES
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Object caches, after Bonwick's slab allocator: a cache hands out objects of
+ * one size that are already constructed, and takes them back in that state, so
+ * that the (expensive) constructor runs once per object per block, not once per
+ * allocation.
+ *
+ * That rules out the intrusive free list, which overwrites the first bytes of
+ * every freed object; every block of a cache is a bitmap block instead, whatever
+ * the size (see nova_block_bitmap.c), and the free maps live in front of the
+ * objects. Foreign frees go through the foreign map and the FPGM, same as for any
+ * other bitmap block.
+ *
+ * The cache keeps its blocks to itself: they're on no linkage, and have a NULL
+ * nv_lkg, so the deallocation paths never try to refile or pass them upstream
+ * (see __nv_block_acnt_settle). Blocks only leave the cache through
+ * nova_objcache_reap and nova_objcache_drop, which run the destructor over them
+ * first.
+ */
+
+nova_res_t nova_objcache_create (nova_objcache_t ** nv_cache,
+                                 nova_heap_t * nv_parent,
+                                 nvi_t nv_size,
+                                 nova_objfn_t nv_ctor,
+                                 nova_objfn_t nv_dtor)
+{
+    const nvi_t _nv_osz = __nv_canonicalize_osz (nv_size);
+    /* The maps come out of the pool, so leave room for them and at least one
+     * object; the class also has to have a linkage in the regional heap, for
+     * when the cache goes away with live objects in it.
+     */
+    if (__builtin_expect (_nv_osz > nova_read_cfg (NV_SMOBJ_POOLSIZE) / 2
+                              || _nv_osz > UINT16_MAX
+                              || __nv_lindex (_nv_osz) >= nv_parent->nv_ln,
+                          0)) {
+#if NOVA_MODE_DEBUG
+        __nv_error (NVE_BADVAL, "nova_objcache_create(%p, %p, %zu, ...): object size too large for a small object pool.", nv_cache, nv_parent, nv_size);
+#endif
+        return nova_fail;
+    }
+
+    (*nv_cache) = malloc (sizeof (nova_objcache_t));
+    if ((*nv_cache) == NULL) {
+        return nova_fail;
+    }
+    (*nv_cache)->nv_parent_heap = nv_parent;
+    (*nv_cache)->nv_osz         = (nova_smobjsz_t)_nv_osz;
+    (*nv_cache)->nv_ctor        = nv_ctor;
+    (*nv_cache)->nv_dtor        = nv_dtor;
+    (*nv_cache)->nv_cur         = NULL;
+    (*nv_cache)->nv_blocks      = NULL;
+
+    __nv_regional_heap_incref (nv_parent);
+
+    return nova_ok;
+}
+
+/* Find a block with a free object, or take a new one; either way, it becomes
+ * nv_cur.
+ */
+static nova_res_t __nv_objcache_refill (nova_objcache_t * nv_cache)
+{
+    /* A block whose count is below its object count has a free object in one of
+     * its maps; __nv_bmblock_alloc pulls in the foreign one if needs be.
+     */
+    for (nova_block_t * _nvc = nv_cache->nv_blocks; _nvc != NULL; _nvc = _nvc->nv_lkgnx) {
+        if (_nvc != nv_cache->nv_cur
+            && __atomic_load_n (&_nvc->nv_acnt, __ATOMIC_ACQUIRE) < _nvc->nv_ocnt) {
+            nv_cache->nv_cur = _nvc;
+            return nova_ok;
+        }
+    }
+
+    /* Only empty blocks will do: anything off a sized linkage has free objects
+     * that were never constructed.
+     */
+    nova_block_t * _nv_block;
+    if (__builtin_expect (nova_ok != __nv_regional_heap_req_empty (nv_cache->nv_parent_heap, 1, &_nv_block), 0)) {
+        return nova_fail;
+    }
+    __nv_bmblock_fmt (_nv_block, nv_cache->nv_osz);
+    __atomic_store_n (&_nv_block->nv_owner, __nv_tid (), __ATOMIC_RELEASE);
+    nvmutex_unlock (&_nv_block->nv_fpgm);
+
+    /* Nobody else knows about the block yet, so the constructor runs with no
+     * locks held.
+     */
+    if (nv_cache->nv_ctor != NULL) {
+        __nv_bmblock_for_each_free (_nv_block, nv_cache->nv_ctor);
+    }
+
+    _nv_block->nv_lkgnx  = nv_cache->nv_blocks;
+    nv_cache->nv_blocks  = _nv_block;
+    nv_cache->nv_cur     = _nv_block;
+
+    return nova_ok;
+}
+
+void * nova_objcache_alloc (nova_objcache_t * nv_cache)
+{
+    void * _nv_obj;
+
+    if (__builtin_expect (nv_cache->nv_cur != NULL
+                              && nova_ok == __nv_bmblock_alloc (nv_cache->nv_cur, &_nv_obj),
+                          1)) {
+        return _nv_obj;
+    }
+    if (__builtin_expect (nova_ok != __nv_objcache_refill (nv_cache), 0)) {
+        return NULL;
+    }
+    if (__builtin_expect (nova_ok != __nv_bmblock_alloc (nv_cache->nv_cur, &_nv_obj), 0)) {
+        return NULL;
+    }
+    return _nv_obj;
+}
+
+/* Take nv_block out of the cache's hands: destroy its free objects, and make it
+ * look like any other block that a dying linkage let go of (see
+ * __nv_lkg_release_nl).
+ */
+static void __nv_objcache_let_go (nova_objcache_t * nv_cache, nova_block_t * nv_block)
+{
+    if (nv_cache->nv_dtor != NULL) {
+        __nv_bmblock_for_each_free (nv_block, nv_cache->nv_dtor);
+    }
+    __atomic_store_n (&nv_block->nv_owner, 0, __ATOMIC_RELEASE);
+}
+
+nvi_t nova_objcache_reap (nova_objcache_t * nv_cache)
+{
+    nova_block_t *_nv_first = NULL, *_nv_last = NULL;
+    nvi_t _nv_n             = 0;
+
+    /* An empty block stays empty: only we allocate from it.
+     */
+    for (nova_block_t ** _nv_link = &nv_cache->nv_blocks; *_nv_link != NULL;) {
+        nova_block_t * _nvc = *_nv_link;
+        if (_nvc == nv_cache->nv_cur || 0 != __atomic_load_n (&_nvc->nv_acnt, __ATOMIC_ACQUIRE)) {
+            _nv_link = &_nvc->nv_lkgnx;
+            continue;
+        }
+        *_nv_link = _nvc->nv_lkgnx;
+
+        __nv_objcache_let_go (nv_cache, _nvc);
+        _nvc->nv_lkgnx = _nv_first;
+        _nv_first      = _nvc;
+        if (_nv_last == NULL) {
+            _nv_last = _nvc;
+        }
+        _nv_n++;
+    }
+
+    if (_nv_first != NULL) {
+        __nv_ulkg_push (&nv_cache->nv_parent_heap->nv_lkgs[0], _nv_first, _nv_last);
+    }
+
+    return _nv_n;
+}
+
+nova_res_t nova_objcache_drop (nova_objcache_t * nv_cache)
+{
+    nova_heap_t * _nv_parent = nv_cache->nv_parent_heap;
+    nova_block_t * _nv_chain = nv_cache->nv_blocks;
+
+    for (nova_block_t * _nvc = _nv_chain; _nvc != NULL; _nvc = _nvc->nv_lkgnx) {
+#if NOVA_MODE_DEBUG
+        if (0 != __atomic_load_n (&_nvc->nv_acnt, __ATOMIC_ACQUIRE)) {
+            __nv_error (NVE_BADVAL, "nova_objcache_drop(%p): block %p still has live objects.", nv_cache, _nvc);
+        }
+#endif
+        __nv_objcache_let_go (nv_cache, _nvc);
+    }
+
+    /* Empty blocks go on the unsized linkage, the others on the sized linkage of
+     * their class, where they're as good as any other bitmap block.
+     */
+    if (_nv_chain != NULL) {
+        __nv_lkg_pass_up (_nv_parent, __nv_lindex (nv_cache->nv_osz), _nv_chain);
+    }
+
+    __nv_regional_heap_decref (_nv_parent);
+    free (nv_cache);
+
+    return nova_ok;
+}
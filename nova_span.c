@@ -0,0 +1,400 @@
+#include "nova.h"
+
+/* mmap, munmap */
+#include <sys/mman.h>
+/* sysconf */
+#include <unistd.h>
+
+/*******************************************************************************
+ * SPAN HANDLING
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Objects that don't fit in a small object pool get a span instead: a run of
+ * contiguous pools in a chunk that's set aside for spans. The run is owned by the
+ * block header of its first pool, which is flagged NOVA_BLFL_SPAN and keeps the
+ * run length in nv_ocnt; since the object starts at the base of that pool, the
+ * usual chunk-aligned lookup in __nv_dealloc_smobj lands right on the header.
+ *
+ * Each span chunk uses its pool map to track which of its pools are taken, so
+ * carving is a search for a run of zero bits, and coalescing is free: clearing
+ * the bits of a dead span merges it with whatever free runs are on either side.
+ * Once the map is empty again, the chunk goes back to the system.
+ *
+ * Spans longer than a chunk has pools get a mapping of their own instead (a
+ * "direct span"): the mapping is aligned like a chunk and starts with a chunk
+ * header, and the object starts where pool 0 would, so the lookup still lands on
+ * nv_blocks[0]. A direct span has nv_ocnt = 0, and the chunk header keeps the
+ * length of the mapping in nv_dmsz. Direct spans don't belong to any span
+ * allocator or root heap; they're unmapped as soon as they're freed.
+ */
+
+static inline nvi_t __nv_span_npools (nvi_t nv_size)
+{
+    const nvi_t _nv_plsz = nova_read_cfg (NV_SMOBJ_POOLSIZE);
+    return (nv_size + _nv_plsz - 1) / _nv_plsz;
+}
+
+/* Index of the first bit >= nv_from in the pool map that is equal to nv_set, or
+ * nv_nbits if there isn't one.
+ */
+static nvi_t __nv_pmap_next (const uint64_t * nv_map, nvi_t nv_nbits, nvi_t nv_from, int nv_set)
+{
+    if (nv_from >= nv_nbits) {
+        return nv_nbits;
+    }
+    const uint64_t _nv_flip = nv_set ? 0 : ~0ULL;
+    nvi_t _nv_w             = nv_from >> 6;
+    uint64_t _nv_bits       = (nv_map[_nv_w] ^ _nv_flip) & (~0ULL << (nv_from & 63));
+    const nvi_t _nv_nw      = (nv_nbits + 63) >> 6;
+    while (_nv_bits == 0) {
+        if (++_nv_w == _nv_nw) {
+            return nv_nbits;
+        }
+        _nv_bits = nv_map[_nv_w] ^ _nv_flip;
+    }
+    const nvi_t _nv_i = (_nv_w << 6) + __builtin_ctzll (_nv_bits);
+    return (_nv_i < nv_nbits) ? _nv_i : nv_nbits;
+}
+
+/* Set or clear [nv_first, nv_first + nv_n) in the pool map.
+ */
+static void __nv_pmap_range (uint64_t * nv_map, nvi_t nv_first, nvi_t nv_n, int nv_set)
+{
+    while (nv_n > 0) {
+        const nvi_t _nv_off  = nv_first & 63;
+        const nvi_t _nv_k    = (nv_n < 64 - _nv_off) ? nv_n : (64 - _nv_off);
+        const uint64_t _nv_m = ((_nv_k == 64) ? ~0ULL : ((1ULL << _nv_k) - 1)) << _nv_off;
+        if (nv_set) {
+            nv_map[nv_first >> 6] |= _nv_m;
+        } else {
+            nv_map[nv_first >> 6] &= ~_nv_m;
+        }
+        nv_first += _nv_k;
+        nv_n -= _nv_k;
+    }
+}
+
+/* Index of the first run of nv_npools free pools in the pool map, or nv_nbits.
+ * Skips from free run to free run, so it's linear in the number of words.
+ */
+static nvi_t __nv_span_fit (const uint64_t * nv_map, nvi_t nv_nbits, nvi_t nv_npools)
+{
+    nvi_t _nv_pos = 0;
+    while (_nv_pos < nv_nbits) {
+        const nvi_t _nv_first = __nv_pmap_next (nv_map, nv_nbits, _nv_pos, 0);
+        if (_nv_first + nv_npools > nv_nbits) {
+            break;
+        }
+        const nvi_t _nv_end = __nv_pmap_next (nv_map, nv_nbits, _nv_first, 1);
+        if (_nv_end - _nv_first >= nv_npools) {
+            return _nv_first;
+        }
+        _nv_pos = _nv_end;
+    }
+    return nv_nbits;
+}
+
+static inline nova_spa_t * __nv_heap_spa (nova_heap_t * nv_heap)
+{
+    return &NOVA_RHEAP_PFX (nv_heap)->nv_spa;
+}
+
+static inline nvi_t __nv_span_pgsz (void)
+{
+    return (nvi_t)sysconf (_SC_PAGESIZE);
+}
+
+/* Offset of the object in a direct span's mapping: the chunk header pools.
+ */
+static inline nvi_t __nv_span_dhdrsz (void)
+{
+    return nova_read_cfg (NV_CHUNK_HDRPOOLS) * nova_read_cfg (NV_SMOBJ_POOLSIZE);
+}
+
+/* Map a direct span of at least nv_size bytes.
+ */
+static nova_res_t __nv_span_map (nvi_t nv_size, void ** nv_obj)
+{
+    __nv_cfg_freeze ();
+    const nvi_t _nv_csize = nova_read_cfg (NV_CHUNKSIZE);
+    const nvi_t _nv_hdrsz = __nv_span_dhdrsz ();
+    const nvi_t _nv_pgsz  = __nv_span_pgsz ();
+    const nvi_t _nv_len   = _nv_hdrsz + ((nv_size + _nv_pgsz - 1) & ~(_nv_pgsz - 1));
+
+    /* Same over-map and trim as the arena, to get the chunk alignment.
+     */
+    uint8_t * _nv_raw = mmap (NULL, _nv_len + _nv_csize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (__builtin_expect (_nv_raw == MAP_FAILED, 0)) {
+        return nova_fail;
+    }
+    uint8_t * _nv_base = (uint8_t *)(((uintptr_t)_nv_raw + _nv_csize - 1) & ~(uintptr_t)(_nv_csize - 1));
+    if (_nv_base != _nv_raw) {
+        munmap (_nv_raw, (nvi_t)(_nv_base - _nv_raw));
+    }
+    munmap (_nv_base + _nv_len, _nv_csize - (nvi_t)(_nv_base - _nv_raw));
+
+    nova_chunk_t * _nv_chunk = (nova_chunk_t *)_nv_base;
+    _nv_chunk->nv_next       = NULL;
+    _nv_chunk->nv_spnx       = NULL;
+    _nv_chunk->nv_spheap     = NULL;
+    _nv_chunk->nv_nidle      = 0;
+    _nv_chunk->nv_dmsz       = _nv_len;
+
+    nova_block_t * _nv_block = &_nv_chunk->nv_blocks[0];
+    nv_block_init (_nv_block, _nv_base + _nv_hdrsz);
+    __atomic_store_n (&_nv_block->nv_acnt, 1, __ATOMIC_RELAXED);
+    __c11_atomic_store (&_nv_block->nv_blfl, NOVA_BLFL_SPAN, __ATOMIC_RELEASE);
+
+    *nv_obj = _nv_block->nv_base;
+    return nova_ok;
+}
+
+/* Claim [nv_first, nv_first + nv_npools) in nv_chunk and set up the header.
+ * Span allocator is locked.
+ */
+static void * __nv_span_carve_sl (nova_chunk_t * nv_chunk, nvi_t nv_first, nvi_t nv_npools)
+{
+    nova_block_t * _nv_block = &nv_chunk->nv_blocks[nv_first];
+    __nv_block_init_lazy (_nv_block);
+    __nv_pmap_range (__nv_chunk_pmap (nv_chunk), nv_first, nv_npools, 1);
+
+    _nv_block->nv_osz  = 0;
+    _nv_block->nv_ocnt = (nova_smobjcnt_t)nv_npools;
+    __atomic_store_n (&_nv_block->nv_acnt, 1, __ATOMIC_RELAXED);
+    __c11_atomic_store (&_nv_block->nv_blfl, NOVA_BLFL_SPAN, __ATOMIC_RELEASE);
+
+    return _nv_block->nv_base;
+}
+
+nova_res_t __nv_spa_init (nova_spa_t * nv_spa)
+{
+    nvmutex_init (&nv_spa->nv_spl);
+    nv_spa->nv_chunks = NULL;
+
+    return nova_ok;
+}
+
+nova_res_t __nv_span_alloc (nova_heap_t * nv_heap, nvi_t nv_size, void ** nv_obj)
+{
+    /* More than the address space could hold (and enough to overflow the pool
+     * count); that's out of memory, not a bad call.
+     */
+    if (__builtin_expect (nv_size > NOVA_SPAN_MAXSZ, 0)) {
+        return nova_fail;
+    }
+    const nvi_t _nv_npools  = __nv_span_npools (nv_size);
+    const nvi_t _nv_nblocks = nova_read_cfg (NV_CHUNK_BLOCKCOUNT);
+    if (__builtin_expect (_nv_npools == 0, 0)) {
+#if NOVA_MODE_DEBUG
+        __nv_error (NVE_BADVAL, "__nv_span_alloc(%p, %zu, %p): zero-length span.", nv_heap, nv_size, nv_obj);
+#endif
+        return nova_fail;
+    }
+    if (_nv_npools > _nv_nblocks) {
+        return __nv_span_map (nv_size, nv_obj);
+    }
+
+    nova_spa_t * _nv_spa = __nv_heap_spa (nv_heap);
+    nvmutex_lock (&_nv_spa->nv_spl);
+    for (nova_chunk_t * _nvc_chunk = _nv_spa->nv_chunks; _nvc_chunk != NULL; _nvc_chunk = _nvc_chunk->nv_spnx) {
+        const nvi_t _nv_first = __nv_span_fit (__nv_chunk_pmap (_nvc_chunk), _nv_nblocks, _nv_npools);
+        if (_nv_first < _nv_nblocks) {
+            *nv_obj = __nv_span_carve_sl (_nvc_chunk, _nv_first, _nv_npools);
+            nvmutex_unlock (&_nv_spa->nv_spl);
+            return nova_ok;
+        }
+    }
+
+    /* Nothing long enough; this is a fresh chunk, so it can't fail to fit.
+     */
+    nova_chunk_t * _nv_chunk;
+    if (__builtin_expect (nova_ok != nv_chunk_create (&_nv_chunk), 0)) {
+        nvmutex_unlock (&_nv_spa->nv_spl);
+        return nova_fail;
+    }
+    _nv_chunk->nv_spheap = nv_heap;
+    _nv_chunk->nv_spnx   = _nv_spa->nv_chunks;
+    _nv_spa->nv_chunks   = _nv_chunk;
+    *nv_obj              = __nv_span_carve_sl (_nv_chunk, 0, _nv_npools);
+    nvmutex_unlock (&_nv_spa->nv_spl);
+
+    /* The root heap is the one that gives chunks back to the system, so it needs
+     * to know about this one.
+     */
+    nova_heap_t * _nv_root = nv_heap;
+    while (_nv_root->nv_parent_heap != NULL) {
+        _nv_root = _nv_root->nv_parent_heap;
+    }
+    nv_chunk_bind_to_root (_nv_chunk, _nv_root);
+
+    return nova_ok;
+}
+
+/* Lock the span allocator that currently owns nv_chunk. The owner can change
+ * under us (when a regional heap dies, its span chunks move to its parent), so
+ * recheck after locking, same as __nv_block_lock_lkg.
+ */
+static nova_spa_t * __nv_span_lock_spa (nova_chunk_t * nv_chunk)
+{
+    while (1) {
+        nova_heap_t * _nv_heap = __atomic_load_n (&nv_chunk->nv_spheap, __ATOMIC_ACQUIRE);
+        nova_spa_t * _nv_spa   = __nv_heap_spa (_nv_heap);
+        nvmutex_lock (&_nv_spa->nv_spl);
+        if (__builtin_expect (_nv_heap == __atomic_load_n (&nv_chunk->nv_spheap, __ATOMIC_ACQUIRE), 1)) {
+            return _nv_spa;
+        }
+        nvmutex_unlock (&_nv_spa->nv_spl);
+    }
+}
+
+static inline nova_chunk_t * __nv_span_chunk (nova_block_t * nv_block)
+{
+    return (nova_chunk_t *)((uintptr_t)nv_block & ~(uintptr_t)(nova_read_cfg (NV_CHUNKSIZE) - 1));
+}
+
+nvi_t __nv_span_size (nova_block_t * nv_block)
+{
+    if (nv_block->nv_ocnt == 0) {
+        return __nv_span_chunk (nv_block)->nv_dmsz - __nv_span_dhdrsz ();
+    }
+    return (nvi_t)nv_block->nv_ocnt * nova_read_cfg (NV_SMOBJ_POOLSIZE);
+}
+
+/* Whether nothing in the span chunk is taken anymore.
+ */
+static int __nv_span_chunk_idle (nova_chunk_t * nv_chunk)
+{
+    const uint64_t * _nv_pmap = __nv_chunk_pmap (nv_chunk);
+    const nvi_t _nv_nw        = (nova_read_cfg (NV_CHUNK_BLOCKCOUNT) + 63) >> 6;
+    for (nvi_t _nv_wi = 0; _nv_wi < _nv_nw; _nv_wi++) {
+        if (_nv_pmap[_nv_wi] != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+nova_res_t __nv_span_dealloc (nova_block_t * nv_block)
+{
+    nova_chunk_t * _nv_chunk = __nv_span_chunk (nv_block);
+    const nvi_t _nv_first    = (nvi_t)(nv_block - _nv_chunk->nv_blocks);
+
+#if NOVA_MODE_DEBUG
+    if (!(__c11_atomic_load (&nv_block->nv_blfl, __ATOMIC_RELAXED) & NOVA_BLFL_SPAN)) {
+        __nv_error (NVE_BADVAL, "__nv_span_dealloc(%p): block is not a span (double free?).", nv_block);
+        return nova_fail;
+    }
+#endif
+
+    if (nv_block->nv_ocnt == 0) {
+        munmap (_nv_chunk, _nv_chunk->nv_dmsz);
+        return nova_ok;
+    }
+
+    nova_spa_t * _nv_spa = __nv_span_lock_spa (_nv_chunk);
+    __c11_atomic_store (&nv_block->nv_blfl, 0, __ATOMIC_RELAXED);
+    __atomic_store_n (&nv_block->nv_acnt, 0, __ATOMIC_RELAXED);
+    __nv_pmap_range (__nv_chunk_pmap (_nv_chunk), _nv_first, nv_block->nv_ocnt, 0);
+    if (!__nv_span_chunk_idle (_nv_chunk)) {
+        nvmutex_unlock (&_nv_spa->nv_spl);
+        return nova_ok;
+    }
+
+    /* That was the last span in the chunk: take it off the span allocator while
+     * we still hold it (so nobody can carve from it anymore), then off the root
+     * heap, and give it back.
+     */
+    for (nova_chunk_t ** _nv_link = &_nv_spa->nv_chunks; *_nv_link != NULL; _nv_link = &(*_nv_link)->nv_spnx) {
+        if (*_nv_link == _nv_chunk) {
+            *_nv_link = _nv_chunk->nv_spnx;
+            break;
+        }
+    }
+    _nv_chunk->nv_spnx     = NULL;
+    nova_heap_t * _nv_root = _nv_chunk->nv_spheap;
+    while (_nv_root->nv_parent_heap != NULL) {
+        _nv_root = _nv_root->nv_parent_heap;
+    }
+    nvmutex_unlock (&_nv_spa->nv_spl);
+
+    __nv_chunk_unbind_from_root (_nv_chunk, _nv_root);
+    __nv_chunk_destroy (_nv_chunk);
+
+    return nova_ok;
+}
+
+nova_res_t __nv_span_resize (nova_block_t * nv_block, nvi_t nv_size)
+{
+    if (__builtin_expect (nv_size > NOVA_SPAN_MAXSZ, 0)) {
+        return nova_fail;
+    }
+    const nvi_t _nv_npools   = __nv_span_npools (nv_size);
+    nova_chunk_t * _nv_chunk = __nv_span_chunk (nv_block);
+    const nvi_t _nv_first    = (nvi_t)(nv_block - _nv_chunk->nv_blocks);
+    const nvi_t _nv_have     = nv_block->nv_ocnt;
+
+    if (_nv_have == 0) {
+        /* Direct span: it can give back pages from the tail, but it can't grow,
+         * and it shouldn't stay a mapping if it would fit in a chunk now.
+         */
+        const nvi_t _nv_pgsz = __nv_span_pgsz ();
+        const nvi_t _nv_len  = __nv_span_dhdrsz () + ((nv_size + _nv_pgsz - 1) & ~(_nv_pgsz - 1));
+        if (_nv_npools <= nova_read_cfg (NV_CHUNK_BLOCKCOUNT) || _nv_len > _nv_chunk->nv_dmsz) {
+            return nova_fail;
+        }
+        if (_nv_len < _nv_chunk->nv_dmsz) {
+            munmap ((uint8_t *)_nv_chunk + _nv_len, _nv_chunk->nv_dmsz - _nv_len);
+            _nv_chunk->nv_dmsz = _nv_len;
+        }
+        return nova_ok;
+    }
+    if (_nv_npools == 0 || _nv_first + _nv_npools > nova_read_cfg (NV_CHUNK_BLOCKCOUNT)) {
+        return nova_fail;
+    }
+    if (_nv_npools == _nv_have) {
+        return nova_ok;
+    }
+
+    nova_spa_t * _nv_spa = __nv_span_lock_spa (_nv_chunk);
+    uint64_t * _nv_pmap  = __nv_chunk_pmap (_nv_chunk);
+    if (_nv_npools < _nv_have) {
+        /* Give the tail back. */
+        __nv_pmap_range (_nv_pmap, _nv_first + _nv_npools, _nv_have - _nv_npools, 0);
+    } else {
+        /* Grow into the pools right after the span, if nobody has them. */
+        if (__nv_pmap_next (_nv_pmap, _nv_first + _nv_npools, _nv_first + _nv_have, 1) < _nv_first + _nv_npools) {
+            nvmutex_unlock (&_nv_spa->nv_spl);
+            return nova_fail;
+        }
+        __nv_pmap_range (_nv_pmap, _nv_first + _nv_have, _nv_npools - _nv_have, 1);
+    }
+    nv_block->nv_ocnt = (nova_smobjcnt_t)_nv_npools;
+    nvmutex_unlock (&_nv_spa->nv_spl);
+
+    return nova_ok;
+}
+
+nova_res_t __nv_spa_pass (nova_spa_t * nv_from, nova_heap_t * nv_to)
+{
+    nova_spa_t * _nv_to = __nv_heap_spa (nv_to);
+
+    /* Parent before child, as with linkage locks. */
+    nvmutex_lock (&_nv_to->nv_spl);
+    nvmutex_lock (&nv_from->nv_spl);
+    nova_chunk_t * _nv_last = NULL;
+    for (nova_chunk_t * _nvc_chunk = nv_from->nv_chunks; _nvc_chunk != NULL; _nvc_chunk = _nvc_chunk->nv_spnx) {
+        __atomic_store_n (&_nvc_chunk->nv_spheap, nv_to, __ATOMIC_RELEASE);
+        _nv_last = _nvc_chunk;
+    }
+    if (_nv_last != NULL) {
+        _nv_last->nv_spnx  = _nv_to->nv_chunks;
+        _nv_to->nv_chunks  = nv_from->nv_chunks;
+        nv_from->nv_chunks = NULL;
+    }
+    nvmutex_unlock (&nv_from->nv_spl);
+    nvmutex_unlock (&_nv_to->nv_spl);
+
+    return nova_ok;
+}
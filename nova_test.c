@@ -1,4 +1,1163 @@
 #include "nova.h"
+#include "nova_inline.h"
+
+/* printf, fprintf */
+#include <stdio.h>
+/* EXIT_SUCCESS, EXIT_FAILURE, qsort */
+#include <stdlib.h>
+/* memset, memcpy */
+#include <string.h>
+
+/*******************************************************************************
+ * TEST HARNESS
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* One behaviour test per feature, run in order against a shared root and
+ * regional heap (some tests make their own, where they need to count chunks or
+ * blocks without the others getting in the way).
+ *
+ * The configuration test runs first, since the chunk geometry is fixed once the
+ * first chunk exists.
+ *
+ * Failed checks are reported and counted; the test carries on unless it can't
+ * (NVT_REQUIRE).
+ */
+
+static int _nvt_failures = 0;
+
+#define NVT_CHECK(___nv_expr___)                                                                     \
+    do {                                                                                             \
+        if (!(___nv_expr___)) {                                                                      \
+            fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #___nv_expr___);       \
+            _nvt_failures++;                                                                         \
+        }                                                                                            \
+    } while (0)
+#define NVT_REQUIRE(___nv_expr___)                                                                   \
+    do {                                                                                             \
+        if (!(___nv_expr___)) {                                                                      \
+            fprintf (stderr, "%s:%d: requirement failed: %s\n", __FILE__, __LINE__, #___nv_expr___); \
+            _nvt_failures++;                                                                         \
+            return;                                                                                  \
+        }                                                                                            \
+    } while (0)
+
+static nova_heap_t * _nvt_root;
+static nova_heap_t * _nvt_reg;
+
+/* Regional heap under `nv_root`, with a reference of its own so that it
+ * outlives the local heaps dropped under it.
+ */
+static nova_heap_t * __nvt_regional (nova_heap_t * nv_root)
+{
+    nova_heap_t * _nv_reg;
+    if (nova_ok != __nv_regional_heap_create (&_nv_reg)) {
+        return NULL;
+    }
+    nv_heap_bind_parent (_nv_reg, nv_root);
+    __nv_regional_heap_incref (nv_root);
+    __nv_regional_heap_incref (_nv_reg);
+    return _nv_reg;
+}
+
+static nova_heap_t * __nvt_local (nova_heap_t * nv_reg)
+{
+    nova_heap_t * _nv_heap;
+    if (nova_ok != nv_heap_create (&_nv_heap)) {
+        return NULL;
+    }
+    nv_heap_bind_parent (_nv_heap, nv_reg);
+    __nv_regional_heap_incref (nv_reg);
+    return _nv_heap;
+}
+
+static nvi_t __nvt_nchunks (nova_heap_t * nv_root)
+{
+    nvi_t _nv_n = 0;
+    for (nova_chunk_t * _nvc = NOVA_RHEAP_PFX (nv_root)->nv_chunks; _nvc != NULL; _nvc = _nvc->nv_next) {
+        _nv_n++;
+    }
+    return _nv_n;
+}
+
+static nvi_t __nvt_ulkg_count (nova_lkg_t * nv_lkg)
+{
+    nvi_t _nv_n = 0;
+    for (nova_block_t * _nvc = (nova_block_t *)(__atomic_load_n (&nv_lkg->nv_uhead, __ATOMIC_ACQUIRE) & NOVA_ULKG_PTRMASK);
+         _nvc != NULL;
+         _nvc = _nvc->nv_lkgnx) {
+        _nv_n++;
+    }
+    return _nv_n;
+}
+
+/* Blocks on a sized linkage of a regional heap, chained from nv_head. */
+static nvi_t __nvt_rlkg_count (nova_lkg_t * nv_lkg)
+{
+    nvi_t _nv_n = 0;
+    for (nova_block_t * _nvc = nv_lkg->nv_head; _nvc != NULL; _nvc = _nvc->nv_lkgnx) {
+        _nv_n++;
+    }
+    return _nv_n;
+}
+
+static int __nvt_ptrcmp (const void * nv_a, const void * nv_b)
+{
+    const uintptr_t _nv_a = *(const uintptr_t *)nv_a, _nv_b = *(const uintptr_t *)nv_b;
+    return _nv_a < _nv_b ? -1 : _nv_a > _nv_b;
+}
+
+/* Whether the `nv_n` objects of `nv_objs` are all distinct; sorts a copy. */
+static int __nvt_distinct (void ** nv_objs, nvi_t nv_n)
+{
+    void ** _nv_sorted = malloc (nv_n * sizeof (void *));
+    memcpy (_nv_sorted, nv_objs, nv_n * sizeof (void *));
+    qsort (_nv_sorted, nv_n, sizeof (void *), __nvt_ptrcmp);
+    int _nv_ok = 1;
+    for (nvi_t _nv_i = 1; _nv_i < nv_n; _nv_i++) {
+        if (_nv_sorted[_nv_i] == _nv_sorted[_nv_i - 1]) {
+            _nv_ok = 0;
+        }
+    }
+    free (_nv_sorted);
+    return _nv_ok;
+}
+
+typedef struct nvt_frees
+{
+    void ** nv_objs;
+    nvi_t nv_n;
+    nvi_t nv_stride;
+} nvt_frees_t;
+
+/* Frees every nv_stride'th object of nv_objs from a thread of its own, i.e.
+ * through the foreign path.
+ */
+static void * __nvt_free_thread (void * nv_arg)
+{
+    nvt_frees_t * _nv_f = nv_arg;
+    __nv_tid_thread_init ();
+    for (nvi_t _nv_i = 0; _nv_i < _nv_f->nv_n; _nv_i += _nv_f->nv_stride) {
+        nova_free (_nv_f->nv_objs[_nv_i]);
+        _nv_f->nv_objs[_nv_i] = NULL;
+    }
+    __nv_tid_thread_drop ();
+    return NULL;
+}
+
+static void __nvt_free_remotely (void ** nv_objs, nvi_t nv_n, nvi_t nv_stride)
+{
+    nvt_frees_t _nv_f = { nv_objs, nv_n, nv_stride };
+    pthread_t _nv_th;
+    pthread_create (&_nv_th, NULL, __nvt_free_thread, &_nv_f);
+    pthread_join (_nv_th, NULL);
+}
+
+/*******************************************************************************
+ * TESTS
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+#define NVT_N 4096
+
+static void * _nvt_objs[NVT_N];
+static void * _nvt_objs2[NVT_N];
+
+/* user-031 */
+static void nvt_cfg_geometry (void)
+{
+    const nvi_t _nv_csize = nova_read_cfg (NV_CHUNKSIZE);
+    const nvi_t _nv_plsz  = nova_read_cfg (NV_SMOBJ_POOLSIZE);
+
+    /* Invalid geometry and derived parameters are refused (errors expected).
+     */
+    NVT_CHECK (nova_fail == nova_set_cfg (NV_SMOBJ_POOLSIZE, 3000));
+    NVT_CHECK (nova_fail == nova_set_cfg (NV_CHUNK_BLOCKCOUNT, 10));
+    NVT_CHECK (nova_read_cfg (NV_SMOBJ_POOLSIZE) == _nv_plsz);
+
+    NVT_CHECK (nova_ok == nova_set_cfg (NV_CHUNKSIZE, _nv_csize));
+    NVT_CHECK (nova_ok == nova_set_cfg (NV_SMOBJ_POOLSIZE, _nv_plsz));
+    const nvi_t _nv_hdr = nova_read_cfg (NV_CHUNK_HDRPOOLS);
+    const nvi_t _nv_nb  = nova_read_cfg (NV_CHUNK_BLOCKCOUNT);
+    NVT_CHECK (_nv_hdr + _nv_nb == _nv_csize / _nv_plsz);
+    NVT_CHECK (_nv_hdr * _nv_plsz >= sizeof (nova_chunk_t) + _nv_nb * sizeof (nova_block_t));
+
+    /* The geometry is fixed once there's a chunk; the pool count isn't.
+     */
+    nova_chunk_t * _nv_chunk;
+    NVT_REQUIRE (nova_ok == nv_chunk_create (&_nv_chunk));
+    NVT_CHECK (nova_fail == nova_set_cfg (NV_CHUNKSIZE, _nv_csize * 2));
+    NVT_CHECK (nova_fail == nova_set_cfg (NV_SMOBJ_POOLSIZE, _nv_plsz / 2));
+    NVT_CHECK (nova_read_cfg (NV_CHUNKSIZE) == _nv_csize && nova_read_cfg (NV_SMOBJ_POOLSIZE) == _nv_plsz);
+    __nv_chunk_destroy (_nv_chunk);
+
+    /* Heaps made after the pool count goes up don't get more linkages than
+     * their parents.
+     */
+    const nvi_t _nv_ln = nova_read_cfg (NV_SMOBJ_POOLCOUNT);
+    nova_heap_t *_nv_root, *_nv_reg, *_nv_heap;
+    NVT_REQUIRE (nova_ok == __nv_root_heap_create (&_nv_root));
+    NVT_REQUIRE (nova_ok == nova_set_cfg (NV_SMOBJ_POOLCOUNT, _nv_ln + 2));
+    NVT_REQUIRE ((_nv_reg = __nvt_regional (_nv_root)) != NULL && (_nv_heap = __nvt_local (_nv_reg)) != NULL);
+    NVT_CHECK (nova_ok == nova_set_cfg (NV_SMOBJ_POOLCOUNT, _nv_ln));
+    NVT_CHECK (_nv_reg->nv_ln == _nv_ln && _nv_heap->nv_ln == _nv_ln);
+    void * _nv_obj = nova_alloc (_nv_heap, _nv_plsz);
+    NVT_CHECK (_nv_obj != NULL && nova_usable_size (_nv_obj) >= _nv_plsz);
+    nova_free (_nv_obj);
+    __nv_local_heap_drop (_nv_heap);
+}
+
+/* user-026 */
+static void nvt_aligned_alloc (void)
+{
+    nova_heap_t * _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+
+    for (nvi_t _nv_align = 8; _nv_align <= 16384; _nv_align <<= 1) {
+        void * _nv_obj = nova_memalign (_nv_heap, _nv_align, 24);
+        NVT_CHECK (_nv_obj != NULL && ((uintptr_t)_nv_obj & (_nv_align - 1)) == 0);
+        nova_free (_nv_obj);
+    }
+    void * _nv_line = nova_alloc_flags (_nv_heap, 8, NOVA_ALLOC_CACHELINE);
+    NVT_CHECK (_nv_line != NULL && ((uintptr_t)_nv_line & (NOVA_CACHELINE - 1)) == 0);
+    NVT_CHECK (nova_usable_size (_nv_line) == NOVA_CACHELINE);
+    nova_free (_nv_line);
+
+    __nv_local_heap_drop (_nv_heap);
+}
+
+/* user-027 */
+static void nvt_realloc (void)
+{
+    nova_heap_t * _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+
+    unsigned char * _nv_obj = nova_alloc (_nv_heap, 100);
+    NVT_REQUIRE (_nv_obj != NULL);
+    NVT_CHECK (nova_usable_size (_nv_obj) == 128);
+    memset (_nv_obj, 0x11, 100);
+
+    /* Same class: stays put. */
+    NVT_CHECK (nova_realloc (_nv_heap, _nv_obj, 128) == _nv_obj);
+    NVT_CHECK (nova_realloc (_nv_heap, _nv_obj, 65) == _nv_obj);
+    /* Larger class: moves, and takes the contents along. */
+    unsigned char * _nv_moved = nova_realloc (_nv_heap, _nv_obj, 1000);
+    NVT_REQUIRE (_nv_moved != NULL);
+    NVT_CHECK (_nv_moved != _nv_obj && _nv_moved[0] == 0x11 && _nv_moved[99] == 0x11);
+    NVT_CHECK (nova_usable_size (_nv_moved) >= 1000);
+    /* Too large to ever fit: fails, and the object is left alone. */
+    NVT_CHECK (nova_realloc (_nv_heap, _nv_moved, (nvi_t)-1) == NULL && _nv_moved[99] == 0x11);
+    nova_free (_nv_moved);
+
+    /* NULL allocates. */
+    void * _nv_new = nova_realloc (_nv_heap, NULL, 40);
+    NVT_CHECK (_nv_new != NULL && nova_usable_size (_nv_new) == 64);
+    nova_free (_nv_new);
+
+    __nv_local_heap_drop (_nv_heap);
+}
+
+/* user-028 */
+static void nvt_occupancy_bins (void)
+{
+    nova_heap_t * _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+    nova_lkg_t * _nv_lkg = &_nv_heap->nv_lkgs[__nv_lindex (64)];
+
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        _nvt_objs[_nv_i] = nova_alloc (_nv_heap, 64);
+        NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+    }
+    /* The first object's block has long stopped being the head, and is full.
+     */
+    nova_block_t * _nv_block = __nv_smobj_block (_nvt_objs[0]);
+    NVT_REQUIRE (_nv_block != _nv_lkg->nv_head);
+    const nvi_t _nv_ocnt = _nv_block->nv_ocnt;
+    NVT_CHECK (((_nv_block->nv_blfl & NOVA_BLFL_BINMASK) >> NOVA_BLFL_BINSHIFT) == NOVA_LKG_BIN_FULL);
+
+    /* Drain it below half: it moves down to the LO bin... */
+    nvi_t _nv_live = _nv_ocnt;
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N && 2 * _nv_live >= _nv_ocnt; _nv_i++) {
+        if (_nvt_objs[_nv_i] != NULL && __nv_smobj_block (_nvt_objs[_nv_i]) == _nv_block) {
+            nova_free (_nvt_objs[_nv_i]);
+            _nvt_objs[_nv_i] = NULL;
+            _nv_live--;
+        }
+    }
+    NVT_CHECK ((_nv_block->nv_blfl & NOVA_BLFL_BINNED) != 0);
+    NVT_CHECK (((_nv_block->nv_blfl & NOVA_BLFL_BINMASK) >> NOVA_BLFL_BINSHIFT) == NOVA_LKG_BIN_LO);
+    NVT_CHECK (_nv_lkg->nv_bins[NOVA_LKG_BIN_LO] != NULL);
+
+    /* ...and leaves the linkage once it's empty. */
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        if (_nvt_objs[_nv_i] != NULL && __nv_smobj_block (_nvt_objs[_nv_i]) == _nv_block) {
+            nova_free (_nvt_objs[_nv_i]);
+            _nvt_objs[_nv_i] = NULL;
+        }
+    }
+    NVT_CHECK (_nv_block->nv_lkg != _nv_lkg);
+    for (nvi_t _nv_bi = 0; _nv_bi < NOVA_LKG_NBINS; _nv_bi++) {
+        for (nova_block_t * _nvc = _nv_lkg->nv_bins[_nv_bi]; _nvc != NULL; _nvc = _nvc->nv_lkgnx) {
+            NVT_CHECK (_nvc != _nv_block);
+        }
+    }
+
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        nova_free (_nvt_objs[_nv_i]);
+    }
+    __nv_local_heap_drop (_nv_heap);
+}
+
+/* user-029 */
+static void nvt_bitmap_blocks (void)
+{
+    nova_heap_t * _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+
+    NVT_REQUIRE (NVT_N == nova_alloc_bulk (_nv_heap, 8, _nvt_objs, NVT_N));
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        NVT_CHECK (((uintptr_t)_nvt_objs[_nv_i] & 7) == 0);
+        NVT_CHECK (__nv_smobj_block (_nvt_objs[_nv_i])->nv_blfl & NOVA_BLFL_BITMAP);
+        *(uint64_t *)_nvt_objs[_nv_i] = _nv_i;
+    }
+    NVT_CHECK (__nvt_distinct (_nvt_objs, NVT_N));
+
+    /* A quarter goes through the foreign map, a quarter through the local one.
+     */
+    __nvt_free_remotely (_nvt_objs, NVT_N, 4);
+    for (nvi_t _nv_i = 1; _nv_i < NVT_N; _nv_i += 4) {
+        nova_free (_nvt_objs[_nv_i]);
+        _nvt_objs[_nv_i] = NULL;
+    }
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        NVT_CHECK (_nvt_objs[_nv_i] == NULL || *(uint64_t *)_nvt_objs[_nv_i] == _nv_i);
+    }
+
+    /* Freed slots get handed out again, and never a live one. */
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        if (_nvt_objs[_nv_i] == NULL) {
+            _nvt_objs[_nv_i] = nova_alloc (_nv_heap, 8);
+            NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+            *(uint64_t *)_nvt_objs[_nv_i] = _nv_i;
+        }
+    }
+    NVT_CHECK (__nvt_distinct (_nvt_objs, NVT_N));
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        NVT_CHECK (*(uint64_t *)_nvt_objs[_nv_i] == _nv_i);
+    }
+    nova_free_bulk (_nvt_objs, NVT_N);
+
+    __nv_local_heap_drop (_nv_heap);
+}
+
+/* user-030 */
+static void nvt_spans (void)
+{
+    nova_heap_t * _nv_reg  = __nvt_regional (_nvt_root);
+    nova_heap_t * _nv_heap = __nvt_local (_nv_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+    const nvi_t _nv_base = __nvt_nchunks (_nvt_root);
+
+    /* Medium objects: spans in span chunks, which go back once empty. */
+    void * _nv_mid[24];
+    for (nvi_t _nv_i = 0; _nv_i < 24; _nv_i++) {
+        const nvi_t _nv_sz = 20000 + _nv_i * 9000;
+        _nv_mid[_nv_i]     = nova_alloc (_nv_heap, _nv_sz);
+        NVT_REQUIRE (_nv_mid[_nv_i] != NULL);
+        NVT_CHECK (nova_usable_size (_nv_mid[_nv_i]) >= _nv_sz);
+        memset (_nv_mid[_nv_i], (int)_nv_i, _nv_sz);
+    }
+    NVT_CHECK (NOVA_RHEAP_PFX (_nv_reg)->nv_spa.nv_chunks != NULL);
+    NVT_CHECK (__nvt_nchunks (_nvt_root) > _nv_base);
+    for (nvi_t _nv_i = 0; _nv_i < 24; _nv_i++) {
+        NVT_CHECK (((unsigned char *)_nv_mid[_nv_i])[19999] == _nv_i);
+        nova_free (_nv_mid[_nv_i]);
+    }
+    NVT_CHECK (NOVA_RHEAP_PFX (_nv_reg)->nv_spa.nv_chunks == NULL);
+    NVT_CHECK (__nvt_nchunks (_nvt_root) == _nv_base);
+
+    /* Spans grow and shrink in place while the pools behind them are free. */
+    unsigned char * _nv_obj = nova_alloc (_nv_heap, 100000);
+    NVT_REQUIRE (_nv_obj != NULL);
+    memset (_nv_obj, 7, 100000);
+    NVT_CHECK (nova_realloc (_nv_heap, _nv_obj, 200000) == _nv_obj && _nv_obj[99999] == 7);
+    NVT_CHECK (nova_realloc (_nv_heap, _nv_obj, 70000) == _nv_obj);
+    nova_free (_nv_obj);
+
+    /* Larger than a chunk: mapped directly, no chunk involved. */
+    _nv_obj = nova_alloc (_nv_heap, 3 << 20);
+    NVT_REQUIRE (_nv_obj != NULL);
+    NVT_CHECK (nova_usable_size (_nv_obj) >= (3 << 20));
+    NVT_CHECK (__nvt_nchunks (_nvt_root) == _nv_base);
+    memset (_nv_obj, 9, 3 << 20);
+    NVT_CHECK (nova_realloc (_nv_heap, _nv_obj, (2 << 20) + 5) == _nv_obj && _nv_obj[(2 << 20) + 4] == 9);
+    nova_free (_nv_obj);
+
+    /* Past the largest span: refused, not rounded into garbage.
+     */
+    const nvi_t _nv_huge[] = { (nvi_t)-1, ((nvi_t)1 << 63) + 1, NOVA_SPAN_MAXSZ + 8 };
+    for (nvi_t _nv_i = 0; _nv_i < sizeof _nv_huge / sizeof _nv_huge[0]; _nv_i++) {
+        NVT_CHECK (__nv_lindex (_nv_huge[_nv_i]) == ~(nvi_t)0);
+        NVT_CHECK (__nv_canonicalize_osz (_nv_huge[_nv_i]) == _nv_huge[_nv_i]);
+        NVT_CHECK (nova_alloc (_nv_heap, _nv_huge[_nv_i]) == NULL);
+        NVT_CHECK (nova_memalign (_nv_heap, 64, _nv_huge[_nv_i]) == NULL);
+    }
+    _nv_obj = nova_alloc (_nv_heap, 100000);
+    NVT_CHECK (nova_realloc (_nv_heap, _nv_obj, NOVA_SPAN_MAXSZ + 8) == NULL);
+    nova_free (_nv_obj);
+
+    __nv_local_heap_drop (_nv_heap);
+}
+
+/* user-032 */
+static void nvt_arena (void)
+{
+    const nvi_t _nv_csize = nova_read_cfg (NV_CHUNKSIZE);
+    nova_chunk_t *_nv_a, *_nv_b;
+    NVT_REQUIRE (nova_ok == nv_chunk_create (&_nv_a));
+    NVT_REQUIRE (nova_ok == nv_chunk_create (&_nv_b));
+    NVT_CHECK (_nv_a != _nv_b);
+    NVT_CHECK (__nv_arena_owns (_nv_a) && __nv_arena_owns (_nv_b));
+    NVT_CHECK (((uintptr_t)_nv_a & (_nv_csize - 1)) == 0 && ((uintptr_t)_nv_b & (_nv_csize - 1)) == 0);
+    NVT_CHECK (!__nv_arena_owns (&_nvt_failures));
+    /* Chunks are committed: every page can be written. */
+    memset ((uint8_t *)_nv_a + _nv_csize / 2, 1, _nv_csize / 2);
+    __nv_chunk_destroy (_nv_a);
+    __nv_chunk_destroy (_nv_b);
+
+    /* Released chunks are reused before more address space is reserved. */
+    nova_chunk_t * _nv_c;
+    NVT_REQUIRE (nova_ok == nv_chunk_create (&_nv_c));
+    NVT_CHECK (_nv_c == _nv_a || _nv_c == _nv_b);
+    __nv_chunk_destroy (_nv_c);
+}
+
+/* user-033 */
+static void nvt_chunk_release (void)
+{
+    nova_heap_t * _nv_reg = __nvt_regional (_nvt_root);
+    NVT_REQUIRE (_nv_reg != NULL);
+    const nvi_t _nv_nb = nova_read_cfg (NV_CHUNK_BLOCKCOUNT);
+
+    nova_chunk_t * _nv_chunk;
+    NVT_REQUIRE (nova_ok == nv_chunk_create (&_nv_chunk));
+    /* Headers are set up on first use. */
+    NVT_CHECK (_nv_chunk->nv_blocks[0].nv_base == NULL);
+
+    /* The whole chunk goes on as one chain, in order. */
+    NVT_CHECK (nova_ok == __nv_chunk_release_blocks_to (_nv_chunk, _nv_reg, 0, _nv_nb));
+    NVT_CHECK (__nvt_ulkg_count (&_nv_reg->nv_lkgs[0]) == _nv_nb);
+    nova_block_t * _nv_chain;
+    NVT_CHECK (__nv_ulkg_pop (&_nv_reg->nv_lkgs[0], NOVA_ULKG_ALL, &_nv_chain) == _nv_nb);
+    nvi_t _nv_i = 0;
+    for (nova_block_t * _nvc = _nv_chain; _nvc != NULL; _nvc = _nvc->nv_lkgnx, _nv_i++) {
+        NVT_CHECK (_nvc == &_nv_chunk->nv_blocks[_nv_i]);
+        NVT_CHECK (_nvc->nv_owner == __nv_tid ());
+    }
+    NVT_CHECK (_nv_i == _nv_nb);
+    __nv_chunk_destroy (_nv_chunk);
+}
+
+/* user-034 */
+static void nvt_refill_batches (void)
+{
+    nova_heap_t * _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+    nova_lkg_t * _nv_lkg = &_nv_heap->nv_lkgs[__nv_lindex (64)];
+    NVT_CHECK (_nv_lkg->nv_rfdmd == 1);
+
+    /* A burst makes the linkage ask for more blocks at a time, and the extras
+     * get parked on the heap's unsized linkage.
+     */
+    nvi_t _nv_n = 0;
+    while (_nv_n < NVT_N && __nvt_ulkg_count (&_nv_heap->nv_lkgs[0]) == 0) {
+        _nvt_objs[_nv_n] = nova_alloc (_nv_heap, 64);
+        NVT_REQUIRE (_nvt_objs[_nv_n] != NULL);
+        _nv_n++;
+    }
+    NVT_CHECK (_nv_lkg->nv_rfdmd > 1 && _nv_lkg->nv_rfdmd <= NOVA_REFILL_MAXBATCH);
+    const nvi_t _nv_parked = __nvt_ulkg_count (&_nv_heap->nv_lkgs[0]);
+    NVT_REQUIRE (_nv_parked > 0);
+
+    /* Another class refills from the parked blocks, without going upstream. */
+    void * _nv_other = nova_alloc (_nv_heap, 512);
+    NVT_CHECK (_nv_other != NULL);
+    NVT_CHECK (__nvt_ulkg_count (&_nv_heap->nv_lkgs[0]) == _nv_parked - 1);
+    nova_free (_nv_other);
+
+    for (nvi_t _nv_i = 0; _nv_i < _nv_n; _nv_i++) {
+        nova_free (_nvt_objs[_nv_i]);
+    }
+    __nv_local_heap_drop (_nv_heap);
+}
+
+#define NVT_STACK_THREADS 4
+
+typedef struct nvt_stack
+{
+    nova_lkg_t * nv_lkg;
+    nvi_t nv_rounds;
+} nvt_stack_t;
+
+static void * __nvt_stack_thread (void * nv_arg)
+{
+    nvt_stack_t * _nv_s = nv_arg;
+    for (nvi_t _nv_r = 0; _nv_r < _nv_s->nv_rounds; _nv_r++) {
+        nova_block_t * _nv_chain;
+        const nvi_t _nv_n = __nv_ulkg_pop (_nv_s->nv_lkg, 1 + (_nv_r & 3), &_nv_chain);
+        if (_nv_n == 0) {
+            continue;
+        }
+        nova_block_t * _nv_last = _nv_chain;
+        while (_nv_last->nv_lkgnx != NULL) {
+            _nv_last = _nv_last->nv_lkgnx;
+        }
+        __nv_ulkg_push (_nv_s->nv_lkg, _nv_chain, _nv_last);
+    }
+    return NULL;
+}
+
+/* user-035 */
+static void nvt_ulkg_stack (void)
+{
+    nova_heap_t * _nv_reg = __nvt_regional (_nvt_root);
+    NVT_REQUIRE (_nv_reg != NULL);
+    const nvi_t _nv_nb = nova_read_cfg (NV_CHUNK_BLOCKCOUNT);
+    nova_chunk_t * _nv_chunk;
+    NVT_REQUIRE (nova_ok == nv_chunk_create (&_nv_chunk));
+    __nv_chunk_release_blocks_to (_nv_chunk, _nv_reg, 0, _nv_nb);
+
+    /* Concurrent pushes and pops neither lose nor duplicate blocks. */
+    nvt_stack_t _nv_s = { &_nv_reg->nv_lkgs[0], 20000 };
+    pthread_t _nv_th[NVT_STACK_THREADS];
+    for (nvi_t _nv_i = 0; _nv_i < NVT_STACK_THREADS; _nv_i++) {
+        pthread_create (&_nv_th[_nv_i], NULL, __nvt_stack_thread, &_nv_s);
+    }
+    for (nvi_t _nv_i = 0; _nv_i < NVT_STACK_THREADS; _nv_i++) {
+        pthread_join (_nv_th[_nv_i], NULL);
+    }
+
+    nova_block_t * _nv_chain;
+    NVT_CHECK (__nv_ulkg_pop (&_nv_reg->nv_lkgs[0], NOVA_ULKG_ALL, &_nv_chain) == _nv_nb);
+    uint64_t _nv_seen[(_nv_nb + 63) / 64];
+    memset (_nv_seen, 0, sizeof _nv_seen);
+    for (nova_block_t * _nvc = _nv_chain; _nvc != NULL; _nvc = _nvc->nv_lkgnx) {
+        const nvi_t _nv_bi = _nvc - _nv_chunk->nv_blocks;
+        NVT_REQUIRE (_nv_bi < _nv_nb);
+        NVT_CHECK (!(_nv_seen[_nv_bi / 64] & ((uint64_t)1 << (_nv_bi % 64))));
+        _nv_seen[_nv_bi / 64] |= (uint64_t)1 << (_nv_bi % 64);
+    }
+    NVT_CHECK (__nvt_ulkg_count (&_nv_reg->nv_lkgs[0]) == 0);
+    __nv_chunk_destroy (_nv_chunk);
+}
+
+/* user-036 */
+static void nvt_steal (void)
+{
+    nova_heap_t * _nv_reg = __nvt_regional (_nvt_root);
+    nova_heap_t * _nv_a   = __nvt_local (_nv_reg);
+    nova_heap_t * _nv_b   = __nvt_local (_nv_reg);
+    NVT_REQUIRE (_nv_a != NULL && _nv_b != NULL);
+    const nvi_t _nv_li = __nv_lindex (64);
+
+    /* A is left with a pile of mostly empty blocks... */
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        _nvt_objs[_nv_i] = nova_alloc (_nv_a, 64);
+        NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+    }
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        if (_nv_i % 4) {
+            nova_free (_nvt_objs[_nv_i]);
+            _nvt_objs[_nv_i] = NULL;
+        }
+    }
+    NVT_REQUIRE (_nv_a->nv_lkgs[_nv_li].nv_bins[NOVA_LKG_BIN_LO] != NULL);
+
+    /* ...which its sibling takes one of, rather than going upstream. */
+    void * _nv_obj = nova_alloc (_nv_b, 64);
+    NVT_REQUIRE (_nv_obj != NULL);
+    nova_block_t * _nv_block = __nv_smobj_block (_nv_obj);
+    NVT_CHECK (_nv_block->nv_lkg == &_nv_b->nv_lkgs[_nv_li]);
+    int _nv_was_as = 0;
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i += 4) {
+        _nv_was_as |= __nv_smobj_block (_nvt_objs[_nv_i]) == _nv_block;
+    }
+    NVT_CHECK (_nv_was_as);
+
+    /* The objects A still had in the block are fine, and can still be freed. */
+    nova_free (_nv_obj);
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i += 4) {
+        nova_free (_nvt_objs[_nv_i]);
+    }
+    __nv_local_heap_drop (_nv_a);
+    __nv_local_heap_drop (_nv_b);
+}
+
+/* user-037 */
+static void nvt_trim (void)
+{
+    nova_heap_t * _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+    const nvi_t _nv_li = __nv_lindex (64);
+
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        _nvt_objs[_nv_i] = nova_alloc (_nv_heap, 64);
+        NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+        memset (_nvt_objs[_nv_i], (int)(_nv_i & 0xff), 64);
+    }
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        if (_nv_i % 8) {
+            nova_free (_nvt_objs[_nv_i]);
+            _nvt_objs[_nv_i] = NULL;
+        }
+    }
+    NVT_REQUIRE (_nv_heap->nv_lkgs[_nv_li].nv_bins[NOVA_LKG_BIN_LO] != NULL);
+
+    NVT_CHECK (nova_heap_trim (_nv_heap, NOVA_TRIM_EMPTY | NOVA_TRIM_SPARSE) > 0);
+    NVT_CHECK (_nv_heap->nv_lkgs[_nv_li].nv_bins[NOVA_LKG_BIN_LO] == NULL);
+    NVT_CHECK (__nvt_ulkg_count (&_nv_heap->nv_lkgs[0]) == 0);
+
+    /* Objects in trimmed blocks are untouched, and freed through the parent. */
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i += 8) {
+        NVT_CHECK (*(unsigned char *)_nvt_objs[_nv_i] == (_nv_i & 0xff));
+        nova_free (_nvt_objs[_nv_i]);
+    }
+    /* The heap is still good to allocate from. */
+    void * _nv_obj = nova_alloc (_nv_heap, 64);
+    NVT_CHECK (_nv_obj != NULL);
+    nova_free (_nv_obj);
+    __nv_local_heap_drop (_nv_heap);
+}
+
+/* user-038 */
+static void nvt_reclaim (void)
+{
+    nova_heap_t * _nv_root;
+    NVT_REQUIRE (nova_ok == __nv_root_heap_create (&_nv_root));
+    nova_heap_t * _nv_reg  = __nvt_regional (_nv_root);
+    nova_heap_t * _nv_heap = __nvt_local (_nv_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        _nvt_objs[_nv_i] = nova_alloc (_nv_heap, 4096);
+        NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+    }
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        nova_free (_nvt_objs[_nv_i]);
+    }
+    nova_heap_trim (_nv_heap, NOVA_TRIM_EMPTY | NOVA_TRIM_SPARSE);
+    nova_block_t * _nv_chain;
+    if (__nv_ulkg_pop (&_nv_reg->nv_lkgs[0], NOVA_ULKG_ALL, &_nv_chain) > 0) {
+        nova_block_t * _nv_last = _nv_chain;
+        while (_nv_last->nv_lkgnx != NULL) {
+            _nv_last = _nv_last->nv_lkgnx;
+        }
+        __nv_ulkg_push (&_nv_root->nv_lkgs[0], _nv_chain, _nv_last);
+    }
+
+    /* Idle chunks beyond the ones kept go back; the blocks on the stack stay
+     * where they are, to be dropped as they come off it.
+     */
+    const nvi_t _nv_chunks = __nvt_nchunks (_nv_root);
+    const nvi_t _nv_stack  = __nvt_ulkg_count (&_nv_root->nv_lkgs[0]);
+    const nvi_t _nv_rel    = nova_reclaim (_nv_root, 1);
+    NVT_CHECK (_nv_rel > 0 && _nv_rel + 1 <= _nv_chunks);
+    NVT_CHECK (__nvt_ulkg_count (&_nv_root->nv_lkgs[0]) == _nv_stack);
+    for (nova_chunk_t * _nvc = NOVA_RHEAP_PFX (_nv_root)->nv_chunks; _nvc != NULL; _nvc = _nvc->nv_next) {
+        const nvi_t _nv_idle = _nvc->nv_nidle & ~NOVA_CHUNK_DYING;
+        nvi_t _nv_on_stack   = 0;
+        for (nova_block_t * _nvb = (nova_block_t *)(_nv_root->nv_lkgs[0].nv_uhead & NOVA_ULKG_PTRMASK); _nvb != NULL; _nvb = _nvb->nv_lkgnx) {
+            _nv_on_stack += ((uintptr_t)_nvb & ~(uintptr_t)(nova_read_cfg (NV_CHUNKSIZE) - 1)) == (uintptr_t)_nvc;
+        }
+        NVT_CHECK (_nv_idle == _nv_on_stack);
+    }
+
+    /* Refills skip the released chunks' blocks, and take the chunks along. */
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        _nvt_objs[_nv_i] = nova_alloc (_nv_heap, 4096);
+        NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+        memset (_nvt_objs[_nv_i], 1, 4096);
+    }
+    NVT_CHECK (__nvt_nchunks (_nv_root) < _nv_chunks + _nv_rel);
+    for (nova_chunk_t * _nvc = NOVA_RHEAP_PFX (_nv_root)->nv_chunks; _nvc != NULL; _nvc = _nvc->nv_next) {
+        NVT_CHECK (_nvc->nv_nidle != NOVA_CHUNK_DYING);
+    }
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        nova_free (_nvt_objs[_nv_i]);
+    }
+    __nv_local_heap_drop (_nv_heap);
+}
+
+/* user-039 */
+static void nvt_drop_splice (void)
+{
+    nova_heap_t * _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+    nova_lkg_t * _nv_rlkg = &_nvt_reg->nv_lkgs[__nv_lindex (64)];
+
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        _nvt_objs[_nv_i] = nova_alloc (_nv_heap, 64);
+        NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+        memset (_nvt_objs[_nv_i], 0x39, 64);
+    }
+    /* Live blocks (full ones included) land on the regional linkage. */
+    const nvi_t _nv_before = __nvt_rlkg_count (_nv_rlkg);
+    __nv_local_heap_drop (_nv_heap);
+    NVT_CHECK (__nvt_rlkg_count (_nv_rlkg) > _nv_before);
+
+    /* A new heap's refills never hand out a live object. */
+    _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        _nvt_objs2[_nv_i] = nova_alloc (_nv_heap, 64);
+        NVT_REQUIRE (_nvt_objs2[_nv_i] != NULL);
+        memset (_nvt_objs2[_nv_i], 0x40, 64);
+    }
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        NVT_CHECK (((unsigned char *)_nvt_objs[_nv_i])[63] == 0x39);
+        nova_free (_nvt_objs[_nv_i]);
+    }
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        nova_free (_nvt_objs2[_nv_i]);
+    }
+    __nv_local_heap_drop (_nv_heap);
+}
+
+/* user-040 */
+static void nvt_drop_async (void)
+{
+    /* Disowning takes the head (and the local fast path) away. */
+    nova_heap_t * _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+    void * _nv_obj = nova_alloc (_nv_heap, 64);
+    NVT_REQUIRE (_nv_obj != NULL);
+    nova_block_t * _nv_block = __nv_smobj_block (_nv_obj);
+    __nv_local_lkg_disown (&_nv_heap->nv_lkgs[__nv_lindex (64)]);
+    NVT_CHECK (_nv_heap->nv_lkgs[__nv_lindex (64)].nv_head == NULL);
+    NVT_CHECK (!(_nv_block->nv_blfl & NOVA_BLFL_ISHEAD) && _nv_block->nv_owner == 0);
+    nova_free (_nv_obj);
+    __nv_local_heap_drop (_nv_heap);
+
+    /* The owner keeps freeing while the maintenance thread drops the heap. */
+    NVT_REQUIRE (nova_ok == nova_maint_start (_nvt_root, 1, (nvi_t)-1));
+    for (int _nv_r = 0; _nv_r < 8; _nv_r++) {
+        _nv_heap = __nvt_local (_nvt_reg);
+        NVT_REQUIRE (_nv_heap != NULL);
+        for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+            _nvt_objs[_nv_i] = nova_alloc (_nv_heap, 16 + (_nv_i % 5) * 40);
+            NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+            memset (_nvt_objs[_nv_i], (int)(_nv_i & 0xff), 16);
+        }
+        for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i += 2) {
+            nova_free (_nvt_objs[_nv_i]);
+        }
+        NVT_CHECK (nova_ok == nova_heap_drop_async (_nv_heap));
+        for (nvi_t _nv_i = 1; _nv_i < NVT_N; _nv_i += 2) {
+            NVT_CHECK (*(unsigned char *)_nvt_objs[_nv_i] == (_nv_i & 0xff));
+            nova_free (_nvt_objs[_nv_i]);
+        }
+    }
+    NVT_CHECK (nova_ok == nova_maint_stop ());
+
+    /* No maintenance thread: dropped on the spot. */
+    _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+    _nv_obj = nova_alloc (_nv_heap, 64);
+    NVT_CHECK (nova_ok == nova_heap_drop_async (_nv_heap));
+    nova_free (_nv_obj);
+}
+
+/* user-041 */
+static void nvt_reset (void)
+{
+    nova_heap_t * _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+
+    nvi_t _nv_chunks = 0;
+    for (int _nv_r = 0; _nv_r < 6; _nv_r++) {
+        for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+            _nvt_objs[_nv_i] = nova_alloc (_nv_heap, 16 + (_nv_i % 6) * 48);
+            NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+            memset (_nvt_objs[_nv_i], 0xab, 16);
+        }
+        NVT_CHECK (__nvt_distinct (_nvt_objs, NVT_N));
+        /* Some of them freed concurrently; the reset takes care of the rest. */
+        nvt_frees_t _nv_f = { _nvt_objs, NVT_N, 3 };
+        pthread_t _nv_th;
+        pthread_create (&_nv_th, NULL, __nvt_free_thread, &_nv_f);
+        NVT_CHECK (nova_heap_reset (_nv_heap) > 0);
+        pthread_join (_nv_th, NULL);
+        /* Every round after the first fits in the blocks the heap already has.
+         */
+        if (_nv_r == 1) {
+            _nv_chunks = __nvt_nchunks (_nvt_root);
+        } else if (_nv_r > 1) {
+            NVT_CHECK (__nvt_nchunks (_nvt_root) == _nv_chunks);
+        }
+    }
+    __nv_local_heap_drop (_nv_heap);
+}
+
+static long _nvt_nctor, _nvt_ndtor;
+
+static void __nvt_ctor (void * nv_obj)
+{
+    *(uint32_t *)nv_obj = 0x5eed;
+    _nvt_nctor++;
+}
+
+static void __nvt_dtor (void * nv_obj)
+{
+    NVT_CHECK (*(uint32_t *)nv_obj == 0x5eed);
+    *(uint32_t *)nv_obj = 0;
+    _nvt_ndtor++;
+}
+
+/* user-042 */
+static void nvt_objcache (void)
+{
+    nova_objcache_t * _nv_cache;
+    NVT_REQUIRE (nova_ok == nova_objcache_create (&_nv_cache, _nvt_reg, 64, __nvt_ctor, __nvt_dtor));
+
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        _nvt_objs[_nv_i] = nova_objcache_alloc (_nv_cache);
+        NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+        NVT_CHECK (*(uint32_t *)_nvt_objs[_nv_i] == 0x5eed);
+    }
+    NVT_CHECK (_nvt_nctor >= NVT_N);
+
+    /* Freed objects come back constructed, without running the constructor. */
+    const long _nv_ctors = _nvt_nctor;
+    __nvt_free_remotely (_nvt_objs, NVT_N, 2);
+    for (nvi_t _nv_i = 1; _nv_i < NVT_N; _nv_i += 2) {
+        nova_free (_nvt_objs[_nv_i]);
+    }
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        _nvt_objs[_nv_i] = nova_objcache_alloc (_nv_cache);
+        NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+        NVT_CHECK (*(uint32_t *)_nvt_objs[_nv_i] == 0x5eed);
+    }
+    NVT_CHECK (_nvt_nctor == _nv_ctors);
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        nova_free (_nvt_objs[_nv_i]);
+    }
+
+    /* Every object that was constructed gets destructed, once. */
+    NVT_CHECK (nova_objcache_reap (_nv_cache) > 0);
+    NVT_CHECK (nova_ok == nova_objcache_drop (_nv_cache));
+    NVT_CHECK (_nvt_nctor == _nvt_ndtor);
+}
+
+typedef struct nvt_v3
+{
+    double nv_x, nv_y, nv_z;
+} nvt_v3_t;
+
+/* user-044 */
+static void nvt_typed_alloc (void)
+{
+    nova_heap_t * _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+
+    for (nvi_t _nv_sz = 1; _nv_sz < 200000; _nv_sz += 97) {
+        NVT_CHECK (NOVA_CANONICAL_OSZ (_nv_sz) == __nv_canonicalize_osz (_nv_sz));
+        NVT_CHECK (NOVA_LINDEX (_nv_sz) == __nv_lindex (_nv_sz));
+    }
+    NVT_CHECK (NOVA_CANONICAL_OSZ ((nvi_t)-1) == (nvi_t)-1 && NOVA_LINDEX ((nvi_t)-1) == ~(nvi_t)0);
+    nvt_v3_t * _nv_v = NOVA_NEW (_nv_heap, nvt_v3_t);
+    NVT_REQUIRE (_nv_v != NULL);
+    NVT_CHECK (nova_usable_size (_nv_v) == 32 && ((uintptr_t)_nv_v & 31) == 0);
+    _nv_v->nv_z = 1.0;
+    nova_free (_nv_v);
+    void * _nv_obj = nova_alloc_const (_nv_heap, 100);
+    NVT_CHECK (_nv_obj != NULL && nova_usable_size (_nv_obj) == 128);
+    nova_free (_nv_obj);
+    _nv_obj = nova_alloc_const (_nv_heap, 100000);
+    NVT_CHECK (_nv_obj != NULL && nova_usable_size (_nv_obj) >= 100000);
+    nova_free (_nv_obj);
+
+    __nv_local_heap_drop (_nv_heap);
+}
+
+static void * __nvt_free_inline_thread (void * nv_arg)
+{
+    void ** _nv_objs = nv_arg;
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i += 4) {
+        nova_free_inline (_nv_objs[_nv_i]);
+    }
+    return NULL;
+}
+
+/* user-045 */
+static void nvt_inline_paths (void)
+{
+    nova_heap_t * _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        const nvi_t _nv_sz = (_nv_i % 512 == 0) ? 40000 : 1 + (_nv_i * 7919) % 3000;
+        _nvt_objs[_nv_i]   = nova_alloc_inline (_nv_heap, _nv_sz);
+        NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+        NVT_CHECK (nova_usable_size (_nvt_objs[_nv_i]) >= _nv_sz);
+        memset (_nvt_objs[_nv_i], (int)(_nv_i & 0xff), _nv_sz);
+    }
+    NVT_CHECK (__nvt_distinct (_nvt_objs, NVT_N));
+    pthread_t _nv_th;
+    pthread_create (&_nv_th, NULL, __nvt_free_inline_thread, _nvt_objs);
+    pthread_join (_nv_th, NULL);
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        if (_nv_i % 4) {
+            NVT_CHECK (*(unsigned char *)_nvt_objs[_nv_i] == (_nv_i & 0xff));
+            nova_free_inline (_nvt_objs[_nv_i]);
+        }
+    }
+    nova_free_inline (NULL);
+    NVT_CHECK (nova_alloc_inline (_nv_heap, (nvi_t)-1) == NULL);
+
+    __nv_local_heap_drop (_nv_heap);
+}
+
+static void * __nvt_default_heap_thread (void * nv_arg)
+{
+    void ** _nv_objs = nv_arg;
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        _nv_objs[_nv_i] = nova_malloc (16 + (_nv_i % 50) * 8);
+        if (_nv_objs[_nv_i] != NULL) {
+            memset (_nv_objs[_nv_i], 0x46, 16);
+        }
+    }
+    if (nova_default_heap () != nova_default_heap ()) {
+        return NULL;
+    }
+    return (void *)(uintptr_t)nova_thread_id ();
+}
+
+/* user-046 */
+static void nvt_default_heap (void)
+{
+    NVT_REQUIRE (nova_ok == nova_set_default_parent (_nvt_reg));
+
+    /* Made on first use, with a thread id, and dropped at thread exit; the
+     * objects outlive it, and the id goes to the next thread.
+     */
+    nova_tid_t _nv_tids[2];
+    for (int _nv_r = 0; _nv_r < 2; _nv_r++) {
+        pthread_t _nv_th;
+        void * _nv_ret;
+        pthread_create (&_nv_th, NULL, __nvt_default_heap_thread, _nvt_objs);
+        pthread_join (_nv_th, &_nv_ret);
+        _nv_tids[_nv_r] = (nova_tid_t)(uintptr_t)_nv_ret;
+        NVT_CHECK (_nv_tids[_nv_r] != 0);
+        for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+            NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+            NVT_CHECK (*(unsigned char *)_nvt_objs[_nv_i] == 0x46);
+            nova_free (_nvt_objs[_nv_i]);
+        }
+    }
+    NVT_CHECK (_nv_tids[0] == _nv_tids[1]);
+}
+
+typedef struct nvt_handoff
+{
+    nova_tid_t nv_to;
+    nova_heap_t * nv_heap;
+} nvt_handoff_t;
+
+static void * __nvt_handoff_thread (void * nv_arg)
+{
+    nvt_handoff_t * _nv_h = nv_arg;
+    __nv_tid_thread_init ();
+    _nv_h->nv_heap = __nvt_local (_nvt_reg);
+    if (_nv_h->nv_heap != NULL) {
+        for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+            _nvt_objs[_nv_i] = nova_alloc (_nv_h->nv_heap, 8 + (_nv_i % 20) * 8);
+        }
+        nova_heap_transfer (_nv_h->nv_heap, _nv_h->nv_to);
+    }
+    __nv_tid_thread_drop ();
+    return NULL;
+}
+
+/* user-047 */
+static void nvt_transfer (void)
+{
+    nvt_handoff_t _nv_h = { nova_thread_id (), NULL };
+    NVT_REQUIRE (_nv_h.nv_to != 0);
+    pthread_t _nv_th;
+    pthread_create (&_nv_th, NULL, __nvt_handoff_thread, &_nv_h);
+    pthread_join (_nv_th, NULL);
+    NVT_REQUIRE (_nv_h.nv_heap != NULL);
+
+    /* Every block of the heap is ours now. */
+    for (nvi_t _nv_li = 1; _nv_li < _nv_h.nv_heap->nv_ln; _nv_li++) {
+        nova_lkg_t * _nv_lkg = &_nv_h.nv_heap->nv_lkgs[_nv_li];
+        NVT_CHECK (_nv_lkg->nv_head == NULL || _nv_lkg->nv_head->nv_owner == _nv_h.nv_to);
+        for (nvi_t _nv_bi = 0; _nv_bi < NOVA_LKG_NBINS; _nv_bi++) {
+            for (nova_block_t * _nvc = _nv_lkg->nv_bins[_nv_bi]; _nvc != NULL; _nvc = _nvc->nv_lkgnx) {
+                NVT_CHECK (_nvc->nv_owner == _nv_h.nv_to);
+            }
+        }
+    }
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+        nova_free (_nvt_objs[_nv_i]);
+        _nvt_objs[_nv_i] = nova_alloc (_nv_h.nv_heap, 24);
+        NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+    }
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        nova_free (_nvt_objs[_nv_i]);
+    }
+    __nv_local_heap_drop (_nv_h.nv_heap);
+}
+
+static pthread_barrier_t _nvt_barrier;
+
+static void * __nvt_producer_thread (void * nv_arg)
+{
+    nova_heap_t * _nv_reg = nv_arg;
+    __nv_tid_thread_init ();
+    nova_heap_t * _nv_heap = __nvt_local (_nv_reg);
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        _nvt_objs[_nv_i] = nova_alloc (_nv_heap, 64);
+    }
+    /* Stay alive (and keep the heap) while the consumer frees. */
+    pthread_barrier_wait (&_nvt_barrier);
+    pthread_barrier_wait (&_nvt_barrier);
+    __nv_local_heap_drop (_nv_heap);
+    __nv_tid_thread_drop ();
+    return NULL;
+}
+
+static void * __nvt_consumer_thread (void * nv_arg)
+{
+    (void)nv_arg;
+    nova_default_heap ();
+    pthread_barrier_wait (&_nvt_barrier);
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        nova_free (_nvt_objs[_nv_i]);
+    }
+    pthread_barrier_wait (&_nvt_barrier);
+    return NULL;
+}
+
+/* user-048 */
+static void nvt_migration (void)
+{
+    nova_heap_t * _nv_preg = __nvt_regional (_nvt_root);
+    nova_heap_t * _nv_creg = __nvt_regional (_nvt_root);
+    NVT_REQUIRE (_nv_preg != NULL && _nv_creg != NULL);
+    NVT_REQUIRE (nova_ok == nova_set_default_parent (_nv_creg));
+
+    /* Blocks emptied by the consumer end up on the consumer's side. */
+    pthread_barrier_init (&_nvt_barrier, NULL, 2);
+    pthread_t _nv_p, _nv_c;
+    pthread_create (&_nv_p, NULL, __nvt_producer_thread, _nv_preg);
+    pthread_create (&_nv_c, NULL, __nvt_consumer_thread, NULL);
+    pthread_join (_nv_p, NULL);
+    pthread_join (_nv_c, NULL);
+    pthread_barrier_destroy (&_nvt_barrier);
+
+    NVT_CHECK (__nvt_ulkg_count (&_nv_creg->nv_lkgs[0]) > 0);
+    NVT_CHECK (nova_ok == nova_set_default_parent (_nvt_reg));
+}
+
+static int _nvt_epoch_go, _nvt_epoch_done;
+
+static void * __nvt_deferring_thread (void * nv_arg)
+{
+    (void)nv_arg;
+    nova_free_deferred (nova_malloc (32));
+    __atomic_store_n (&_nvt_epoch_go, 1, __ATOMIC_RELEASE);
+    while (!__atomic_load_n (&_nvt_epoch_done, __ATOMIC_ACQUIRE))
+        ;
+    return NULL;
+}
+
+/* user-049 */
+static void nvt_epoch (void)
+{
+    nova_quiesce ();
+
+    /* Not freed right away, but two epochs later. */
+    unsigned char * _nv_obj = nova_malloc (48);
+    NVT_REQUIRE (_nv_obj != NULL);
+    memset (_nv_obj, 0x49, 48);
+    NVT_CHECK (nova_ok == nova_free_deferred (_nv_obj));
+    NVT_CHECK (nova_ok == nova_free_deferred (NULL));
+    NVT_CHECK (_nv_obj[47] == 0x49);
+    nvi_t _nv_freed = 0;
+    for (int _nv_i = 0; _nv_i < 4; _nv_i++) {
+        _nv_freed += nova_quiesce ();
+    }
+    NVT_CHECK (_nv_freed == 1);
+
+    /* A thread that only defers doesn't hold anybody up. */
+    pthread_t _nv_th;
+    pthread_create (&_nv_th, NULL, __nvt_deferring_thread, NULL);
+    while (!__atomic_load_n (&_nvt_epoch_go, __ATOMIC_ACQUIRE))
+        ;
+    NVT_CHECK (nova_ok == nova_free_deferred (nova_malloc (48)));
+    _nv_freed = 0;
+    for (int _nv_i = 0; _nv_i < 4; _nv_i++) {
+        _nv_freed += nova_quiesce ();
+    }
+    NVT_CHECK (_nv_freed == 1);
+    __atomic_store_n (&_nvt_epoch_done, 1, __ATOMIC_RELEASE);
+    pthread_join (_nv_th, NULL);
+}
+
+/* user-050 */
+static void nvt_alloc_near (void)
+{
+    nova_heap_t * _nv_heap = __nvt_local (_nvt_reg);
+    NVT_REQUIRE (_nv_heap != NULL);
+
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        _nvt_objs[_nv_i] = nova_alloc (_nv_heap, 200);
+        NVT_REQUIRE (_nvt_objs[_nv_i] != NULL);
+    }
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i += 4) {
+        nova_free (_nvt_objs[_nv_i]);
+    }
+    __nvt_free_remotely (_nvt_objs + 1, NVT_N - 1, 4);
+
+    /* Hints into blocks with room left land in the same block. */
+    nvi_t _nv_hits = 0, _nv_tries = 0;
+    for (nvi_t _nv_i = 2; _nv_i < NVT_N; _nv_i += 4) {
+        void * _nv_obj = nova_alloc_near (_nv_heap, _nvt_objs[_nv_i], 200);
+        NVT_REQUIRE (_nv_obj != NULL);
+        _nv_tries++;
+        _nv_hits += __nv_smobj_block (_nv_obj) == __nv_smobj_block (_nvt_objs[_nv_i]);
+        _nvt_objs[_nv_i - 2] = _nv_obj;
+    }
+    NVT_CHECK (_nv_hits > _nv_tries / 2);
+    /* No hint: same as nova_alloc. */
+    void * _nv_obj = nova_alloc_near (_nv_heap, NULL, 100);
+    NVT_CHECK (_nv_obj != NULL);
+    nova_free (_nv_obj);
+
+    for (nvi_t _nv_i = 0; _nv_i < NVT_N; _nv_i++) {
+        if (_nv_i % 4 != 1) {
+            nova_free (_nvt_objs[_nv_i]);
+        }
+    }
+    __nv_local_heap_drop (_nv_heap);
+}
+
+/*******************************************************************************
+ * MAIN
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+static void __nvt_run (const char * nv_name, void (*nv_test) (void))
+{
+    const int _nv_failures = _nvt_failures;
+    nv_test ();
+    printf ("%-24s %s\n", nv_name, _nv_failures == _nvt_failures ? "ok" : "FAILED");
+}
 
 /* Test harness
  */
@@ -9,5 +1168,42 @@ int main (
     printf ("sizeof(nova_block_t): %zu\n", sizeof (nova_block_t));
     printf ("offsetof(nova_chunk_t, nv_blocks): %zu\n", offsetof (struct nova_chunk, nv_blocks[0]));
 
+    __nv_tid_thread_init ();
+
+    __nvt_run ("cfg_geometry", nvt_cfg_geometry);
+
+    if (nova_ok != __nv_root_heap_create (&_nvt_root) || (_nvt_reg = __nvt_regional (_nvt_root)) == NULL) {
+        fprintf (stderr, "couldn't set up the heaps\n");
+        return EXIT_FAILURE;
+    }
+
+    __nvt_run ("aligned_alloc", nvt_aligned_alloc);
+    __nvt_run ("realloc", nvt_realloc);
+    __nvt_run ("occupancy_bins", nvt_occupancy_bins);
+    __nvt_run ("bitmap_blocks", nvt_bitmap_blocks);
+    __nvt_run ("spans", nvt_spans);
+    __nvt_run ("arena", nvt_arena);
+    __nvt_run ("chunk_release", nvt_chunk_release);
+    __nvt_run ("refill_batches", nvt_refill_batches);
+    __nvt_run ("ulkg_stack", nvt_ulkg_stack);
+    __nvt_run ("steal", nvt_steal);
+    __nvt_run ("trim", nvt_trim);
+    __nvt_run ("reclaim", nvt_reclaim);
+    __nvt_run ("drop_splice", nvt_drop_splice);
+    __nvt_run ("drop_async", nvt_drop_async);
+    __nvt_run ("reset", nvt_reset);
+    __nvt_run ("objcache", nvt_objcache);
+    __nvt_run ("typed_alloc", nvt_typed_alloc);
+    __nvt_run ("inline_paths", nvt_inline_paths);
+    __nvt_run ("default_heap", nvt_default_heap);
+    __nvt_run ("transfer", nvt_transfer);
+    __nvt_run ("migration", nvt_migration);
+    __nvt_run ("epoch", nvt_epoch);
+    __nvt_run ("alloc_near", nvt_alloc_near);
+
+    if (_nvt_failures != 0) {
+        printf ("%d check(s) failed\n", _nvt_failures);
+        return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,185 @@
+#include "nova.hpp"
+
+/* std::printf, std::fprintf */
+#include <cstdio>
+/* EXIT_SUCCESS, EXIT_FAILURE */
+#include <cstdlib>
+/* std::list */
+#include <list>
+/* std::map */
+#include <map>
+/* std::pmr::vector */
+#include <vector>
+
+/*******************************************************************************
+ * TEST HARNESS
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Behaviour tests for the C++ interface (nova.hpp); the C interface is covered
+ * by nova_test.c.
+ */
+
+static int _nvt_failures = 0;
+
+#define NVT_CHECK(___nv_expr___)                                                                      \
+    do {                                                                                              \
+        if (!(___nv_expr___)) {                                                                       \
+            std::fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #___nv_expr___);  \
+            _nvt_failures++;                                                                          \
+        }                                                                                             \
+    } while (0)
+
+static nova_heap_t * _nvt_root;
+static nova_heap_t * _nvt_reg;
+
+static void __nvt_run (const char * nv_name, void (*nv_test) ())
+{
+    const int _nv_failures = _nvt_failures;
+    nv_test ();
+    std::printf ("%-24s %s\n", nv_name, _nv_failures == _nvt_failures ? "ok" : "FAILED");
+}
+
+/*******************************************************************************
+ * TESTS
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* user-043 */
+static void nvt_allocator ()
+{
+    nova_heap_t * _nv_heap;
+    if (nova_ok != nv_heap_create (&_nv_heap)) {
+        NVT_CHECK (!"nv_heap_create");
+        return;
+    }
+    nv_heap_bind_parent (_nv_heap, _nvt_reg);
+    __nv_regional_heap_incref (_nvt_reg);
+
+    {
+        /* Nodes come from the installed heap, sized to their own class. */
+        nova::thread_heap_scope _nv_scope (_nv_heap);
+        NVT_CHECK (nova::thread_heap () == _nv_heap);
+
+        std::list<long, nova::allocator<long>> _nv_list;
+        for (long _nv_i = 0; _nv_i < 10000; _nv_i++) {
+            _nv_list.push_back (_nv_i);
+        }
+        long _nv_sum = 0;
+        for (const long & _nv_v : _nv_list) {
+            _nv_sum += _nv_v;
+            NVT_CHECK (((nova_lkg_t *)__nv_smobj_block ((void *)&_nv_v)->nv_lkg)->nv_heap == _nv_heap);
+            NVT_CHECK (__nv_smobj_block ((void *)&_nv_v)->nv_osz < 64);
+        }
+        NVT_CHECK (_nv_sum == 10000L * 9999 / 2);
+
+        std::map<int, int, std::less<int>, nova::allocator<std::pair<const int, int>>> _nv_map;
+        for (int _nv_i = 0; _nv_i < 5000; _nv_i++) {
+            _nv_map[_nv_i * 7] = _nv_i;
+        }
+        NVT_CHECK (_nv_map.size () == 5000 && _nv_map[7 * 4999] == 4999);
+
+        /* Arrays go through the run-time path. */
+        std::vector<int, nova::allocator<int>> _nv_vec (100000, 3);
+        NVT_CHECK (_nv_vec[99999] == 3);
+        NVT_CHECK (nova_usable_size (_nv_vec.data ()) >= 100000 * sizeof (int));
+
+        /* Alignments past the pool's can't be had, one object or many. */
+        struct alignas (4096) nvt_page {
+            char nv_bytes[20000];
+        };
+        nvt_page * _nv_page = nova::allocator<nvt_page> ().allocate (1);
+        NVT_CHECK (((std::uintptr_t)_nv_page & 4095) == 0);
+        nova::allocator<nvt_page> ().deallocate (_nv_page, 1);
+        struct alignas (65536) nvt_huge {
+            char nv_bytes[65536];
+        };
+        for (std::size_t _nv_n = 1; _nv_n <= 2; _nv_n++) {
+            bool _nv_threw = false;
+            try {
+                nova::allocator<nvt_huge> ().allocate (_nv_n);
+            } catch (const std::bad_alloc &) {
+                _nv_threw = true;
+            }
+            NVT_CHECK (_nv_threw);
+        }
+    }
+
+    /* With no scope, it's the default heap. */
+    NVT_CHECK (nova::thread_heap () == nova_default_heap ());
+    NVT_CHECK (nova::allocator<int> () == nova::allocator<double> ());
+
+    __nv_local_heap_drop (_nv_heap);
+}
+
+/* user-043 */
+static void nvt_pmr ()
+{
+    nova::scoped_heap_resource _nv_res (_nvt_reg);
+    nova::heap_resource _nv_plain (_nv_res.heap ());
+    NVT_CHECK (_nv_res.is_equal (_nv_plain));
+
+    {
+        std::pmr::vector<std::pmr::vector<int>> _nv_vv (&_nv_res);
+        for (int _nv_i = 0; _nv_i < 200; _nv_i++) {
+            _nv_vv.emplace_back (std::size_t (_nv_i + 1), _nv_i);
+        }
+        NVT_CHECK (_nv_vv[199].size () == 200 && _nv_vv[199][199] == 199);
+        NVT_CHECK (_nv_vv[150].get_allocator ().resource () == &_nv_res);
+    }
+
+    /* Over-aligned requests are honoured. */
+    void * _nv_obj = _nv_plain.allocate (100, 256);
+    NVT_CHECK (((std::uintptr_t)_nv_obj & 255) == 0);
+    _nv_plain.deallocate (_nv_obj, 100, 256);
+
+    /* release() frees everything at once: round after round of allocations
+     * fit in what the first one took.
+     */
+    std::size_t _nv_chunks = 0;
+    for (int _nv_r = 0; _nv_r < 16; _nv_r++) {
+        for (int _nv_i = 0; _nv_i < 1000; _nv_i++) {
+            *(int *)_nv_res.allocate (1024) = _nv_i;
+        }
+        _nv_res.release ();
+        std::size_t _nv_n = 0;
+        for (nova_chunk_t * _nvc = NOVA_RHEAP_PFX (_nvt_root)->nv_chunks; _nvc != nullptr; _nvc = _nvc->nv_next) {
+            _nv_n++;
+        }
+        if (_nv_r == 0) {
+            _nv_chunks = _nv_n;
+        }
+        NVT_CHECK (_nv_n == _nv_chunks);
+    }
+}
+
+/*******************************************************************************
+ * MAIN
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+int main ()
+{
+    __nv_tid_thread_init ();
+
+    if (nova_ok != __nv_root_heap_create (&_nvt_root) || nova_ok != __nv_regional_heap_create (&_nvt_reg)) {
+        std::fprintf (stderr, "couldn't set up the heaps\n");
+        return EXIT_FAILURE;
+    }
+    nv_heap_bind_parent (_nvt_reg, _nvt_root);
+    __nv_regional_heap_incref (_nvt_root);
+    __nv_regional_heap_incref (_nvt_reg);
+    nova_set_default_parent (_nvt_reg);
+
+    __nvt_run ("allocator", nvt_allocator);
+    __nvt_run ("pmr", nvt_pmr);
+
+    if (_nvt_failures != 0) {
+        std::printf ("%d check(s) failed\n", _nvt_failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
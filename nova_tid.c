@@ -12,7 +12,8 @@ NOVA_DOCSTUB ();
 #if !defined(NOVA_TID_RECYCLING)
 static /* __atomic */ nova_tid_t __nv_tid_next = 1;
 #endif
-static _Thread_local nova_tid_t __nv_tid_local = 0;
+/* Not static: nova_inline.h reads it directly. */
+__thread nova_tid_t __nv_tid_local = 0;
 
 nova_tid_t __nv_tid ()
 {
@@ -24,6 +25,11 @@ nova_tid_t __nv_tid ()
     return __nv_tid_local;
 }
 
+nova_tid_t nova_thread_id (void)
+{
+    return __nv_tid ();
+}
+
 typedef struct nv_tid_recycle_info
 {
     nova_tid_t nv_tid;
@@ -40,7 +46,10 @@ static nv_tid_recycle_chain_t __nv_tid_recycle_chain = {
     .nv_head   = NULL,
     .nv_length = 0
 };
-static nova_mutex_t __nv_tid_recycle_chain_lock;
+/* Statically initialized, so that threads can come and go before (or without)
+ * __nv_tid_recycle_init.
+ */
+static nova_mutex_t __nv_tid_recycle_chain_lock = PTHREAD_MUTEX_INITIALIZER;
 
 nova_res_t __nv_tid_recycle_init ()
 {
@@ -109,9 +118,10 @@ nova_res_t __nv_tid_thread_init ()
          * _nv_mark is currently equal to the nv_tid of the previous link + 1, or,
          * in the case of the start-of-chain scenario, it's 1.
          */
-        _nv_info->nv_tid = _nv_mark;
+        _nv_info->nv_tid  = _nv_mark;
+        _nv_info->nv_next = NULL;
         if (__builtin_expect (_nv_prev != NULL, 1)) {
-
+            _nv_prev->nv_next = _nv_info;
         } else {
             __nv_tid_recycle_chain.nv_head = _nv_info;
         }
@@ -120,6 +130,8 @@ nova_res_t __nv_tid_thread_init ()
     }
 
     nvmutex_unlock (&__nv_tid_recycle_chain_lock);
+
+    __nv_tid_local = _nv_info->nv_tid;
 #endif
 
     return nova_ok;
@@ -149,6 +161,9 @@ nova_res_t __nv_tid_thread_drop ()
         _nv_curr = _nv_curr->nv_next;
     }
     nvmutex_unlock (&__nv_tid_recycle_chain_lock);
+    /* The id may go to the next thread to start now; it isn't ours anymore.
+     */
+    __nv_tid_local = 0;
     if (_nv_curr == NULL) {
         /* Failed to find the relevant tid/no tids in chain
          */
@@ -1 +1,44 @@
 #include "nova.h"
+
+/*******************************************************************************
+ * SIZE CLASSES
+ ******************************************************************************/
+
+NOVA_DOCSTUB ();
+
+/* Size classes are powers of two, starting at NOVA_SMOBJ_MINOSZ.
+ *
+ * This is wasteful in the worst case (just under half of an object can be slack),
+ * but it buys us something that's fairly hard to get otherwise: since pools are
+ * laid out at multiples of the pool size inside a chunk that is aligned to its own
+ * size, every object of class 2^k is aligned to 2^k (up to the alignment of the
+ * pool itself). Aligned allocation therefore falls out of the size class selection,
+ * and we never have to over-allocate and trim.
+ */
+
+nvi_t __nv_canonicalize_osz (nvi_t nv_osz)
+{
+    if (nv_osz <= NOVA_SMOBJ_MINOSZ) {
+        return NOVA_SMOBJ_MINOSZ;
+    }
+    /* No class this large; rounding up could shift by 64.
+     */
+    if (__builtin_expect (nv_osz > NOVA_SPAN_MAXSZ, 0)) {
+        return nv_osz;
+    }
+    /* Round up to the next power of two; nv_osz > 1 here, so the clz is well-defined.
+     */
+    return (nvi_t)1 << (64 - __builtin_clzll ((unsigned long long)(nv_osz - 1)));
+}
+
+nvi_t __nv_lindex (nvi_t nv_osz)
+{
+    /* log2(canonical size) - 1; with NOVA_SMOBJ_MINOSZ=8, the smallest class
+     * lands on linkage 2, which keeps linkage 0 (unsized) and linkage 1 (reserved)
+     * out of the way.
+     */
+    if (__builtin_expect (nv_osz > NOVA_SPAN_MAXSZ, 0)) {
+        return ~(nvi_t)0;
+    }
+    return (nvi_t)__builtin_ctzll ((unsigned long long)__nv_canonicalize_osz (nv_osz)) - 1;
+}